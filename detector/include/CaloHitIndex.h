@@ -0,0 +1,38 @@
+#ifndef CaloHitIndex_h
+#define CaloHitIndex_h 1
+
+#include <cstddef>
+#include <unordered_map>
+
+/**
+ *  Index of the hits of one calorimeter hit collection by cellID.
+ *
+ *  Geant4HitCollection::find compares the cellID of every hit already in the collection, so
+ *  filling a shower with N cells costs O(N^2) comparisons. The sensitive actions keep this index
+ *  next to each of their collections, add every new hit to it and clear it at the end of the event,
+ *  when the collection is handed over. Clearing keeps the buckets, so that after the first events
+ *  the index is filled without rehashing.
+ */
+namespace lcgeo {
+
+  template<typename HIT> class CaloHitIndex {
+  public:
+    /// Hit with the given cellID, nullptr if there is none yet
+    HIT* find(long long cellID) const {
+      typename std::unordered_map<long long, HIT*>::const_iterator it = m_hits.find(cellID);
+      return ( it != m_hits.end() ? it->second : nullptr );
+    }
+    /// Add a hit which was added to the collection
+    void add(long long cellID, HIT* hit) { m_hits.emplace(cellID, hit); }
+    /// Forget all hits, the hits are owned by the collection
+    void clear() { m_hits.clear(); }
+    /// Number of hits in the index
+    std::size_t size() const { return m_hits.size(); }
+
+  private:
+    std::unordered_map<long long, HIT*> m_hits;
+  };
+
+}
+
+#endif // CaloHitIndex_h
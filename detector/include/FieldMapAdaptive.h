@@ -0,0 +1,72 @@
+#ifndef FieldMapAdaptive_h
+#define FieldMapAdaptive_h 1
+
+#include <DD4hep/FieldTypes.h>
+
+#include <cstddef>
+#include <vector>
+
+/**
+ *  Multi-resolution x-y-z field map: the volume is divided into blocks of equal size, and every
+ *  block holds its own uniform grid with 1, 2, 4, ... cells per axis. The coarsest grid which
+ *  reproduces the source fields within the tolerance is chosen per block, so regions with small
+ *  gradients, like the barrel of the solenoid, need few points, while regions with large gradients,
+ *  like the yoke or the final focus magnets, use the finest step.
+ *
+ *  The field is interpolated trilinearly inside of each block. Where blocks of different resolution
+ *  meet, the nodes of the finer block on the common face, edge or corner take the interpolated field
+ *  of the coarser block, so the field is continuous across the blocks. Every block is checked
+ *  against the source fields at the nodes and cell centres of the finest grid; if a constrained
+ *  block exceeds the tolerance there, its coarser neighbours are refined.
+ */
+class FieldMapAdaptive: public dd4hep::CartesianField::Object {
+public:
+
+  struct FieldValues_t {
+    double Bx;
+    double By;
+    double Bz;
+    FieldValues_t(double _Bx, double _By, double _Bz):
+      Bx(_Bx), By(_By), Bz(_Bz) {}
+  };
+
+  struct Block_t {
+    int offset;    // index of the first node of the block in values
+    int nCells;    // cells per axis of the block grid
+  };
+
+  double min[3];                         // lower corner of the map
+  double max[3];                         // upper corner of the map
+  double step[3];                        // finest step-size of the block grids
+  double blockSize[3];                   // size of the blocks
+  int    nBlocks[3];                     // blocks along x, y and z
+  int    nLevels;                        // resolution levels, the finest block grid has 2^(nLevels-1) cells per axis
+  double tolerance;                      // maximum deviation from the source fields at the check points of the blocks
+
+  double bScale;                         //Bfield scale factor, applied at lookup time
+  std::vector< Block_t > blocks;         //Blocks in x-y-z order
+  std::vector< FieldValues_t > values;   //Field values at the nodes of all block grids
+
+  std::vector< dd4hep::CartesianField > bakedFields; //Field elements summed into the field map
+
+public:
+  /// Initializing constructor
+  FieldMapAdaptive();
+  /// Call to access the field components at a given location
+  virtual void fieldComponents(const double* pos, double* field);
+  /// Add the field of a block without bScale at frac, the position in the block in units of blockSize
+  void blockField(std::size_t blockIndex, const double* frac, double* field) const;
+  /// Set the blocks covering min to max with the finest step-size step and nLevels resolution levels
+  void setGrid(const double* gridMin, const double* gridMax, const double* finestStep, int levels);
+  /// Fill the blocks with the sum of the given fields, choosing the coarsest grid within the tolerance per block
+  /// with conforming faces between the blocks
+  void fillFromFields(const std::vector< dd4hep::CartesianField >& fields);
+  /// Number of nodes of a uniform grid with the finest step-size covering the same volume
+  std::size_t uniformSize() const;
+  /// Maximum deviation of the interpolated field from the sum of the baked fields at nPoints random points.
+  /// If given, worstPos is filled with the position of the maximum deviation
+  double maxDeviationFromFields(int nPoints, double* worstPos = nullptr);
+};
+
+
+#endif // FieldMapAdaptive_h
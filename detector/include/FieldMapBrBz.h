@@ -1,8 +1,13 @@
 #ifndef FieldMap_rzBrBz_h
 #define FieldMap_rzBrBz_h 1
 
+#include "FieldMapCache.h"
+#include "FieldMapCellCache.h"
+
 #include <DD4hep/FieldTypes.h>
 
+#include <cstddef>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -30,18 +35,64 @@ public:
   int zOrdering;                           // z   coordinate ordering, 1(-1) if from low-to-high (high-to-low)
   double zMin,   zMax,   zStep,   zScale;  // min, max, step-size and scale factor of z   coordinate in fieldmap
 
-  double bScale;                           //Bfield scale factor
-  std::vector< FieldValues_t > fieldMap;   //List with the field map points
+  double bScale;                           //Bfield scale factor, applied at lookup time
+  std::vector< FieldValues_t > fieldMap;   //List with the field map points, not scaled by bScale
+
+  const FieldValues_t* fieldMapPtr;        //Field map points used in the interpolation, in fieldMap or in the mapped cache file
+  std::shared_ptr<const lcgeo::FieldMapCache> cache; //Mapped cache file holding the field map points, if any
+  std::string sourceFile;                //ROOT file the field map points were read from, directly or through the cache file, empty otherwise
+  double sourceCoorUnits, sourceBfieldUnits; //Units of the coordinates and the field in sourceFile
+
+  int interpolation;                       // interpolation of the field map, 1(3) for bilinear (bicubic B-spline)
+  std::vector< FieldValues_t > splineCoefficients; //Cubic B-spline coefficients of the field map points, used with interpolation == 3
+  const FieldValues_t* splineCoefficientsPtr; //Cubic B-spline coefficients used in the interpolation, in splineCoefficients or in the shared grid
+
+  std::shared_ptr<const FieldMapBrBz> sharedGrid; //Field map holding the points used by this one, if shared through the FieldMapRegistry
+
+  uint64_t id;                             // unique id of this field map, tags its cells in the per-thread last-cell caches
+  std::shared_ptr<lcgeo::FieldMapCellCounters> cellCacheCounters; //Lookup counters of the per-thread last-cell cache, null if the cache is not used
 
 public:
   /// Initializing constructor
   FieldMapBrBz();
+  /// Destructor, printing the hit rate of the last-cell cache
+  virtual ~FieldMapBrBz();
+  /// Add the last-cell cache lookups of the calling thread not yet counted to cellCacheCounters
+  void flushCellCache() const;
   /// Call to access the field components at a given location
   virtual void fieldComponents(const double* pos, double* field);
+  /// Call to access the field components at nPoints locations, pos and field hold nPoints consecutive (x,y,z) triplets
+  void fieldComponentsBatch(const double* pos, double* field, std::size_t nPoints);
   /// Field the FieldMap from the the tree specified in the XML
   void fillFieldMapFromTree(const std::string& filename, double coorUnits, double BfieldUnits);
+  /// Map the FieldMap from the binary cache file, false if it is missing or out of date
+  bool fillFieldMapFromCache(const std::string& cacheFile, const std::string& filename, double coorUnits, double BfieldUnits);
+  /// Write the FieldMap to the binary cache file
+  void writeFieldMapCache(const std::string& cacheFile, const std::string& filename, double coorUnits, double BfieldUnits) const;
+  /// Cache file header describing the configuration of this FieldMap
+  lcgeo::FieldMapCacheHeader cacheHeader(const std::string& filename, double coorUnits, double BfieldUnits) const;
   /// Get global index in the Field map
   int getGlobalIndex(const int rBin, const int zBin);
+  /// Get the lower and upper corner bins and the normalized coordinates of the (rho,z) cell containing pos, false if outside of the map.
+  /// If given, lower is filled with the (rho,z) coordinates of the lower corner of the cell
+  bool getCell(const double* pos, int* bin0, int* bin1, double* frac, double* lower = nullptr) const;
+  /// Same as getCell, for the rho and z coordinates of the position
+  bool getCellRZ(double rho, double z, int* bin0, int* bin1, double* frac, double* lower = nullptr) const;
+  /// Add the Br and Bz components interpolated in the cell given by getCell to field
+  void interpolate(const int* bin0, const int* bin1, const double* frac, double* field) const;
+  /// Fill the cubic B-spline coefficients of the field map used with interpolation == 3
+  void fillSplineCoefficients();
+  /// Use the field map points, grid and interpolation settings of another field map, which is kept alive by this one
+  void useSharedGrid(const std::shared_ptr<const FieldMapBrBz>& grid);
+
+private:
+  /// Bicubic B-spline interpolation using the 4x4 nodes around the cell
+  void interpolateCubic(const int* bin0, const double* frac, double* field) const;
+  /// Add the Br and Bz components interpolated in the cells of a block of lcgeo::laneBlockSize points, one lane per point
+  void interpolateBlock(const int (*bin0)[2], const int (*bin1)[2], const double (*frac)[2], double (*field)[2]) const;
+  /// Bilinear interpolation from the last cell of the calling thread, refilled if (rho,z) is outside of it.
+  /// False if (rho,z) is outside of the map
+  bool interpolateCached(double rho, double z, double* field) const;
 };
 
 
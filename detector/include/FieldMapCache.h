@@ -0,0 +1,79 @@
+#ifndef FieldMapCache_h
+#define FieldMapCache_h 1
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace lcgeo {
+
+  /// Header of the binary field map cache files, followed by the grid of field values
+  struct FieldMapCacheHeader {
+    char     magic[8];           // file identifier, "LCGEOFMC"
+    uint32_t version;            // version of the cache format
+    uint32_t mapType;            // 1(2) for FieldMapBrBz (FieldMapXYZ) grids, 3 for FieldMapXYZ grids baked from other fields
+    uint32_t storage;            // layout of the field values following the header
+    int32_t  coorsOrder;         // order with which the coordinates are scanned in the source tree
+    char     strCoorsOrder[8];   // same as string, e.g. RZ or XYZ
+    int32_t  nBins[3];           // bins of the grid axes, rho-z or x-y-z
+    int32_t  ordering[3];        // ordering of the grid axes in the source tree, 1(-1) for low-to-high (high-to-low)
+    double   min[3];             // min of the grid axes
+    double   max[3];             // max of the grid axes
+    double   step[3];            // step-size of the grid axes
+    double   coorUnits;          // units of the coordinates in the source tree
+    double   BfieldUnits;        // units of the field in the source tree
+    double   bScale;             // field scale factor applied to the cached values, 1 since version 2
+    uint64_t configChecksum;     // checksum of the tree and variable names
+    uint64_t sourceSize;         // size of the source ROOT file in bytes
+    uint64_t sourceChecksum;     // checksum of the source, for a ROOT file only computed when writing the cache
+    uint64_t payloadSize;        // size of the field values following the header in bytes
+    int64_t  sourceModified;     // modification time of the source ROOT file in ns since the epoch
+    uint64_t sourceInode;        // inode of the source ROOT file
+    char     padding[56];        // keep the field values 64 byte aligned
+  };
+
+  /**
+   *  Read-only memory mapping of a binary field map cache file. All processes mapping the same
+   *  cache file share one copy of the field values in the page cache.
+   *
+   *  The cache is produced once from the field map read from the ROOT file and is only used if
+   *  the header agrees with the configuration of the field element and with the size, modification
+   *  time and inode of the source ROOT file, so that opening the cache does not read the source.
+   *  The checksum of the ROOT file is only computed when the cache is written, sources held in
+   *  memory are compared by their checksum.
+   */
+  class FieldMapCache {
+  public:
+    /// Map the cache file, nullptr if it does not exist or does not agree with the expected header
+    static std::shared_ptr<const FieldMapCache> open(const std::string& cacheFile, const FieldMapCacheHeader& expected);
+    /// Write the header and the field values to the cache file, false (and a warning) on failure
+    static bool write(const std::string& cacheFile, const FieldMapCacheHeader& header, const void* payload);
+    /// Header with the magic string, version, config checksum and the size, modification time and inode of the source ROOT file filled
+    static FieldMapCacheHeader makeHeader(const std::string& filename, const std::string& config);
+    /// Fill the checksum of the source ROOT file, reading the whole file; called when writing the cache
+    static void addSourceChecksum(FieldMapCacheHeader& header, const std::string& filename);
+    /// Header with the magic string, version and the checksums of a source held in memory filled
+    static FieldMapCacheHeader makeHeader(const void* source, std::size_t sourceSize, const std::string& config);
+    /// 64 bit FNV-1a checksum of a buffer
+    static uint64_t checksum(const void* data, std::size_t size, uint64_t seed = 14695981039346656037ULL);
+
+    ~FieldMapCache();
+    FieldMapCache(const FieldMapCache&) = delete;
+    FieldMapCache& operator=(const FieldMapCache&) = delete;
+
+    /// Header of the mapped cache file
+    const FieldMapCacheHeader& header() const { return *static_cast<const FieldMapCacheHeader*>(m_address); }
+    /// Field values following the header
+    const void* payload() const { return static_cast<const char*>(m_address) + sizeof(FieldMapCacheHeader); }
+
+  private:
+    FieldMapCache(void* address, std::size_t size) : m_address(address), m_size(size) {}
+
+    void*       m_address;
+    std::size_t m_size;
+  };
+
+}
+
+#endif // FieldMapCache_h
@@ -0,0 +1,115 @@
+#ifndef FieldMapCellCache_h
+#define FieldMapCellCache_h 1
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+/**
+ *  Per-thread cache of the last grid cell used by a field map.
+ *
+ *  Consecutive steps of a track mostly fall into the same cell of the field map, so the corner
+ *  values and the edges of the last cell are kept per thread and reused as long as the position
+ *  stays inside the cell. The field map objects are shared between the worker threads of DDG4,
+ *  hence the cells live in thread_local storage and are tagged with the id of the field map which
+ *  filled them. The lookup counters are summed per thread and added to the counters of the field
+ *  map every few thousand lookups, when the thread ends and, for the thread destroying the field
+ *  map, before its counters are printed.
+ */
+namespace lcgeo {
+
+  /// Lookup counters of the last-cell caches of one field map, summed over all threads
+  class FieldMapCellCounters {
+  public:
+    void add(uint64_t nHits, uint64_t nMisses) {
+      m_hits   += nHits;
+      m_misses += nMisses;
+    }
+    uint64_t hits()   const { return m_hits; }
+    uint64_t misses() const { return m_misses; }
+    double hitRate() const {
+      const uint64_t total = hits() + misses();
+      return ( total > 0 ? double(hits())/total : 0.0 );
+    }
+
+  private:
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+  };
+
+  /// Unique id of a field map, never reused for the lifetime of the process
+  inline uint64_t newFieldMapId() {
+    static std::atomic<uint64_t> lastId{0};
+    return ++lastId;
+  }
+
+  /// Last cell of a grid with NDIM axes and NVALUES field components per node, used by one thread
+  template<int NDIM, int NVALUES> struct FieldMapCell {
+    static const int nCorners = 1 << NDIM;
+    static const uint64_t flushInterval = 4096;
+
+    uint64_t owner = 0;                                // id of the field map which filled the cell, 0 if unused
+    double   lower[NDIM];                              // lower edges of the cell
+    double   upper[NDIM];                              // upper edges of the cell, equal to lower at the upper end of the map
+    double   corners[nCorners][NVALUES];               // field values at the corners, corner index bit d set for the upper edge of axis d
+    uint64_t hits = 0;                                 // lookups inside the cell not yet added to the counters
+    uint64_t misses = 0;                               // lookups outside of the cell not yet added to the counters
+    std::shared_ptr<FieldMapCellCounters> counters;    // counters of the field map which filled the cell
+
+    ~FieldMapCell() { flush(); }
+
+    /// Add the pending hits and misses to the counters of the field map
+    void flush() {
+      if(counters) counters->add(hits, misses);
+      hits = 0;
+      misses = 0;
+    }
+
+    /// Whether the coordinates are inside of the cell, false for NaN
+    bool contains(const double* coord) const {
+      for(int d=0;d<NDIM;d++) {
+        if(not (coord[d] >= lower[d] && coord[d] <= upper[d])) return false;
+      }
+      return true;
+    }
+
+    /// Count a lookup, the counters of the field map are updated every flushInterval lookups
+    void count(bool hit) {
+      if(hit) ++hits;
+      else    ++misses;
+      if(hits + misses >= flushInterval) flush();
+    }
+  };
+
+  /// Cell of the calling thread in which the field map with the given id is kept
+  template<int NDIM, int NVALUES> FieldMapCell<NDIM, NVALUES>& threadCellSlot(uint64_t owner) {
+    //A few cells per thread, so that overlaid field maps do not evict each other
+    static thread_local FieldMapCell<NDIM, NVALUES> cells[4];
+    return cells[owner % 4];
+  }
+
+  /// Cell of the calling thread for the field map with the given id, emptied if it was used by another field map
+  template<int NDIM, int NVALUES>
+  FieldMapCell<NDIM, NVALUES>& threadCell(uint64_t owner, const std::shared_ptr<FieldMapCellCounters>& counters) {
+    FieldMapCell<NDIM, NVALUES>& cell = threadCellSlot<NDIM, NVALUES>(owner);
+    if(cell.owner != owner) {
+      cell.flush();
+      cell.owner    = owner;
+      cell.counters = counters;
+      for(int d=0;d<NDIM;d++) {
+        cell.lower[d] = 1.0;
+        cell.upper[d] = 0.0;
+      }
+    }
+    return cell;
+  }
+
+  /// Add the pending lookups of the calling thread for the field map with the given id to its counters
+  template<int NDIM, int NVALUES> void flushThreadCell(uint64_t owner) {
+    FieldMapCell<NDIM, NVALUES>& cell = threadCellSlot<NDIM, NVALUES>(owner);
+    if(cell.owner == owner) cell.flush();
+  }
+
+}
+
+#endif // FieldMapCellCache_h
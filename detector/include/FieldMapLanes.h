@@ -0,0 +1,83 @@
+#ifndef FieldMapLanes_h
+#define FieldMapLanes_h 1
+
+#include <cmath>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/**
+ *  Double precision lanes for the batched evaluation of the field maps.
+ *
+ *  The points of a block are interpolated together with one lane per point: with AVX2 a LaneD holds
+ *  four points and the corner values are gathered, with SSE2 it holds two points loaded one lane at
+ *  a time, otherwise it is a single double. The single point and the batched kernels do the same
+ *  operations in the same order, with the multiply-adds spelled out by mulAdd and laneMulAdd, so that
+ *  the compiler cannot contract them differently and both give the same result.
+ */
+namespace lcgeo {
+
+  /// Number of points evaluated together by fieldComponentsBatch
+  const int laneBlockSize = 8;
+
+  /// a*b + c, rounded once if the target has a fast fused multiply-add
+  inline double mulAdd(double a, double b, double c) {
+#if defined(FP_FAST_FMA)
+    return std::fma(a, b, c);
+#else
+    return a*b + c;
+#endif
+  }
+
+#if defined(__AVX2__)
+  typedef __m256d LaneD;
+  const int laneWidth = 4;
+  inline LaneD laneSet(double a)             { return _mm256_set1_pd(a); }
+  inline LaneD laneLoad(const double* p)     { return _mm256_loadu_pd(p); }
+  inline void  laneStore(double* p, LaneD a) { _mm256_storeu_pd(p, a); }
+  inline LaneD laneSub(LaneD a, LaneD b)     { return _mm256_sub_pd(a, b); }
+  inline LaneD laneMul(LaneD a, LaneD b)     { return _mm256_mul_pd(a, b); }
+#if defined(FP_FAST_FMA)
+  inline LaneD laneMulAdd(LaneD a, LaneD b, LaneD c) { return _mm256_fmadd_pd(a, b, c); }
+#else
+  inline LaneD laneMulAdd(LaneD a, LaneD b, LaneD c) { return _mm256_add_pd(_mm256_mul_pd(a, b), c); }
+#endif
+  /// base[index[i]] in lane i, the masked gather with all lanes enabled avoids an undefined source operand
+  inline LaneD laneGather(const double* base, const int* index) {
+    return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), base, _mm_loadu_si128(reinterpret_cast<const __m128i*>(index)),
+                                    _mm256_castsi256_pd(_mm256_set1_epi64x(-1)), sizeof(double));
+  }
+#elif defined(__SSE2__)
+  typedef __m128d LaneD;
+  const int laneWidth = 2;
+  inline LaneD laneSet(double a)             { return _mm_set1_pd(a); }
+  inline LaneD laneLoad(const double* p)     { return _mm_loadu_pd(p); }
+  inline void  laneStore(double* p, LaneD a) { _mm_storeu_pd(p, a); }
+  inline LaneD laneSub(LaneD a, LaneD b)     { return _mm_sub_pd(a, b); }
+  inline LaneD laneMul(LaneD a, LaneD b)     { return _mm_mul_pd(a, b); }
+#if defined(FP_FAST_FMA)
+  inline LaneD laneMulAdd(LaneD a, LaneD b, LaneD c) { return _mm_fmadd_pd(a, b, c); }
+#else
+  inline LaneD laneMulAdd(LaneD a, LaneD b, LaneD c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+#endif
+  /// base[index[i]] in lane i
+  inline LaneD laneGather(const double* base, const int* index) {
+    return _mm_set_pd(base[index[1]], base[index[0]]);
+  }
+#else
+  typedef double LaneD;
+  const int laneWidth = 1;
+  inline LaneD laneSet(double a)             { return a; }
+  inline LaneD laneLoad(const double* p)     { return *p; }
+  inline void  laneStore(double* p, LaneD a) { *p = a; }
+  inline LaneD laneSub(LaneD a, LaneD b)     { return a - b; }
+  inline LaneD laneMul(LaneD a, LaneD b)     { return a*b; }
+  inline LaneD laneMulAdd(LaneD a, LaneD b, LaneD c) { return mulAdd(a, b, c); }
+  /// base[index[0]]
+  inline LaneD laneGather(const double* base, const int* index) { return base[index[0]]; }
+#endif
+
+}
+
+#endif // FieldMapLanes_h
@@ -0,0 +1,50 @@
+#ifndef FieldMapRegistry_h
+#define FieldMapRegistry_h 1
+
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace lcgeo {
+
+  /**
+   *  Process-wide registry of the field map grids read from file.
+   *
+   *  Field elements reading the same file with the same tree, variables and units share one
+   *  read-only grid, the field scale factors are applied by every element at lookup time. The
+   *  registry only holds weak references: a grid is freed with the last field element using it
+   *  and read again if it is requested afterwards.
+   */
+  class FieldMapRegistry {
+  public:
+    /// Grid registered under key, or the one made by create if no field element uses it anymore
+    template<typename Grid>
+    static std::shared_ptr<const Grid> get(const std::string& key, const std::function<std::shared_ptr<const Grid>()>& create) {
+      std::lock_guard<std::mutex> lock(mutex());
+      removeExpired();
+      std::weak_ptr<const void>& entry = entries()[key];
+      if(std::shared_ptr<const void> existing = entry.lock()) {
+        std::cout << "FieldMapRegistry: Sharing the field map grid " << key << std::endl;
+        return std::static_pointer_cast<const Grid>(existing);
+      }
+      std::shared_ptr<const Grid> grid = create();
+      entry = grid;
+      return grid;
+    }
+
+    /// Number of grids in use
+    static std::size_t size();
+
+  private:
+    static std::mutex& mutex();
+    static std::map< std::string, std::weak_ptr<const void> >& entries();
+    static void removeExpired();
+  };
+
+}
+
+#endif // FieldMapRegistry_h
@@ -0,0 +1,66 @@
+#ifndef FieldMapSpline_h
+#define FieldMapSpline_h 1
+
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+
+/**
+ *  Helpers for the cubic B-spline interpolation of the field maps.
+ *
+ *  The grid values are converted once into B-spline coefficients with the recursive prefilter
+ *  of M. Unser (IEEE Signal Processing Magazine 16 (1999) 22), using mirror boundary conditions.
+ *  Interpolating the coefficients with the cubic B-spline weights of the four nearest nodes per
+ *  axis then reproduces the grid values exactly at the nodes, with fourth order accuracy in between.
+ */
+namespace lcgeo {
+
+  /// Index of node k on an axis with n nodes, mirrored at the first and last node
+  inline int splineMirrorIndex(int k, int n) {
+    if(n == 1) return 0;
+    const int period = 2*(n-1);
+    k = std::abs(k) % period;
+    return ( k < n ? k : period - k );
+  }
+
+  /// Cubic B-spline weights of the nodes bin-1, bin, bin+1 and bin+2 for a point at fraction f of the cell
+  inline void splineWeights(double f, double* w) {
+    const double f2 = f*f;
+    const double f3 = f2*f;
+    w[0] = (1.0 - 3.0*f + 3.0*f2 - f3)/6.0;
+    w[1] = (4.0 - 6.0*f2 + 3.0*f3)/6.0;
+    w[2] = (1.0 + 3.0*f + 3.0*f2 - 3.0*f3)/6.0;
+    w[3] = f3/6.0;
+  }
+
+  /// Convert n values at data[0], data[stride], ... into cubic B-spline coefficients in place
+  inline void splinePrefilter(double* data, int n, std::ptrdiff_t stride) {
+    if(n < 2) return;
+
+    const double z = std::sqrt(3.0) - 2.0;
+    const double lambda = (1.0 - z)*(1.0 - 1.0/z);
+    for(int k=0;k<n;k++) data[k*stride] *= lambda;
+
+    //Initial causal coefficient for mirror boundary conditions
+    double zn  = z;
+    double z2n = std::pow(z, n-1);
+    double sum = data[0] + z2n*data[(n-1)*stride];
+    z2n *= z2n/z;
+    for(int k=1;k<n-1;k++) {
+      sum += (zn + z2n)*data[k*stride];
+      zn  *= z;
+      z2n /= z;
+    }
+    data[0] = sum/(1.0 - zn*zn);
+
+    //Causal recursion
+    for(int k=1;k<n;k++) data[k*stride] += z*data[(k-1)*stride];
+
+    //Initial anti-causal coefficient and anti-causal recursion
+    data[(n-1)*stride] = (z/(z*z - 1.0))*(z*data[(n-2)*stride] + data[(n-1)*stride]);
+    for(int k=n-2;k>=0;k--) data[k*stride] = z*(data[(k+1)*stride] - data[k*stride]);
+  }
+
+}
+
+#endif // FieldMapSpline_h
@@ -1,8 +1,13 @@
 #ifndef FieldMap_XYZ_h
 #define FieldMap_XYZ_h 1
 
+#include "FieldMapCache.h"
+#include "FieldMapCellCache.h"
+
 #include <DD4hep/FieldTypes.h>
 
+#include <cstddef>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -35,19 +40,87 @@ public:
   int zOrdering;                 // z coordinate ordering, 1(-1) if from low-to-high (high-to-low)
   double zMin,zMax,zStep,zScale; // min, max, step-size and scale factor of z coordinate in fieldmap
   
-  double bScale;                         //Bfield scale factor 
-  std::vector< FieldValues_t > fieldMap; //List with the field map points
+  double bScale;                         //Bfield scale factor, applied at lookup time
+  std::vector< FieldValues_t > fieldMap; //List with the field map points, not scaled by bScale
+
+  int storage;                           // grid storage used for the interpolation, 0(1) for double array-of-structs (packed float32 structure-of-arrays)
+  std::vector< float > fieldMapSoA;      //Packed float32 copy of the field map points, blocks of Bx[N], By[N], Bz[N]
+
+  const FieldValues_t* fieldMapPtr;      //Field map points used in the interpolation, in fieldMap or in the mapped cache file
+  const float* fieldMapSoAPtr;           //Packed field map points used in the interpolation, in fieldMapSoA or in the mapped cache file
+  std::shared_ptr<const lcgeo::FieldMapCache> cache; //Mapped cache file holding the field map points, if any
+  std::string sourceFile;                //ROOT file the field map points were read from, directly or through the cache file, empty otherwise
+  double sourceCoorUnits, sourceBfieldUnits; //Units of the coordinates and the field in sourceFile
+
+  int interpolation;                     // interpolation of the field map, 1(3) for trilinear (tricubic B-spline)
+  std::vector< FieldValues_t > splineCoefficients; //Cubic B-spline coefficients of the field map points, used with interpolation == 3
+  const FieldValues_t* splineCoefficientsPtr; //Cubic B-spline coefficients used in the interpolation, in splineCoefficients or in the shared grid
+
+  std::shared_ptr<const FieldMapXYZ> sharedGrid; //Field map holding the points used by this one, if shared through the FieldMapRegistry
+  std::vector< dd4hep::CartesianField > bakedFields; //Field elements summed into the field map points, if baked from them
+
+  uint64_t id;                           // unique id of this field map, tags its cells in the per-thread last-cell caches
+  std::shared_ptr<lcgeo::FieldMapCellCounters> cellCacheCounters; //Lookup counters of the per-thread last-cell cache, null if the cache is not used
 
 public:
   /// Initializing constructor
   FieldMapXYZ();
+  /// Destructor, printing the hit rate of the last-cell cache
+  virtual ~FieldMapXYZ();
+  /// Add the last-cell cache lookups of the calling thread not yet counted to cellCacheCounters
+  void flushCellCache() const;
   
   /// Call to access the field components at a given location
   virtual void fieldComponents(const double* pos, double* field);
+  /// Call to access the field components at nPoints locations, pos and field hold nPoints consecutive (x,y,z) triplets
+  void fieldComponentsBatch(const double* pos, double* field, std::size_t nPoints);
   /// Field the FieldMap from the the tree specified in the XML
   void fillFieldMapFromTree(const std::string& filename, double coorUnits, double BfieldUnits);
+  /// Fill the FieldMap with the sum of the given fields at the nodes of the grid, which must be set before
+  void fillFieldMapFromFields(const std::vector< dd4hep::CartesianField >& fields);
+  /// Map the FieldMap from the binary cache file, false if it is missing or out of date
+  bool fillFieldMapFromCache(const std::string& cacheFile, const std::string& filename, double coorUnits, double BfieldUnits);
+  /// Map the FieldMap from the binary cache file, false if it is missing or does not agree with the expected header
+  bool fillFieldMapFromCache(const std::string& cacheFile, const lcgeo::FieldMapCacheHeader& expected);
+  /// Write the FieldMap to the binary cache file
+  void writeFieldMapCache(const std::string& cacheFile, const std::string& filename, double coorUnits, double BfieldUnits) const;
+  /// Write the FieldMap to the binary cache file, with the grid of the FieldMap added to the header
+  void writeFieldMapCache(const std::string& cacheFile, lcgeo::FieldMapCacheHeader header) const;
+  /// Cache file header describing the configuration of this FieldMap
+  lcgeo::FieldMapCacheHeader cacheHeader(const std::string& filename, double coorUnits, double BfieldUnits) const;
+  /// Cache file header describing the grid and the baked fields: the field maps read from a file by their file and
+  /// settings, the other fields by a checksum of their sum at probe points
+  lcgeo::FieldMapCacheHeader bakedCacheHeader() const;
+  /// Maximum deviation of the interpolated field from the sum of the baked fields at nPoints random points in the grid.
+  /// If given, worstPos is filled with the position of the maximum deviation
+  double maxDeviationFromFields(int nPoints, double* worstPos = nullptr);
   /// Get global index in the Field map 
   int  getGlobalIndex(const int xBin, const int yBin, const int zBin);
+  /// Fill the packed float32 structure-of-arrays copy of the field map used with storage == 1
+  void fillFieldMapSoA();
+  /// Fill the cubic B-spline coefficients of the field map used with interpolation == 3
+  void fillSplineCoefficients();
+  /// Use the field map points, grid and interpolation settings of another field map, which is kept alive by this one
+  void useSharedGrid(const std::shared_ptr<const FieldMapXYZ>& grid);
+  /// Get the lower and upper corner bins and the normalized coordinates of the cell containing pos, false if outside of the map.
+  /// If given, lower is filled with the coordinates of the lower corner of the cell
+  bool getCell(const double* pos, int* bin0, int* bin1, double* frac, double* lower = nullptr) const;
+
+  /// Add the field interpolated in the cell given by getCell to field
+  void interpolate(const int* bin0, const int* bin1, const double* frac, double* field) const;
+
+private:
+  /// Trilinear interpolation of the three field components in one pass on the packed float32 field map
+  void interpolateSoA(const int* bin0, const int* bin1, const double* frac, double* field) const;
+  /// Add the field interpolated in the cells of a block of lcgeo::laneBlockSize points, one lane per point
+  void interpolateBlock(const int (*bin0)[3], const int (*bin1)[3], const double (*frac)[3], double (*field)[3]) const;
+  /// Trilinear interpolation of a block of points on the packed float32 field map, index and frac arranged by lane
+  void interpolateSoABlock(const int* index, const double* frac, double (*field)[3]) const;
+  /// Tricubic B-spline interpolation using the 4x4x4 nodes around the cell
+  void interpolateCubic(const int* bin0, const double* frac, double* field) const;
+  /// Trilinear interpolation from the last cell of the calling thread, refilled if pos is outside of it.
+  /// False if pos is outside of the map
+  bool interpolateCached(const double* pos, double* field) const;
   
 };
 
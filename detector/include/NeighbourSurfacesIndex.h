@@ -0,0 +1,98 @@
+#ifndef NeighbourSurfacesIndex_h
+#define NeighbourSurfacesIndex_h 1
+
+#include "DD4hep/DetElement.h"
+#include "DDRec/DetectorData.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+/**
+ *  Flat index of the neighbouring surfaces in the same layer, with the same content as
+ *  NeighbourSurfacesData::sameLayer. The cellIDs of the surfaces are kept sorted in one vector,
+ *  the neighbours of all surfaces are stored one after the other in a second vector and the
+ *  neighbours of the i-th surface are the entries offsets[i] to offsets[i+1]. A query is a
+ *  binary search over the cellIDs, and the whole index takes three allocations instead of two
+ *  per surface for the map of vectors.
+ *
+ *  The tracker drivers add it to the DetElement next to the NeighbourSurfacesData with
+ *  addNeighbourSurfacesIndex, and it is used e.g. as
+ *
+ *    const lcgeo::NeighbourSurfacesIndexData* index = det.extension<lcgeo::NeighbourSurfacesIndexData>( false ) ;
+ *    for( dd4hep::CellID neighbour : index->neighbours( cellID ) ) ...
+ */
+namespace lcgeo {
+
+  struct NeighbourSurfacesIndexStruct {
+
+    typedef dd4hep::CellID CellID;
+
+    /// The neighbours of one surface, a view into the flat neighbour vector
+    struct Range {
+      const CellID* first = nullptr;
+      const CellID* last = nullptr;
+      const CellID* begin() const { return first; }
+      const CellID* end() const { return last; }
+      std::size_t size() const { return last - first; }
+      bool empty() const { return first == last; }
+    };
+
+    std::vector<CellID> cellIDs{};          // sorted cellIDs of the surfaces with neighbours
+    std::vector<unsigned> offsets{};        // start of the neighbours of each surface, one more entry than cellIDs
+    std::vector<CellID> neighbourIDs{};     // neighbours of all surfaces
+
+    /// Fill from the map of NeighbourSurfacesData::sameLayer, keeping the order of the neighbours
+    template<typename MAP> void fill( const MAP& sameLayer ) {
+      clear();
+      cellIDs.reserve( sameLayer.size() );
+      offsets.reserve( sameLayer.size() + 1 );
+      std::size_t nNeighbours = 0;
+      for( const auto& entry : sameLayer ) nNeighbours += entry.second.size();
+      neighbourIDs.reserve( nNeighbours );
+      for( const auto& entry : sameLayer ) {
+        cellIDs.push_back( entry.first );
+        offsets.push_back( neighbourIDs.size() );
+        neighbourIDs.insert( neighbourIDs.end(), entry.second.begin(), entry.second.end() );
+      }
+      offsets.push_back( neighbourIDs.size() );
+    }
+
+    /// Neighbours of the surface with the given cellID, empty if it has none
+    Range neighbours( CellID cellID ) const {
+      Range range;
+      const auto it = std::lower_bound( cellIDs.begin(), cellIDs.end(), cellID );
+      if( it == cellIDs.end() || *it != cellID ) return range;
+      const std::size_t i = it - cellIDs.begin();
+      range.first = neighbourIDs.data() + offsets[i];
+      range.last = neighbourIDs.data() + offsets[i+1];
+      return range;
+    }
+
+    /// Number of surfaces with neighbours
+    std::size_t size() const { return cellIDs.size(); }
+
+    /// Bytes allocated for the index
+    std::size_t memoryUsage() const {
+      return cellIDs.capacity()*sizeof(CellID) + offsets.capacity()*sizeof(unsigned) + neighbourIDs.capacity()*sizeof(CellID);
+    }
+
+    void clear() {
+      cellIDs.clear();
+      offsets.clear();
+      neighbourIDs.clear();
+    }
+  };
+
+  typedef dd4hep::rec::StructExtension<NeighbourSurfacesIndexStruct> NeighbourSurfacesIndexData;
+
+  /// Add the flat index of the neighbours in the same layer of neighbourSurfacesData to det
+  inline void addNeighbourSurfacesIndex( dd4hep::DetElement& det, const dd4hep::rec::NeighbourSurfacesData& neighbourSurfacesData ) {
+    NeighbourSurfacesIndexData* index = new NeighbourSurfacesIndexData() ;
+    index->fill( neighbourSurfacesData.sameLayer ) ;
+    det.addExtension< NeighbourSurfacesIndexData >( index ) ;
+  }
+
+}
+
+#endif // NeighbourSurfacesIndex_h
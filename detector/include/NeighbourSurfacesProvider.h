@@ -0,0 +1,136 @@
+#ifndef NeighbourSurfacesProvider_h
+#define NeighbourSurfacesProvider_h 1
+
+#include "DDRec/DetectorData.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/**
+ *  Neighbouring surfaces in the same layer computed on query from the topology of the layers,
+ *  instead of the lists stored for every sensor in NeighbourSurfacesData.
+ *
+ *  A layer is a grid of nModules x nSensors surfaces, e.g. the staves in phi and the sensors
+ *  along z of a barrel layer, or a single module with the sensors around the ring of an endcap
+ *  layer. Indices which wrap around in phi are flagged per axis. The neighbours of a surface are
+ *  the surfaces with module and sensor index within the given radius, on the same side: the
+ *  reflected (side -1) half of an endcap layer has the same topology as the side +1 half.
+ *
+ *  Only the layout of the module, sensor, layer and side fields of the cellID is stored, the other
+ *  fields are taken from the queried cellID. For radius 1 the neighbours are the ones stored in
+ *  NeighbourSurfacesData::sameLayer, in the same order, except that around a wrapped axis of
+ *  fewer than three surfaces no neighbour is repeated.
+ */
+namespace lcgeo {
+
+  struct NeighbourSurfacesProviderStruct {
+
+    typedef dd4hep::CellID CellID;
+
+    /// Position of a field in the cellID
+    struct Field {
+      unsigned offset = 0;
+      unsigned width = 0;
+      bool isSigned = false;
+
+      long long value( CellID cellID ) const {
+        const CellID mask = ( width < 64 ? ( CellID(1) << width ) - 1 : ~CellID(0) );
+        long long v = ( cellID >> offset ) & mask;
+        if( isSigned && width < 64 && ( v >> ( width - 1 ) ) ) v -= ( 1LL << width );
+        return v;
+      }
+      CellID set( CellID cellID, long long v ) const {
+        const CellID mask = ( width < 64 ? ( CellID(1) << width ) - 1 : ~CellID(0) );
+        return ( cellID & ~( mask << offset ) ) | ( ( CellID(v) & mask ) << offset );
+      }
+      /// Layout of a field of an encoder, e.g. the BitFieldValue of a UTIL::BitField64
+      template<typename VALUE> static Field of( const VALUE& value ) {
+        Field field;
+        field.offset = value.offset();
+        field.width = value.width();
+        field.isSigned = value.isSigned();
+        return field;
+      }
+    };
+
+    /// Topology of the surfaces of one layer
+    struct Layer {
+      int nModules = 0;             // number of module indices, 0 if the layer has no surfaces
+      int nSensors = 0;             // number of sensor indices
+      bool wrapModules = false;     // module nModules-1 is next to module 0
+      bool wrapSensors = false;     // sensor nSensors-1 is next to sensor 0
+      bool reflected = false;       // the layer exists on side -1 as well as on its own side
+      int side = 0;                 // side of the layer
+    };
+
+    Field sideField{};
+    Field layerField{};
+    Field moduleField{};
+    Field sensorField{};
+    std::vector<Layer> layers{};    // indexed by the layer field
+
+    /// Take the layout of the fields from the encoder of the readout, e.g. a UTIL::BitField64
+    template<typename ENCODER> void setFields( ENCODER& encoder, const std::string& side, const std::string& layer,
+                                               const std::string& module, const std::string& sensor ) {
+      sideField = Field::of( encoder[side] );
+      layerField = Field::of( encoder[layer] );
+      moduleField = Field::of( encoder[module] );
+      sensorField = Field::of( encoder[sensor] );
+    }
+
+    /// Set the topology of a layer
+    void setLayer( int layer, const Layer& topology ) {
+      if( layer < 0 ) return;
+      if( layer >= int( layers.size() ) ) layers.resize( layer + 1 );
+      layers[layer] = topology;
+    }
+
+    /// Append the neighbours of the surface within moduleRadius modules and sensorRadius sensors
+    void neighbours( CellID cellID, int moduleRadius, int sensorRadius, std::vector<CellID>& result ) const {
+      const long long layer = layerField.value( cellID );
+      if( layer < 0 || layer >= (long long) layers.size() ) return;
+      const Layer& topology = layers[layer];
+      const long long side = sideField.value( cellID );
+      if( topology.nModules == 0 || ( side != topology.side && !( topology.reflected && side == -topology.side ) ) ) return;
+
+      const int module = moduleField.value( cellID );
+      const int sensor = sensorField.value( cellID );
+      int moduleLow, moduleHigh, sensorLow, sensorHigh;
+      range( topology.nModules, topology.wrapModules, moduleRadius, moduleLow, moduleHigh );
+      range( topology.nSensors, topology.wrapSensors, sensorRadius, sensorLow, sensorHigh );
+      for( int imodule=-moduleLow; imodule<=moduleHigh; imodule++ ) {
+        int newmodule = module + imodule;
+        if( topology.wrapModules ) newmodule = ( ( newmodule % topology.nModules ) + topology.nModules ) % topology.nModules;
+        else if( newmodule < 0 || newmodule >= topology.nModules ) continue;
+        for( int isensor=-sensorLow; isensor<=sensorHigh; isensor++ ) {
+          if( imodule == 0 && isensor == 0 ) continue;
+          int newsensor = sensor + isensor;
+          if( topology.wrapSensors ) newsensor = ( ( newsensor % topology.nSensors ) + topology.nSensors ) % topology.nSensors;
+          else if( newsensor < 0 || newsensor >= topology.nSensors ) continue;
+          result.push_back( sensorField.set( moduleField.set( cellID, newmodule ), newsensor ) );
+        }
+      }
+    }
+
+    /// Append the neighbours of the surface within the same radius in modules and sensors
+    void neighbours( CellID cellID, int radius, std::vector<CellID>& result ) const {
+      neighbours( cellID, radius, radius, result );
+    }
+
+  private:
+    /// Offsets to look at below and above an index; around a wrapped axis every index is taken once
+    static void range( int n, bool wrap, int radius, int& low, int& high ) {
+      low = high = std::max( 0, radius );
+      if( wrap ) {
+        low = std::min( low, ( n - 1 ) / 2 );
+        high = std::min( high, n / 2 );
+      }
+    }
+  };
+
+  typedef dd4hep::rec::StructExtension<NeighbourSurfacesProviderStruct> NeighbourSurfacesProviderData;
+
+}
+
+#endif // NeighbourSurfacesProvider_h
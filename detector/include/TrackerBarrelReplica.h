@@ -0,0 +1,101 @@
+#ifndef TrackerBarrelReplica_h
+#define TrackerBarrelReplica_h 1
+
+#include "NeighbourSurfacesProvider.h"
+
+#include "DD4hep/DetElement.h"
+#include "DD4hep/Volumes.h"
+#include "DDRec/DetectorData.h"
+
+#include <TGeoMatrix.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ *  Placement of the sensors of a TrackerBarrel_o1_v05 from their cellID, without a DetElement for
+ *  every sensor.
+ *
+ *  The driver places the modules into the layer volume in the order of their module and sensor
+ *  index, so the placement of a sensor is the daughter module*nSensors+sensor of the volume of
+ *  the layer DetElement, and its sensitive components are the same placements in every module
+ *  volume. Only the layer DetElements and the layout of the fields of the cellID are stored.
+ *
+ *  With replicaSensors="true" (or the constant TrackerBarrel_replicaSensors set to 1 for all
+ *  barrels of a model) the driver creates no DetElements for the sensors and their components,
+ *  and the cellIDs are resolved here or by the VolumeManager, which finds the sensitive placements
+ *  below the layer DetElement. No surfaces are installed for the sensors in that mode.
+ */
+namespace lcgeo {
+
+  struct TrackerBarrelReplicaStruct {
+
+    typedef dd4hep::CellID CellID;
+    typedef NeighbourSurfacesProviderStruct::Field Field;
+
+    /// Sensors of one layer
+    struct Layer {
+      dd4hep::DetElement element{};                    // DetElement of the layer
+      int nModules = 0;                                // number of modules in phi, 0 if the layer does not exist
+      int nSensors = 0;                                // number of sensors along z in a module
+      std::vector<dd4hep::PlacedVolume> sensitive{};   // sensitive components in the module volume
+    };
+
+    CellID base = 0;                // cellID with the fields fixed for the detector, e.g. system and side
+    Field layerField{};
+    Field moduleField{};
+    Field sensorField{};
+    std::vector<Layer> layers{};    // indexed by the layer field
+
+    /// Take the fixed fields and the layout of the fields from the encoder of the readout, e.g. a UTIL::BitField64
+    template<typename ENCODER> void setFields( ENCODER& encoder, const std::string& layer, const std::string& module,
+                                               const std::string& sensor ) {
+      base = encoder.getValue();
+      layerField = Field::of( encoder[layer] );
+      moduleField = Field::of( encoder[module] );
+      sensorField = Field::of( encoder[sensor] );
+      base = sensorField.set( moduleField.set( layerField.set( base, 0 ), 0 ), 0 );
+    }
+
+    /// Set the sensors of a layer
+    void setLayer( int layer, const Layer& sensors ) {
+      if( layer < 0 ) return;
+      if( layer >= int( layers.size() ) ) layers.resize( layer + 1 );
+      layers[layer] = sensors;
+    }
+
+    /// CellID of a sensor
+    CellID cellID( int layer, int module, int sensor ) const {
+      return sensorField.set( moduleField.set( layerField.set( base, layer ), module ), sensor );
+    }
+
+    /// Placement of the module volume of the sensor in the layer volume, invalid if there is no such sensor
+    dd4hep::PlacedVolume modulePlacement( CellID cellID ) const {
+      const long long layer = layerField.value( cellID );
+      if( layer < 0 || layer >= (long long) layers.size() ) return dd4hep::PlacedVolume();
+      const Layer& sensors = layers[layer];
+      const long long module = moduleField.value( cellID );
+      const long long sensor = sensorField.value( cellID );
+      if( module < 0 || module >= sensors.nModules || sensor < 0 || sensor >= sensors.nSensors ) return dd4hep::PlacedVolume();
+      return dd4hep::PlacedVolume( sensors.element.volume()->GetNode( module * sensors.nSensors + sensor ) );
+    }
+
+    /// Transformation from the sensitive component of the sensor to the world, false if there is no such sensor
+    bool worldTransformation( CellID cellID, TGeoHMatrix& matrix, std::size_t component = 0 ) const {
+      const dd4hep::PlacedVolume module = modulePlacement( cellID );
+      if( not module.isValid() ) return false;
+      const Layer& sensors = layers[layerField.value( cellID )];
+      if( component >= sensors.sensitive.size() ) return false;
+      matrix = sensors.element.nominal().worldTransformation();
+      matrix.Multiply( module->GetMatrix() );
+      matrix.Multiply( sensors.sensitive[component]->GetMatrix() );
+      return true;
+    }
+  };
+
+  typedef dd4hep::rec::StructExtension<TrackerBarrelReplicaStruct> TrackerBarrelReplicaData;
+
+}
+
+#endif // TrackerBarrelReplica_h
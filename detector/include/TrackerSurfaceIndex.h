@@ -0,0 +1,95 @@
+#ifndef TrackerSurfaceIndex_h
+#define TrackerSurfaceIndex_h 1
+
+#include <DDRec/ISurface.h>
+#include <DDRec/Vector3D.h>
+
+#include <cstddef>
+#include <list>
+#include <utility>
+#include <vector>
+
+/**
+ *  Bounding volume hierarchy over the surfaces of the tracking detectors (VolPlane, VolCylinder,
+ *  VolCone, ...), e.g. from dd4hep::rec::SurfaceHelper( det ).surfaceList() of the trackers.
+ *
+ *  Every surface is enclosed in an axis aligned box computed from its outline (ISurface::getLines),
+ *  and the boxes are split recursively at the median of their centres along the longest axis, so
+ *  that queries visit O(log n) nodes instead of all surfaces:
+ *
+ *   - crossed( start, end ) gives the surfaces crossed by a straight segment, a cylinder or cone
+ *     entered and left by the segment twice; a helix is passed as the polyline of its chords
+ *   - nearest( point ) gives the surface closest to a point, where the distance to a surface is the
+ *     larger of the distance to its (unbounded) surface and the distance to its box
+ *
+ *  The linear scans giving the same results are kept as crossedLinear and nearestLinear for testing
+ *  and benchmarking. The surfaces are not owned and have to outlive the index.
+ */
+namespace lcgeo {
+
+  class TrackerSurfaceIndex {
+  public:
+    typedef dd4hep::rec::ISurface Surface;
+    typedef dd4hep::rec::Vector3D Vector3D;
+
+    /// Index of the surfaces; tolerance is the margin of the bounds of the surfaces and of their boxes
+    explicit TrackerSurfaceIndex( const std::list<Surface*>& surfaces, double tolerance = 1e-4 );
+
+    /// Append the surfaces crossed by the segment from start to end, ordered along the segment
+    void crossed( const Vector3D& start, const Vector3D& end, std::vector<const Surface*>& result ) const;
+    /// Append the surfaces crossed by a polyline, e.g. the chords of a helix, ordered along the polyline
+    void crossed( const std::vector<Vector3D>& points, std::vector<const Surface*>& result ) const;
+    /// Surface nearest to the point, nullptr if the index is empty
+    const Surface* nearest( const Vector3D& point, double* distance = nullptr ) const;
+
+    /// Same as crossed, scanning all surfaces
+    void crossedLinear( const Vector3D& start, const Vector3D& end, std::vector<const Surface*>& result ) const;
+    /// Same as nearest, scanning all surfaces
+    const Surface* nearestLinear( const Vector3D& point, double* distance = nullptr ) const;
+
+    /// Number of surfaces in the index
+    std::size_t size() const { return m_entries.size(); }
+    /// Number of nodes of the hierarchy
+    std::size_t nNodes() const { return m_nodes.size(); }
+
+  private:
+    struct Box {
+      double min[3];
+      double max[3];
+    };
+    struct Entry {
+      const Surface* surface;
+      Box box;
+    };
+    struct Node {
+      Box box;
+      int left;       // first child, the second child is left+1; -1 for a leaf
+      int first;      // first entry of a leaf
+      int count;      // number of entries of a leaf
+    };
+
+    /// Fill the node with the entries first to last, splitting them into child nodes if there are many
+    void build( int node, int first, int last );
+    typedef std::pair<double, const Surface*> Crossing;   // parameter along the segment and crossed surface
+
+    /// Append the crossings of the segment with the surface within its bounds: at most one for planes,
+    /// up to two for cylinders and cones, which a straight segment can enter and leave
+    void crossing( const Entry& entry, const Vector3D& start, const Vector3D& end, std::vector<Crossing>& crossings ) const;
+    /// Parameter between tLow and tHigh where the distance changes its sign, negative if outside of the bounds
+    double refine( const Surface* surface, const Vector3D& start, const Vector3D& end,
+                   double tLow, double dLow, double tHigh, double dHigh ) const;
+    /// Distance of the point to the surface of the entry as defined for nearest
+    double distance( const Entry& entry, const Vector3D& point ) const;
+
+    static bool overlaps( const Box& box, const Vector3D& start, const Vector3D& end );
+    static double boxDistance( const Box& box, const Vector3D& point );
+
+    std::vector<Entry> m_entries{};
+    std::vector<Node> m_nodes{};
+    std::vector<Entry> m_unbounded{};   // surfaces without outline, checked for every query
+    double m_tolerance;
+  };
+
+}
+
+#endif // TrackerSurfaceIndex_h
@@ -0,0 +1,474 @@
+#include "FieldMapAdaptive.h"
+
+#include <DD4hep/Version.h>
+#if DD4HEP_VERSION_GE(0,24)
+#include <DD4hep/detail/Handle.inl>
+#else
+#include <DD4hep/Handle.inl>
+#endif
+
+#include <DD4hep/FieldTypes.h>
+
+
+#include <DD4hep/DetFactoryHelper.h>
+#include <XML/Utilities.h>
+
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip>
+#include <limits>
+
+using dd4hep::CartesianField;
+using dd4hep::Detector;
+using dd4hep::Ref_t;
+
+DD4HEP_INSTANTIATE_HANDLE(FieldMapAdaptive);
+
+namespace {
+  /// Add the field interpolated trilinearly between the values at the eight corners of a cell,
+  /// corner index bit 0 (1, 2) set for the upper x (y, z) corner
+  inline void trilinear(const double (*corners)[3], const double* frac, double* globalField) {
+
+    const double xd = frac[0];
+    const double yd = frac[1];
+    const double zd = frac[2];
+
+    double B_00,B_01,B_10,B_11,B_0,B_1,B;
+    for(int j=0;j<3;j++) {
+      B_00 = (1.0 - xd)*corners[0][j] + xd*corners[1][j];
+      B_01 = (1.0 - xd)*corners[4][j] + xd*corners[5][j];
+      B_10 = (1.0 - xd)*corners[2][j] + xd*corners[3][j];
+      B_11 = (1.0 - xd)*corners[6][j] + xd*corners[7][j];
+      B_0  = (1.0 - yd)*B_00          + yd*B_10;
+      B_1  = (1.0 - yd)*B_01          + yd*B_11;
+      B    = (1.0 - zd)*B_0           + zd*B_1;
+      globalField[j] += B;
+    }
+
+  }
+
+  /// Add the field of a block grid with nCells cells per axis at frac, the position in the block in units of the block size
+  inline void gridField(const FieldMapAdaptive::FieldValues_t* grid, int nCells, const double* frac, double* globalField) {
+
+    int    bin[3];
+    double cellFrac[3];
+    for(int d=0;d<3;d++) {
+      const double t = frac[d]*nCells;
+      bin[d]      = std::min(int(t), nCells - 1);
+      cellFrac[d] = t - bin[d];
+    }
+
+    const int nNodes = nCells + 1;
+    const FieldMapAdaptive::FieldValues_t* node = &grid[bin[0] + nNodes*(bin[1] + nNodes*bin[2])];
+    double corners[8][3];
+    for(int c=0;c<8;c++) {
+      const FieldMapAdaptive::FieldValues_t& value = node[(c & 1) + nNodes*(((c >> 1) & 1) + nNodes*((c >> 2) & 1))];
+      corners[c][0] = value.Bx;
+      corners[c][1] = value.By;
+      corners[c][2] = value.Bz;
+    }
+    trilinear(corners, cellFrac, globalField);
+
+  }
+
+  /// Maximum deviation of a block grid with nCells cells per axis from the check points of the block, the
+  /// nodes and cell centres of the finest grid with finestCells cells per axis. Stops once limit is exceeded
+  double gridDeviation(const FieldMapAdaptive::FieldValues_t* grid, int nCells, int finestCells,
+                       const std::vector<double>& nodes, const std::vector<double>& centres, double limit) {
+
+    const int finestNodes = finestCells + 1;
+    double maxDeviation = 0.0;
+    auto check = [&](const double* u, const double* B) {
+      const double frac[3] = { u[0]/finestCells, u[1]/finestCells, u[2]/finestCells };
+      double field[3] = { -B[0], -B[1], -B[2] };
+      gridField(grid, nCells, frac, field);
+      maxDeviation = std::max(maxDeviation, std::sqrt(field[0]*field[0] + field[1]*field[1] + field[2]*field[2]));
+      return maxDeviation <= limit;
+    };
+
+    for(int k=0;k<finestNodes;k++) {
+      for(int j=0;j<finestNodes;j++) {
+        for(int i=0;i<finestNodes;i++) {
+          const double u[3] = { double(i), double(j), double(k) };
+          if(not check(u, &nodes[3*(i + finestNodes*(j + finestNodes*k))])) return maxDeviation;
+        }
+      }
+    }
+    for(int k=0;k<finestCells;k++) {
+      for(int j=0;j<finestCells;j++) {
+        for(int i=0;i<finestCells;i++) {
+          const double u[3] = { i + 0.5, j + 0.5, k + 0.5 };
+          if(not check(u, &centres[3*(i + finestCells*(j + finestCells*k))])) return maxDeviation;
+        }
+      }
+    }
+    return maxDeviation;
+
+  }
+
+  /// Sum of the fields at the given position
+  inline void sumFields(const std::vector< CartesianField >& fields, const double* pos, double* sum) {
+    sum[0] = sum[1] = sum[2] = 0.0;
+    for(const auto& field : fields) {
+      double B[3] = {0.0, 0.0, 0.0};
+      field.magneticField(pos, B);
+      for(int j=0;j<3;j++) sum[j] += B[j];
+    }
+  }
+}
+
+FieldMapAdaptive::FieldMapAdaptive():
+  nLevels(1), tolerance(0.0), bScale(1.0) {
+  type = dd4hep::CartesianField::MAGNETIC;
+  for(int d=0;d<3;d++) {
+    min[d] = max[d] = 0.0;
+    step[d] = blockSize[d] = 0.0;
+    nBlocks[d] = 0;
+  }
+}
+
+void FieldMapAdaptive::fieldComponents(const double* pos, double* globalField) {
+
+  int    block[3];
+  double frac[3];
+  for(int d=0;d<3;d++) {
+    if(not (pos[d] >= min[d] && pos[d] <= max[d])) return;
+    const double u = (pos[d] - min[d])/blockSize[d];
+    block[d] = std::min(int(u), nBlocks[d] - 1);
+    frac[d]  = u - block[d];
+  }
+
+  double field[3] = {0.0, 0.0, 0.0};
+  blockField(block[0] + nBlocks[0]*(block[1] + nBlocks[1]*block[2]), frac, field);
+  for(int j=0;j<3;j++) globalField[j] += bScale*field[j];
+
+}
+
+void FieldMapAdaptive::blockField(std::size_t blockIndex, const double* frac, double* field) const {
+
+  const Block_t& blk = blocks[blockIndex];
+  gridField(&values[blk.offset], blk.nCells, frac, field);
+
+}
+
+void FieldMapAdaptive::setGrid(const double* gridMin, const double* gridMax, const double* finestStep, int levels) {
+
+  nLevels = levels;
+  const int finestCells = 1 << (nLevels - 1);
+  for(int d=0;d<3;d++) {
+    min[d]       = gridMin[d];
+    step[d]      = finestStep[d];
+    blockSize[d] = finestCells*step[d];
+    nBlocks[d]   = std::max(1, int(std::ceil((gridMax[d] - gridMin[d])/blockSize[d] - 1e-9)));
+    max[d]       = min[d] + nBlocks[d]*blockSize[d];
+  }
+  blocks.clear();
+  values.clear();
+
+}
+
+void FieldMapAdaptive::fillFromFields(const std::vector< CartesianField >& fields) {
+
+  const int finestCells = 1 << (nLevels - 1);
+  const int finestNodes = finestCells + 1;
+  const std::size_t nTotal = std::size_t(nBlocks[0])*nBlocks[1]*nBlocks[2];
+  blocks.assign(nTotal, Block_t{0, 0});
+  values.clear();
+
+  //Field at the nodes and at the cell centres of the finest grid of a block, the check points of the
+  //tolerance. The nodes of the coarser grids are a subset of the finest nodes. The positions are
+  //computed from the global node index, so that neighbouring blocks sample their faces identically
+  std::vector<double> nodes(3*std::size_t(finestNodes)*finestNodes*finestNodes);
+  std::vector<double> centres(3*std::size_t(finestCells)*finestCells*finestCells);
+  auto sample = [&](std::size_t b) {
+    const int bx = b % nBlocks[0], by = (b/nBlocks[0]) % nBlocks[1], bz = b/(std::size_t(nBlocks[0])*nBlocks[1]);
+    for(int k=0;k<finestNodes;k++) {
+      for(int j=0;j<finestNodes;j++) {
+        for(int i=0;i<finestNodes;i++) {
+          const double pos[3] = { min[0] + (bx*finestCells + i)*step[0],
+                                  min[1] + (by*finestCells + j)*step[1],
+                                  min[2] + (bz*finestCells + k)*step[2] };
+          sumFields(fields, pos, &nodes[3*(i + finestNodes*(j + finestNodes*k))]);
+        }
+      }
+    }
+    for(int k=0;k<finestCells;k++) {
+      for(int j=0;j<finestCells;j++) {
+        for(int i=0;i<finestCells;i++) {
+          const double pos[3] = { min[0] + (bx*finestCells + i + 0.5)*step[0],
+                                  min[1] + (by*finestCells + j + 0.5)*step[1],
+                                  min[2] + (bz*finestCells + k + 0.5)*step[2] };
+          sumFields(fields, pos, &centres[3*(i + finestCells*(j + finestCells*k))]);
+        }
+      }
+    }
+  };
+
+  //Grid of a block at a level from the source fields, and its deviation at the check points
+  std::vector< int > level(nTotal, 0);
+  std::vector< double > sourceDeviation(nTotal, 0.0);
+  std::vector< std::vector< FieldValues_t > > source(nTotal);
+  auto chooseLevel = [&](std::size_t b, int minLevel) {
+    sample(b);
+    for(int l=minLevel;l<nLevels;l++) {
+      const int nCells = 1 << l;
+      const int stride = finestCells/nCells;
+      std::vector< FieldValues_t > grid;
+      grid.reserve(std::size_t(nCells + 1)*(nCells + 1)*(nCells + 1));
+      for(int k=0;k<=nCells;k++) {
+        for(int j=0;j<=nCells;j++) {
+          for(int i=0;i<=nCells;i++) {
+            const double* B = &nodes[3*(i*stride + finestNodes*(j*stride + finestNodes*k*stride))];
+            grid.emplace_back(B[0], B[1], B[2]);
+          }
+        }
+      }
+      //The finest grid is taken in any case
+      const bool finest = (l == nLevels - 1);
+      const double deviation = gridDeviation(grid.data(), nCells, finestCells, nodes, centres,
+                                             finest ? std::numeric_limits<double>::max() : tolerance);
+      if(deviation <= tolerance || finest) {
+        level[b] = l;
+        sourceDeviation[b] = deviation;
+        source[b].swap(grid);
+        return;
+      }
+    }
+  };
+
+  //Coarsest grid reproducing the check points within the tolerance per block
+  for(std::size_t b=0;b<nTotal;b++) chooseLevel(b, 0);
+
+  //The faces, edges and corners shared by blocks of different levels are made conforming: the nodes
+  //of the finer block on them take the field of the coarsest block touching them, whose grid is a
+  //subset of the finer one, so both sides interpolate to the same field. The blocks are treated
+  //from the coarsest to the finest, so that the coarser grids are final when they are used. If a
+  //constrained block no longer satisfies its tolerance, its coarser neighbours are refined by one
+  //level and the constraints are redone
+  std::vector< std::vector< FieldValues_t > > grids;
+  std::vector< std::size_t > order(nTotal);
+  std::vector< char > constrained(nTotal), refine(nTotal);
+  for(;;) {
+    grids = source;
+    for(std::size_t b=0;b<nTotal;b++) order[b] = b;
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return level[a] < level[b]; });
+    std::fill(constrained.begin(), constrained.end(), 0);
+
+    for(std::size_t b : order) {
+      const int blk[3] = { int(b % nBlocks[0]), int((b/nBlocks[0]) % nBlocks[1]), int(b/(std::size_t(nBlocks[0])*nBlocks[1])) };
+      const int nCells = 1 << level[b];
+      const int nNodes = nCells + 1;
+      for(int k=0;k<nNodes;k++) {
+        for(int j=0;j<nNodes;j++) {
+          for(int i=0;i<nNodes;i++) {
+            const int node[3] = { i, j, k };
+            bool boundary = false;
+            for(int d=0;d<3;d++) boundary = boundary || node[d] == 0 || node[d] == nCells;
+            if(not boundary) continue;
+
+            //Blocks touching the node: one or two per axis, with the position of the node in them
+            int first[3], last[3];
+            for(int d=0;d<3;d++) {
+              first[d] = ( node[d] == 0      && blk[d] > 0              ? blk[d] - 1 : blk[d] );
+              last[d]  = ( node[d] == nCells && blk[d] < nBlocks[d] - 1 ? blk[d] + 1 : blk[d] );
+            }
+            std::size_t coarsest = b;
+            int coarsestIndex[3] = { blk[0], blk[1], blk[2] };
+            for(int nz=first[2];nz<=last[2];nz++) {
+              for(int ny=first[1];ny<=last[1];ny++) {
+                for(int nx=first[0];nx<=last[0];nx++) {
+                  const std::size_t n = nx + nBlocks[0]*(ny + std::size_t(nBlocks[1])*nz);
+                  if(level[n] < level[coarsest] || (level[n] == level[coarsest] && level[n] < level[b] && n < coarsest)) {
+                    coarsest = n;
+                    coarsestIndex[0] = nx;
+                    coarsestIndex[1] = ny;
+                    coarsestIndex[2] = nz;
+                  }
+                }
+              }
+            }
+            if(coarsest == b) continue;
+
+            double frac[3];
+            for(int d=0;d<3;d++) {
+              frac[d] = ( coarsestIndex[d] < blk[d] ? 1.0 : coarsestIndex[d] > blk[d] ? 0.0 : double(node[d])/nCells );
+            }
+            double field[3] = {0.0, 0.0, 0.0};
+            gridField(grids[coarsest].data(), 1 << level[coarsest], frac, field);
+            grids[b][i + nNodes*(j + nNodes*k)] = FieldValues_t(field[0], field[1], field[2]);
+            constrained[b] = 1;
+          }
+        }
+      }
+    }
+
+    //Tolerance of the constrained blocks, or their deviation at the finest level if that is larger
+    std::fill(refine.begin(), refine.end(), 0);
+    bool refined = false;
+    for(std::size_t b=0;b<nTotal;b++) {
+      if(not constrained[b]) continue;
+      sample(b);
+      const double limit = std::max(tolerance, sourceDeviation[b]);
+      if(gridDeviation(grids[b].data(), 1 << level[b], finestCells, nodes, centres, limit) <= limit) continue;
+      const int blk[3] = { int(b % nBlocks[0]), int((b/nBlocks[0]) % nBlocks[1]), int(b/(std::size_t(nBlocks[0])*nBlocks[1])) };
+      for(int nz=std::max(blk[2] - 1, 0);nz<=std::min(blk[2] + 1, nBlocks[2] - 1);nz++) {
+        for(int ny=std::max(blk[1] - 1, 0);ny<=std::min(blk[1] + 1, nBlocks[1] - 1);ny++) {
+          for(int nx=std::max(blk[0] - 1, 0);nx<=std::min(blk[0] + 1, nBlocks[0] - 1);nx++) {
+            const std::size_t n = nx + nBlocks[0]*(ny + std::size_t(nBlocks[1])*nz);
+            if(level[n] < level[b]) refine[n] = 1;
+          }
+        }
+      }
+    }
+    for(std::size_t b=0;b<nTotal;b++) {
+      if(not refine[b]) continue;
+      chooseLevel(b, level[b] + 1);
+      refined = true;
+    }
+    if(not refined) break;
+  }
+
+  for(std::size_t b=0;b<nTotal;b++) {
+    blocks[b].offset = values.size();
+    blocks[b].nCells = 1 << level[b];
+    values.insert(values.end(), grids[b].begin(), grids[b].end());
+  }
+
+  values.shrink_to_fit();
+
+}
+
+std::size_t FieldMapAdaptive::uniformSize() const {
+
+  const int finestCells = 1 << (nLevels - 1);
+  return ( std::size_t(nBlocks[0]*finestCells + 1)*
+           std::size_t(nBlocks[1]*finestCells + 1)*
+           std::size_t(nBlocks[2]*finestCells + 1) );
+
+}
+
+double FieldMapAdaptive::maxDeviationFromFields(int nPoints, double* worstPos) {
+
+  std::mt19937 generator(4242);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  double maxDeviation = 0.0;
+  for(int i=0;i<nPoints;i++) {
+    const double pos[3] = { min[0] + unit(generator)*(max[0] - min[0]),
+                            min[1] + unit(generator)*(max[1] - min[1]),
+                            min[2] + unit(generator)*(max[2] - min[2]) };
+    double field[3] = {0.0, 0.0, 0.0};
+    fieldComponents(pos, field);
+    double sum[3];
+    sumFields(bakedFields, pos, sum);
+    for(int j=0;j<3;j++) field[j] -= sum[j];
+    const double deviation = std::sqrt(field[0]*field[0] + field[1]*field[1] + field[2]*field[2]);
+    if(deviation > maxDeviation) {
+      maxDeviation = deviation;
+      if(worstPos) std::copy(pos, pos + 3, worstPos);
+    }
+  }
+  return maxDeviation;
+
+}
+
+
+static Ref_t create_FieldMap_XYZAdaptive(Detector& description,
+                                         dd4hep::xml::Handle_t handle ) {
+  dd4hep::xml::Component xmlParameter(handle);
+
+  const double gridMin[3]  = { xmlParameter.attr< double >(_Unicode(xMin)),
+                               xmlParameter.attr< double >(_Unicode(yMin)),
+                               xmlParameter.attr< double >(_Unicode(zMin)) };
+  const double gridMax[3]  = { xmlParameter.attr< double >(_Unicode(xMax)),
+                               xmlParameter.attr< double >(_Unicode(yMax)),
+                               xmlParameter.attr< double >(_Unicode(zMax)) };
+  const double gridStep[3] = { xmlParameter.attr< double >(_Unicode(xStep)),
+                               xmlParameter.attr< double >(_Unicode(yStep)),
+                               xmlParameter.attr< double >(_Unicode(zStep)) };
+  for(int d=0;d<3;d++) {
+    if (not (gridMax[d] > gridMin[d] && gridStep[d] > 0)) {
+      std::stringstream error;
+      error << "FieldMapAdaptive[ERROR]: The grid of an adaptive field map needs min < max and step > 0 for x, y and z";
+      throw std::runtime_error(error.str());
+    }
+  }
+
+  const double tolerance = xmlParameter.attr< double >(_Unicode(tolerance));
+  if (not (tolerance >= 0)) {
+    std::stringstream error;
+    error << "FieldMapAdaptive[ERROR]: The tolerance of an adaptive field map must not be negative";
+    throw std::runtime_error(error.str());
+  }
+
+  //Number of resolution levels, the blocks have 1, 2, ..., 2^(levels-1) cells per axis
+  int levels = 4;
+  if(xmlParameter.hasAttr(_Unicode(levels))) levels = xmlParameter.attr< int >(_Unicode(levels));
+  if (levels < 1 || levels > 6) {
+    std::stringstream error;
+    error << "FieldMapAdaptive[ERROR]: The number of levels of an adaptive field map must be between 1 and 6, not " << levels;
+    throw std::runtime_error(error.str());
+  }
+
+  //Optional number of random points at which the adaptive field is compared with the sum of the fields
+  int deviationPoints = 10000;
+  if(xmlParameter.hasAttr(_Unicode(deviationPoints))) deviationPoints = xmlParameter.attr< int >(_Unicode(deviationPoints));
+
+  dd4hep::OverlayedField::Object* overlay = description.field().data<dd4hep::OverlayedField::Object>();
+  if (not overlay or overlay->magnetic_components.empty()) {
+    std::stringstream error;
+    error << "FieldMapAdaptive[ERROR]: An adaptive field map needs magnetic field elements declared before it";
+    throw std::runtime_error(error.str());
+  }
+
+  CartesianField obj;
+  FieldMapAdaptive* ptr = new FieldMapAdaptive();
+  ptr->tolerance   = tolerance;
+  ptr->bakedFields = overlay->magnetic_components;
+  ptr->setGrid(gridMin, gridMax, gridStep, levels);
+  ptr->fillFromFields(ptr->bakedFields);
+
+  //The summed elements are replaced by this one, which is added to the overlay when it is returned
+  overlay->magnetic_components.clear();
+  overlay->magnetic = CartesianField();
+
+  std::vector<int> blocksPerLevel(levels, 0);
+  for(const auto& blk : ptr->blocks) {
+    int level = 0;
+    while((1 << level) < blk.nCells) ++level;
+    ++blocksPerLevel[level];
+  }
+
+  std::cout << "Adaptive fields" << std::endl;
+  for(const auto& field : ptr->bakedFields) std::cout << "            " << std::setw(13) << field.name() << std::endl;
+  const char* axes[3] = { "x", "y", "z" };
+  for(int d=0;d<3;d++) {
+    std::cout << axes[d] << "Min        " << std::setw(13) << ptr->min[d]/dd4hep::cm << " cm"       << std::endl;
+    std::cout << axes[d] << "Max        " << std::setw(13) << ptr->max[d]/dd4hep::cm << " cm"       << std::endl;
+    std::cout << axes[d] << "Step       " << std::setw(13) << ptr->step[d]/dd4hep::cm << " cm"      << std::endl;
+    std::cout << "n" << axes[d] << "Blocks    " << std::setw(13) << ptr->nBlocks[d]                 << std::endl;
+  }
+  std::cout << "Tolerance   " << std::setw(13) << ptr->tolerance/dd4hep::tesla << " tesla"          << std::endl;
+  for(int level=0;level<levels;level++) {
+    std::cout << "Blocks " << std::setw(3) << (1 << level) << "^3 " << std::setw(9) << blocksPerLevel[level] << std::endl;
+  }
+  std::cout << "Points      " << std::setw(13) << ptr->values.size()
+            << " instead of " << ptr->uniformSize() << " in a uniform grid" << std::endl;
+  if(deviationPoints > 0) {
+    double worstPos[3] = {0.0, 0.0, 0.0};
+    const double maxDeviation = ptr->maxDeviationFromFields(deviationPoints, worstPos);
+    std::cout << "MaxDeviation" << std::setw(13) << maxDeviation/dd4hep::tesla << " tesla at ("
+              << worstPos[0]/dd4hep::cm << "," << worstPos[1]/dd4hep::cm << "," << worstPos[2]/dd4hep::cm << ") cm"
+              << " in " << deviationPoints << " random points" << std::endl;
+  }
+
+  obj.assign(ptr, xmlParameter.nameStr(), xmlParameter.typeStr());
+
+  return obj;
+
+}
+DECLARE_XMLELEMENT(FieldXYZAdaptive,create_FieldMap_XYZAdaptive)
@@ -1,4 +1,7 @@
 #include "FieldMapBrBz.h"
+#include "FieldMapRegistry.h"
+#include "FieldMapSpline.h"
+#include "FieldMapLanes.h"
 
 #include <DD4hep/Version.h>
 #if DD4HEP_VERSION_GE(0,24)
@@ -15,8 +18,13 @@
 
 #include <TFile.h>
 #include <TTree.h>
+#include <TTreeReader.h>
+#include <TTreeReaderValue.h>
 
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <string>
 #include <stdexcept>
 #include <iostream>
@@ -29,9 +37,9 @@ using dd4hep::Ref_t;
 DD4HEP_INSTANTIATE_HANDLE(FieldMapBrBz);
 
 namespace {
-  void checkBranch( int retCode ) {
+  template<typename T> void checkBranch( const TTreeReaderValue<T>& value ) {
 
-    if ( retCode != 0 ) {
+    if ( value.GetSetupStatus() < 0 ) {
       std::stringstream error;
       error << "FieldMap[ERROR]: Branch not correctly described ";
       throw std::runtime_error( error.str() );
@@ -39,10 +47,25 @@ namespace {
   }
 }
 
-FieldMapBrBz::FieldMapBrBz() {
+FieldMapBrBz::FieldMapBrBz() : fieldMapPtr(nullptr), sourceCoorUnits(0.0), sourceBfieldUnits(0.0), interpolation(1), splineCoefficientsPtr(nullptr),
+                               id(lcgeo::newFieldMapId()) {
   type = CartesianField::MAGNETIC;
 } //ctor
 
+FieldMapBrBz::~FieldMapBrBz() {
+  if(cellCacheCounters) {
+    //The other threads have flushed their lookups when they ended, the calling one may still have some
+    flushCellCache();
+    std::cout << "FieldMapBrBz: Last-cell cache hits " << cellCacheCounters->hits()
+              << " of " << cellCacheCounters->hits() + cellCacheCounters->misses() << " lookups, hit rate "
+              << cellCacheCounters->hitRate() << std::endl;
+  }
+}
+
+void FieldMapBrBz::flushCellCache() const {
+  if(cellCacheCounters) lcgeo::flushThreadCell<2,2>(id);
+}
+
 
 int FieldMapBrBz::getGlobalIndex(const int rBin, const int zBin)
 {
@@ -63,26 +86,20 @@ int FieldMapBrBz::getGlobalIndex(const int rBin, const int zBin)
 }
 
 /**
-    Use bileanar interpolation to calculate the field at the given position
-    This uses large pieces from Mokka FieldX03
+    Get the bins of the lower (bin0) and upper (bin1) corners of the cell containing the position and
+    the normalized coordinates (frac) of the position inside this cell, for the rho and z axes
  */
-void FieldMapBrBz::fieldComponents(const double* pos , double* globalField) {
+bool FieldMapBrBz::getCell(const double* pos, int* bin0, int* bin1, double* frac, double* lower) const {
+
+  //Get the rho and z coordinates of the 3D point
+  return getCellRZ(sqrt(pos[0]*pos[0] + pos[1]*pos[1]), pos[2], bin0, bin1, frac, lower);
 
-  //get position coordinates in our system
-  const double posRho = sqrt(pos[0]*pos[0] + pos[1]*pos[1]);
-  const double posZ   = pos[2];
-  const double posPhi = atan2(pos[1], pos[0]);
+}
 
-  //Get the rho, z and phi coordinates of the 3D point
-  double r   = posRho;
-  double z   = posZ;
-  double phi = posPhi;
+bool FieldMapBrBz::getCellRZ(double r, double z, int* bin0, int* bin1, double* frac, double* lower) const {
 
   //Get positive values to do less checks when comparing
-  if( z < 0 ) {
-    z   *= -1;
-    phi += M_PI;
-  }
+  if( z < 0 ) z *= -1;
 
   //APS: Note the mokka field map does not start at 0, so we have to assume that
   //this area is covered, or add some more parameters for the values where the
@@ -91,7 +108,7 @@ void FieldMapBrBz::fieldComponents(const double* pos , double* globalField) {
   if(z < zMin  ) z = zMin;
 
   //Do nothing if rho and z point are outside fieldmap limits
-  if (not (r <= rhoMax && z <= zMax ) ) return;
+  if (not (r <= rhoMax && z <= zMax ) ) return false;
 
   //Calculate the bins on the rho and z axis containing the (r,z) point
   int rBin,zBin;
@@ -112,38 +129,70 @@ void FieldMapBrBz::fieldComponents(const double* pos , double* globalField) {
   }
 
   //Get normalized coordinate of (r,z) point in bin
-  double rd = (r - r0)/rhoStep;
-  double zd = (z - z0)/zStep;
-
-  //Get the field values at the four corners of bin containing the (r,z) point
-  int rBin0 = rBin;
-  int rBin1 = rBin+1;
-  int zBin0 = zBin;
-  int zBin1 = zBin+1;
+  frac[0] = (r - r0)/rhoStep;
+  frac[1] = (z - z0)/zStep;
+
+  //Get the bins of the four corners of bin containing the (r,z) point
+  bin0[0] = rBin;
+  bin1[0] = rBin+1;
+  bin0[1] = zBin;
+  bin1[1] = zBin+1;
   //Protection in case the sampled coordinate is exactly at maximum value of fieldma
-  if(rBin1 > nRho-1) rBin1 = rBin0;
-  if(zBin1 > nZ  -1) zBin1 = zBin0;
-  const FieldMapBrBz::FieldValues_t& B_r0z0 = fieldMap[rBin0 + zBin0*nRho];
-  const FieldMapBrBz::FieldValues_t& B_r1z0 = fieldMap[rBin1 + zBin0*nRho];
-  const FieldMapBrBz::FieldValues_t& B_r0z1 = fieldMap[rBin0 + zBin1*nRho];
-  const FieldMapBrBz::FieldValues_t& B_r1z1 = fieldMap[rBin1 + zBin1*nRho];
-
-  //field at (r,z) point is linear interpolation of fielmap values at bin corners
+  if(bin1[0] > nRho-1) bin1[0] = bin0[0];
+  if(bin1[1] > nZ  -1) bin1[1] = bin0[1];
+
+  if(lower) {
+    lower[0] = r0;
+    lower[1] = z0;
+  }
+
+  return true;
+
+}
+
+namespace {
+  /**
+      sin(phi) and cos(phi) of the azimuthal projection of Br, computed from the coordinates instead of
+      atan2, sin and cos. phi is rotated by pi for negative z, as the map only covers positive z, which
+      flips the sign of both. On the z axis phi is 0, as atan2(0,0) gave before
+   */
+  inline void azimuthalProjection(double x, double y, double z, double rho, double& sinPhi, double& cosPhi) {
+    const double invRho = ( rho > 0.0 ? 1.0/rho : 0.0 );
+    const double sign   = ( z < 0 ? -1.0 : 1.0 );
+    sinPhi = sign*y*invRho;
+    cosPhi = ( rho > 0.0 ? sign*x*invRho : sign );
+  }
+}
+
+/**
+    Use bileanar interpolation to calculate the field at the given position
+    This uses large pieces from Mokka FieldX03
+ */
+void FieldMapBrBz::fieldComponents(const double* pos , double* globalField) {
+
+  //Get the rho coordinate of the 3D point, used for the cell and for the projection of Br
+  const double rho = sqrt(pos[0]*pos[0] + pos[1]*pos[1]);
+
   double field[2] = {0.0, 0.0};
+  if(cellCacheCounters) {
+    if(not interpolateCached(rho, pos[2], field)) return;
+  } else {
+    int bin0[2], bin1[2];
+    double frac[2];
+    if(not getCellRZ(rho, pos[2], bin0, bin1, frac)) return;
+    interpolate(bin0, bin1, frac, field);
+  }
 
-  field[0] = (1.0 - rd) * (1.0 - zd) * B_r0z0.Br + 
-                    rd  * (1.0 - zd) * B_r1z0.Br + 
-             (1.0 - rd) *        zd  * B_r0z1.Br + 
-                    rd  *        zd  * B_r1z1.Br;
+  double sinPhi, cosPhi;
+  azimuthalProjection(pos[0], pos[1], pos[2], rho, sinPhi, cosPhi);
 
-  field[1] = (1.0 - rd) * (1.0 - zd) * B_r0z0.Bz + 
-                    rd  * (1.0 - zd) * B_r1z0.Bz + 
-             (1.0 - rd) *        zd  * B_r0z1.Bz + 
-                    rd  *        zd  * B_r1z1.Bz;
+  //The field map points can be shared with other field maps, the scale factor is applied here
+  const double Br = bScale*field[0];
+  const double Bz = bScale*field[1];
 
-  globalField[0] += field[0] * sin( phi ) ;
-  globalField[1] += field[0] * cos( phi ) ;
-  globalField[2] += field[1] ;
+  globalField[0] += Br * sinPhi ;
+  globalField[1] += Br * cosPhi ;
+  globalField[2] += Bz ;
 
   /*
   std::cout << std::endl;
@@ -157,6 +206,256 @@ void FieldMapBrBz::fieldComponents(const double* pos , double* globalField) {
 
 }
 
+/**
+    Evaluate the field at nPoints positions per call: the cylindrical coordinates and cells of a block
+    of lcgeo::laneBlockSize points are computed first, then the whole block is interpolated together by
+    interpolateBlock with one lane per point, and the field is projected for the points inside the map.
+    Gives the same result as calling fieldComponents for every point
+ */
+void FieldMapBrBz::fieldComponentsBatch(const double* pos, double* globalField, std::size_t nPoints) {
+
+  const std::size_t blockSize = lcgeo::laneBlockSize;
+  int    bin0[blockSize][2], bin1[blockSize][2];
+  double frac[blockSize][2];
+  double field[blockSize][2];
+  double sinPhi[blockSize], cosPhi[blockSize];
+  bool   inside[blockSize];
+
+  for(std::size_t start=0;start<nPoints;start+=blockSize) {
+    const std::size_t n = std::min(blockSize, nPoints - start);
+    const double* blockPos = pos + 3*start;
+
+    //Locate the cells of all points in the block, same arithmetic as getCell
+    for(std::size_t i=0;i<n;i++) {
+      const double x = blockPos[3*i];
+      const double y = blockPos[3*i + 1];
+      const double z = blockPos[3*i + 2];
+      const double rho = std::sqrt(x*x + y*y);
+      const double coord[2] = { std::max(rho, rhoMin), std::max(std::fabs(z), zMin) };
+      const double coordMin[2]  = { rhoMin,  zMin  };
+      const double coordMax[2]  = { rhoMax,  zMax  };
+      const double coordStep[2] = { rhoStep, zStep };
+      const int    nBins[2]     = { nRho,    nZ    };
+      inside[i] = (coord[0] <= rhoMax) & (coord[1] <= zMax);
+      for(int j=0;j<2;j++) {
+        //Clamp to the map so that the bin is valid also for points outside of the map
+        const double c  = coord[j] <= coordMax[j] ? coord[j] : coordMax[j];
+        int bin         = int((c - coordMin[j])/coordStep[j]);
+        double c0       = coordMin[j] + bin*coordStep[j];
+        const bool down = c0 > c;
+        bin            -= down;
+        c0             -= down ? coordStep[j] : 0.0;
+        frac[i][j]      = (c - c0)/coordStep[j];
+        bin0[i][j]      = bin;
+        bin1[i][j]      = bin+1 > nBins[j]-1 ? bin : bin+1;
+      }
+      azimuthalProjection(x, y, z, rho, sinPhi[i], cosPhi[i]);
+    }
+    //Unused lanes of the last block interpolate the first cell of the map
+    for(std::size_t i=n;i<blockSize;i++) {
+      inside[i] = false;
+      for(int j=0;j<2;j++) {
+        frac[i][j] = 0.0;
+        bin0[i][j] = bin1[i][j] = 0;
+      }
+    }
+
+    for(std::size_t i=0;i<blockSize;i++) field[i][0] = field[i][1] = 0.0;
+    interpolateBlock(bin0, bin1, frac, field);
+
+    //Project the field for the points inside the map
+    for(std::size_t i=0;i<n;i++) {
+      if(not inside[i]) continue;
+      double* blockField = globalField + 3*(start + i);
+      const double Br = bScale*field[i][0];
+      const double Bz = bScale*field[i][1];
+      blockField[0] += Br * sinPhi[i] ;
+      blockField[1] += Br * cosPhi[i] ;
+      blockField[2] += Bz ;
+    }
+  }
+
+}
+
+/**
+    Add the Br and Bz components interpolated in the cells of a block of lcgeo::laneBlockSize points,
+    with one lane per point: the corner values are gathered per lane and the bilinear interpolation of
+    interpolate is done on lcgeo::LaneD, with the same operations so that the result agrees exactly.
+    The bicubic interpolation is done point by point
+ */
+void FieldMapBrBz::interpolateBlock(const int (*bin0)[2], const int (*bin1)[2], const double (*frac)[2], double (*field)[2]) const {
+
+  const int n = lcgeo::laneBlockSize;
+  if(interpolation == 3) {
+    for(int i=0;i<n;i++) interpolateCubic(bin0[i], frac[i], field[i]);
+    return;
+  }
+
+  //Indices of the Br values of the corners and fractions arranged by lane, corner index bit 0 (1) set
+  //for the upper rho (z) corner, the two components of a point are consecutive doubles
+  int    index[4][n];
+  double fracLanes[2][n];
+  for(int i=0;i<n;i++) {
+    for(int corner=0;corner<4;corner++) {
+      index[corner][i] = 2*( ( corner & 1 ? bin1[i][0] : bin0[i][0] ) +
+                             ( corner & 2 ? bin1[i][1] : bin0[i][1] )*nRho );
+    }
+    for(int j=0;j<2;j++) fracLanes[j][i] = frac[i][j];
+  }
+  const double* values = &fieldMapPtr[0].Br;
+
+  using namespace lcgeo;
+  const LaneD one = laneSet(1.0);
+  for(int lane=0;lane<n;lane+=laneWidth) {
+    const LaneD rd = laneLoad(&fracLanes[0][lane]);
+    const LaneD zd = laneLoad(&fracLanes[1][lane]);
+    const LaneD weight[4] = { laneMul(laneSub(one, rd), laneSub(one, zd)), laneMul(rd, laneSub(one, zd)),
+                              laneMul(laneSub(one, rd), zd),               laneMul(rd, zd) };
+
+    for(int j=0;j<2;j++) {
+      LaneD c[4];
+      for(int corner=0;corner<4;corner++) c[corner] = laneGather(values + j, &index[corner][lane]);
+
+      LaneD B = laneMul(weight[0], c[0]);
+      B = laneMulAdd(weight[1], c[1], B);
+      B = laneMulAdd(weight[2], c[2], B);
+      B = laneMulAdd(weight[3], c[3], B);
+
+      double B_lanes[laneWidth];
+      laneStore(B_lanes, B);
+      for(int l=0;l<laneWidth;l++) field[lane + l][j] += B_lanes[l];
+    }
+  }
+
+}
+
+namespace {
+  /// Add the Br and Bz components interpolated bilinearly between the values at the four corners of a
+  /// cell, corner index bit 0 (1) set for the upper rho (z) corner
+  inline void bilinear(const double (*corners)[2], const double* frac, double* field) {
+
+    const double rd = frac[0];
+    const double zd = frac[1];
+
+    //field at (r,z) point is linear interpolation of fielmap values at bin corners,
+    //same operations as in FieldMapBrBz::interpolateBlock
+    for(int j=0;j<2;j++) {
+      double B = (1.0 - rd) * (1.0 - zd) * corners[0][j];
+      B = lcgeo::mulAdd(        rd  * (1.0 - zd), corners[1][j], B);
+      B = lcgeo::mulAdd((1.0 - rd) *        zd , corners[2][j], B);
+      B = lcgeo::mulAdd(        rd  *        zd , corners[3][j], B);
+      field[j] += B;
+    }
+
+  }
+}
+
+/**
+    Add the Br and Bz components bilinearly interpolated in the cell given by getCell to field
+ */
+void FieldMapBrBz::interpolate(const int* bin0, const int* bin1, const double* frac, double* field) const {
+
+  if(interpolation == 3) {
+    interpolateCubic(bin0, frac, field);
+    return;
+  }
+
+  //Get the field values at the four corners of bin containing the (r,z) point
+  double corners[4][2];
+  for(int corner=0;corner<4;corner++) {
+    const FieldMapBrBz::FieldValues_t& B = fieldMapPtr[ ( corner & 1 ? bin1[0] : bin0[0] ) +
+                                                        ( corner & 2 ? bin1[1] : bin0[1] )*nRho ];
+    corners[corner][0] = B.Br;
+    corners[corner][1] = B.Bz;
+  }
+
+  bilinear(corners, frac, field);
+
+}
+
+/**
+    Bilinear interpolation using the corner values of the last cell of the calling thread. The cell is
+    only refilled from the field map when the position leaves it, consecutive steps of a track mostly
+    stay inside of one cell
+ */
+bool FieldMapBrBz::interpolateCached(double rho, double z, double* field) const {
+
+  lcgeo::FieldMapCell<2,2>& cell = lcgeo::threadCell<2,2>(id, cellCacheCounters);
+
+  //Same (rho,z) coordinates as in getCell
+  const double coord[2] = { std::max(rho, rhoMin), std::max(std::fabs(z), zMin) };
+  const double step[2]  = { rhoStep, zStep };
+  double frac[2];
+
+  const bool hit = cell.contains(coord);
+  cell.count(hit);
+  if(hit) {
+    for(int j=0;j<2;j++) frac[j] = (coord[j] - cell.lower[j])/step[j];
+  } else {
+    int bin0[2], bin1[2];
+    if(not getCellRZ(rho, z, bin0, bin1, frac, cell.lower)) {
+      cell.lower[0] = 1.0;
+      cell.upper[0] = 0.0;
+      return false;
+    }
+    for(int j=0;j<2;j++) cell.upper[j] = ( bin1[j] > bin0[j] ? cell.lower[j] + step[j] : cell.lower[j] );
+
+    for(int corner=0;corner<4;corner++) {
+      const FieldMapBrBz::FieldValues_t& B = fieldMapPtr[ ( corner & 1 ? bin1[0] : bin0[0] ) +
+                                                          ( corner & 2 ? bin1[1] : bin0[1] )*nRho ];
+      cell.corners[corner][0] = B.Br;
+      cell.corners[corner][1] = B.Bz;
+    }
+  }
+
+  bilinear(cell.corners, frac, field);
+  return true;
+
+}
+
+/**
+    Bicubic interpolation with the cubic B-spline coefficients of the 4x4 nodes around the cell,
+    mirrored at the edges of the map
+ */
+void FieldMapBrBz::interpolateCubic(const int* bin0, const double* frac, double* field) const {
+
+  double wr[4], wz[4];
+  lcgeo::splineWeights(frac[0], wr);
+  lcgeo::splineWeights(frac[1], wz);
+
+  int ir[4], iz[4];
+  for(int k=0;k<4;k++) {
+    ir[k] = lcgeo::splineMirrorIndex(bin0[0] - 1 + k, nRho);
+    iz[k] = lcgeo::splineMirrorIndex(bin0[1] - 1 + k, nZ)*nRho;
+  }
+
+  for(int kz=0;kz<4;kz++) {
+    double Br = 0.0, Bz = 0.0;
+    for(int kr=0;kr<4;kr++) {
+      const FieldMapBrBz::FieldValues_t& B = splineCoefficientsPtr[ir[kr] + iz[kz]];
+      Br += wr[kr]*B.Br;
+      Bz += wr[kr]*B.Bz;
+    }
+    field[0] += wz[kz]*Br;
+    field[1] += wz[kz]*Bz;
+  }
+
+}
+
+void FieldMapBrBz::fillSplineCoefficients() {
+
+  splineCoefficients.assign(fieldMapPtr, fieldMapPtr + std::size_t(nRho)*nZ);
+
+  //The prefilter is separable: convert all lines along rho, then along z, for both components
+  static_assert( sizeof(FieldValues_t) == 2*sizeof(double), "FieldValues_t must be two packed doubles" );
+  double* data = &splineCoefficients[0].Br;
+  for(int c=0;c<2;c++) {
+    for(int iz=0;iz<nZ;iz++)   lcgeo::splinePrefilter(data + 2*iz*nRho + c, nRho, 2);
+    for(int ir=0;ir<nRho;ir++) lcgeo::splinePrefilter(data + 2*ir + c, nZ, 2*nRho);
+  }
+  splineCoefficientsPtr = splineCoefficients.data();
+
+}
 
 void FieldMapBrBz::fillFieldMapFromTree(const std::string& filename,
                                         double coorUnits, double BfieldUnits) {
@@ -167,6 +466,9 @@ void FieldMapBrBz::fillFieldMapFromTree(const std::string& filename,
     error << "FieldMapBrBz[ERROR]: File not found: " << filename;
     throw std::runtime_error( error.str() );
   }
+  sourceFile        = filename;
+  sourceCoorUnits   = coorUnits;
+  sourceBfieldUnits = BfieldUnits;
 
   std::cout << std::endl;
   std::cout << "Ntuple name:   " << ntupleName << std::endl;
@@ -184,14 +486,7 @@ void FieldMapBrBz::fillFieldMapFromTree(const std::string& filename,
     throw std::runtime_error( error.str() );
   }
 
-  //Set branch adresses
-  float r, z, Br, Bz;
-  checkBranch( tree->SetBranchAddress(rhoVar.c_str(),  &r) );
-  checkBranch( tree->SetBranchAddress(zVar.c_str(),    &z) );
-  checkBranch( tree->SetBranchAddress(BrhoVar.c_str(), &Br));
-  checkBranch( tree->SetBranchAddress(BzVar.c_str(),   &Bz));
-
-  //Loop over the tree entries. In this loop get,
+  //Read the tree once, sequentially, into columns. While reading get,
   // - min, max and step-size values of fieldmap coordinates
   // - coordinates ordering
   zStep       = -1;
@@ -200,28 +495,50 @@ void FieldMapBrBz::fillFieldMapFromTree(const std::string& filename,
   zOrdering   =  1;
   strCoorsOrder = std::string("");
   const int treeEntries = tree->GetEntries();
-  fieldMap.reserve(treeEntries);
-  for(int i=0;i<treeEntries;i++) {
-    tree->GetEntry(i);
-
-    if(i == 0) {
-      rhoMin = r;
-      zMin   = z;
-    }
-    if(i == treeEntries-1) {
-      rhoMax = r;
-      zMax   = z;
-    }
-
-    if(r != rhoMin && rhoStep < 0.0) {
-      rhoStep     = TMath::Abs(rhoMin - r);
-      strCoorsOrder += std::string("R");
-    }
-    if(z != zMin && zStep < 0.0) {
-      zStep         = TMath::Abs(zMin - z);
-      strCoorsOrder += std::string("Z");
+  std::vector< float > rs, zs, Brs, Bzs;
+  rs.reserve(treeEntries);
+  zs.reserve(treeEntries);
+  Brs.reserve(treeEntries);
+  Bzs.reserve(treeEntries);
+  {
+    TTreeReader reader(tree);
+    TTreeReaderValue<float> r(reader,  rhoVar.c_str());
+    TTreeReaderValue<float> z(reader,  zVar.c_str());
+    TTreeReaderValue<float> Br(reader, BrhoVar.c_str());
+    TTreeReaderValue<float> Bz(reader, BzVar.c_str());
+
+    while(reader.Next()) {
+      rs.push_back(*r);
+      zs.push_back(*z);
+      Brs.push_back(*Br);
+      Bzs.push_back(*Bz);
+
+      if(rs.size() == 1) {
+        rhoMin = rs.back();
+        zMin   = zs.back();
+      }
+
+      if(rs.back() != rhoMin && rhoStep < 0.0) {
+        rhoStep     = TMath::Abs(rhoMin - rs.back());
+        strCoorsOrder += std::string("R");
+      }
+      if(zs.back() != zMin && zStep < 0.0) {
+        zStep         = TMath::Abs(zMin - zs.back());
+        strCoorsOrder += std::string("Z");
+      }
     }
+    checkBranch( r );
+    checkBranch( z );
+    checkBranch( Br );
+    checkBranch( Bz );
   }
+  if ( rs.empty() || int(rs.size()) != treeEntries ) {
+    std::stringstream error;
+    error << "FieldMapBrBz[ERROR]: Could only read " << rs.size() << " of " << treeEntries << " tree entries";
+    throw std::runtime_error( error.str() );
+  }
+  rhoMax = rs.back();
+  zMax   = zs.back();
 
   if(strCoorsOrder == std::string("RZ"))      coorsOrder = 1;
   else if(strCoorsOrder == std::string("ZR")) coorsOrder = 2;
@@ -272,18 +589,110 @@ void FieldMapBrBz::fillFieldMapFromTree(const std::string& filename,
     throw std::runtime_error( error.str() );
   }
 
-  //Fill the array with the Bfield values in the RZ order
-  for(int iz=0;iz<nZ;iz++) {
-    for(int ir=0;ir<nRho;ir++) {
-      tree->GetEntry(getGlobalIndex(ir,iz));
-      fieldMap.push_back( FieldMapBrBz::FieldValues_t( double(Br)*bScale*BfieldUnits,
-                                                       double(Bz)*bScale*BfieldUnits ) );
+  //Fill the array with the Bfield values in the RZ order, placing every entry according to its coordinates
+  fieldMap.assign(elements, FieldMapBrBz::FieldValues_t(0.0, 0.0));
+  std::vector< bool > filled(elements, false);
+  for(int i=0;i<treeEntries;i++) {
+    const long ir = std::lround((rs[i]*coorUnits - rhoMin)/rhoStep);
+    const long iz = std::lround((zs[i]*coorUnits - zMin)/zStep);
+    const long index = ir + iz*nRho;
+    if ( ir < 0 || ir >= nRho || iz < 0 || iz >= nZ || filled[index] ) {
+      std::stringstream error;
+      error << "FieldMapBrBz[ERROR]: Tree entry " << i << " at (" << rs[i] << "," << zs[i]
+            << ") is not on the regular grid of the field map";
+      throw std::runtime_error( error.str() );
     }
+    filled[index] = true;
+    fieldMap[index] = FieldMapBrBz::FieldValues_t( double(Brs[i])*BfieldUnits,
+                                                   double(Bzs[i])*BfieldUnits );
   }
 
   file->Close();
   delete file;
 
+  fieldMapPtr = fieldMap.data();
+
+}
+
+void FieldMapBrBz::useSharedGrid(const std::shared_ptr<const FieldMapBrBz>& grid) {
+
+  coorsOrder    = grid->coorsOrder;
+  strCoorsOrder = grid->strCoorsOrder;
+  nRho = grid->nRho;  rhoOrdering = grid->rhoOrdering;  rhoMin = grid->rhoMin;  rhoMax = grid->rhoMax;  rhoStep = grid->rhoStep;
+  nZ   = grid->nZ;    zOrdering   = grid->zOrdering;    zMin   = grid->zMin;    zMax   = grid->zMax;    zStep   = grid->zStep;
+
+  interpolation         = grid->interpolation;
+  fieldMapPtr           = grid->fieldMapPtr;
+  splineCoefficientsPtr = grid->splineCoefficientsPtr;
+  sourceFile            = grid->sourceFile;
+  sourceCoorUnits       = grid->sourceCoorUnits;
+  sourceBfieldUnits     = grid->sourceBfieldUnits;
+  sharedGrid            = grid;
+
+}
+
+lcgeo::FieldMapCacheHeader FieldMapBrBz::cacheHeader(const std::string& filename,
+                                                     double coorUnits, double BfieldUnits) const {
+
+  std::stringstream config;
+  config << ntupleName << ":" << rhoVar << ":" << zVar << ":" << BrhoVar << ":" << BzVar;
+
+  lcgeo::FieldMapCacheHeader header = lcgeo::FieldMapCache::makeHeader(filename, config.str());
+  header.mapType     = 1;
+  header.storage     = 0;
+  header.coorUnits   = coorUnits;
+  header.BfieldUnits = BfieldUnits;
+  header.bScale      = 1.0; //the points are stored without bScale, which is applied at lookup
+  return header;
+
+}
+
+bool FieldMapBrBz::fillFieldMapFromCache(const std::string& cacheFile, const std::string& filename,
+                                         double coorUnits, double BfieldUnits) {
+
+  std::shared_ptr<const lcgeo::FieldMapCache> mapped =
+    lcgeo::FieldMapCache::open(cacheFile, cacheHeader(filename, coorUnits, BfieldUnits));
+  if (not mapped) return false;
+
+  const lcgeo::FieldMapCacheHeader& header = mapped->header();
+  const std::size_t nPoints = std::size_t(header.nBins[0])*header.nBins[1];
+  if (header.payloadSize != nPoints*sizeof(FieldValues_t)) return false;
+
+  coorsOrder    = header.coorsOrder;
+  strCoorsOrder = std::string(header.strCoorsOrder, strnlen(header.strCoorsOrder, sizeof(header.strCoorsOrder)));
+  nRho = header.nBins[0];  rhoOrdering = header.ordering[0];
+  nZ   = header.nBins[1];  zOrdering   = header.ordering[1];
+  rhoMin = header.min[0];  rhoMax = header.max[0];  rhoStep = header.step[0];
+  zMin   = header.min[1];  zMax   = header.max[1];  zStep   = header.step[1];
+
+  //The interpolation reads the field values directly from the mapped file
+  std::vector< FieldValues_t >().swap(fieldMap);
+  fieldMapPtr = static_cast<const FieldValues_t*>(mapped->payload());
+  cache = mapped;
+  sourceFile        = filename;
+  sourceCoorUnits   = coorUnits;
+  sourceBfieldUnits = BfieldUnits;
+
+  std::cout << "FieldMapBrBz: Field map mapped from cache file " << cacheFile << std::endl;
+  return true;
+
+}
+
+void FieldMapBrBz::writeFieldMapCache(const std::string& cacheFile, const std::string& filename,
+                                      double coorUnits, double BfieldUnits) const {
+
+  lcgeo::FieldMapCacheHeader header = cacheHeader(filename, coorUnits, BfieldUnits);
+  lcgeo::FieldMapCache::addSourceChecksum(header, filename);
+  header.coorsOrder = coorsOrder;
+  strCoorsOrder.copy(header.strCoorsOrder, sizeof(header.strCoorsOrder) - 1);
+  header.nBins[0] = nRho;    header.ordering[0] = rhoOrdering;
+  header.nBins[1] = nZ;      header.ordering[1] = zOrdering;
+  header.min[0] = rhoMin;    header.max[0] = rhoMax;  header.step[0] = rhoStep;
+  header.min[1] = zMin;      header.max[1] = zMax;    header.step[1] = zStep;
+  header.payloadSize = std::size_t(nRho)*nZ*sizeof(FieldValues_t);
+
+  lcgeo::FieldMapCache::write(cacheFile, header, fieldMapPtr);
+
 }
 
 static Ref_t create_FieldMap_rzBrBz(Detector& ,
@@ -311,8 +720,58 @@ static Ref_t create_FieldMap_rzBrBz(Detector& ,
   double coorUnits   = xmlParameter.attr< double >(_Unicode(coorUnits));
   double BfieldUnits = xmlParameter.attr< double >(_Unicode(BfieldUnits));
 
+  //Optional interpolation of the field map: linear (default) or cubic, using precomputed B-spline coefficients
+  std::string strInterpolation("linear");
+  if(xmlParameter.hasAttr(_Unicode(interpolation))) strInterpolation = xmlParameter.attr< std::string >(_Unicode(interpolation));
+  int interpolation = 1;
+  if(strInterpolation == "linear")     interpolation = 1;
+  else if(strInterpolation == "cubic") interpolation = 3;
+  else {
+    std::stringstream error;
+    error << "FieldMapBrBz[ERROR]: Unknown interpolation " << strInterpolation << ", must be linear or cubic";
+    throw std::runtime_error(error.str());
+  }
+
+  //Optional per-thread cache of the last cell used in the interpolation
+  bool cellCache = false;
+  if(xmlParameter.hasAttr(_Unicode(cellCache))) cellCache = xmlParameter.attr< bool >(_Unicode(cellCache));
+  if(cellCache && (interpolation != 1)) {
+    std::stringstream error;
+    error << "FieldMapBrBz[ERROR]: The last-cell cache is only available with the linear interpolation";
+    throw std::runtime_error(error.str());
+  }
+
+  //Optional binary cache of the field map, mapped read-only instead of reading the tree
+  std::string cacheFile;
+  if(xmlParameter.hasAttr(_Unicode(cacheFile))) cacheFile = xmlParameter.attr< std::string >(_Unicode(cacheFile));
+
+  //Field elements reading the same file with the same settings share one grid, the bScale is applied at lookup
+  std::stringstream key;
+  key << "FieldMapBrBz:" << filename << ":" << ntupleName << ":" << rhoVar << ":" << zVar
+      << ":" << BrhoVar << ":" << BzVar << ":" << coorUnits << ":" << BfieldUnits << ":" << strInterpolation;
+  std::shared_ptr<const FieldMapBrBz> grid = lcgeo::FieldMapRegistry::get<FieldMapBrBz>(key.str(), [&]() {
+      std::shared_ptr<FieldMapBrBz> newGrid = std::make_shared<FieldMapBrBz>();
+      newGrid->interpolation = interpolation;
+      newGrid->bScale        = 1.0;
+      newGrid->ntupleName    = ntupleName;
+      newGrid->rhoVar        = rhoVar;
+      newGrid->zVar          = zVar;
+      newGrid->BrhoVar       = BrhoVar;
+      newGrid->BzVar         = BzVar;
+
+      //Map the entries from the cache file if it is up to date, otherwise read them form the file in this place
+      if(cacheFile.empty() or not newGrid->fillFieldMapFromCache(cacheFile, filename, coorUnits, BfieldUnits)) {
+        newGrid->fillFieldMapFromTree(filename, coorUnits, BfieldUnits);
+        if(not cacheFile.empty()) newGrid->writeFieldMapCache(cacheFile, filename, coorUnits, BfieldUnits);
+      }
+      if(newGrid->interpolation == 3) newGrid->fillSplineCoefficients();
+      return std::shared_ptr<const FieldMapBrBz>(newGrid);
+    });
+
   CartesianField obj;
   FieldMapBrBz* ptr = new FieldMapBrBz();
+  ptr->useSharedGrid(grid);
+  if(cellCache) ptr->cellCacheCounters = std::make_shared<lcgeo::FieldMapCellCounters>();
   ptr->rScale     = rScale;
   ptr->zScale     = zScale;
   ptr->bScale     = bScale;
@@ -322,9 +781,6 @@ static Ref_t create_FieldMap_rzBrBz(Detector& ,
   ptr->BrhoVar    = BrhoVar;
   ptr->BzVar      = BzVar;
 
-  //Read the entries form the file in this place
-  ptr->fillFieldMapFromTree(filename, coorUnits, BfieldUnits);
-
   std::string strRhoOrdering("low-to-high");
   std::string strZOrdering("low-to-high");
   if(ptr->rhoOrdering == -1) strRhoOrdering = "high-to-low";
@@ -346,6 +802,8 @@ static Ref_t create_FieldMap_rzBrBz(Detector& ,
   std::cout << "CoorsOrder  " << std::setw(13) << ptr->strCoorsOrder.c_str()            << std::endl;
   std::cout << "coorUnits   " << std::setw(13) << coorUnits/dd4hep::cm << " cm"         << std::endl;
   std::cout << "BfieldUnits " << std::setw(13) << BfieldUnits/dd4hep::tesla << " tesla" << std::endl;
+  std::cout << "Interpolation " << std::setw(11) << strInterpolation.c_str()            << std::endl;
+  std::cout << "CellCache   " << std::setw(13) << ( cellCache ? "true" : "false" )   << std::endl;
 
   ptr->rhoMin  *= rScale;
   ptr->rhoMax  *= rScale;
@@ -0,0 +1,164 @@
+#include "FieldMapCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+  const char     cacheMagic[8] = { 'L', 'C', 'G', 'E', 'O', 'F', 'M', 'C' };
+  const uint32_t cacheVersion  = 3;
+
+  static_assert( sizeof(lcgeo::FieldMapCacheHeader) % 64 == 0, "FieldMapCacheHeader must keep the field values aligned" );
+}
+
+namespace lcgeo {
+
+  uint64_t FieldMapCache::checksum(const void* data, std::size_t size, uint64_t seed) {
+
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for(std::size_t i=0;i<size;i++) {
+      hash ^= bytes[i];
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+
+  }
+
+  FieldMapCacheHeader FieldMapCache::makeHeader(const void* source, std::size_t sourceSize, const std::string& config) {
+
+    FieldMapCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, cacheMagic, sizeof(header.magic));
+    header.version        = cacheVersion;
+    header.configChecksum = checksum(config.data(), config.size());
+    header.sourceChecksum = checksum(source, sourceSize);
+    header.sourceSize     = sourceSize;
+    return header;
+
+  }
+
+  FieldMapCacheHeader FieldMapCache::makeHeader(const std::string& filename, const std::string& config) {
+
+    FieldMapCacheHeader header = makeHeader(nullptr, 0, config);
+    header.sourceChecksum = 0;
+
+    //Only the metadata of the source ROOT file, so that checking the cache does not read the file
+    struct stat status;
+    if (stat(filename.c_str(), &status) != 0) {
+      std::stringstream error;
+      error << "FieldMapCache[ERROR]: File not found: " << filename;
+      throw std::runtime_error( error.str() );
+    }
+    header.sourceSize  = status.st_size;
+    header.sourceInode = status.st_ino;
+#ifdef __APPLE__
+    header.sourceModified = int64_t(status.st_mtimespec.tv_sec)*1000000000LL + status.st_mtimespec.tv_nsec;
+#else
+    header.sourceModified = int64_t(status.st_mtim.tv_sec)*1000000000LL + status.st_mtim.tv_nsec;
+#endif
+
+    return header;
+
+  }
+
+  void FieldMapCache::addSourceChecksum(FieldMapCacheHeader& header, const std::string& filename) {
+
+    //A sequential read is cheap compared to unpacking the tree, which happens at the same time
+    std::ifstream source(filename, std::ios::binary);
+    if (not source) {
+      std::stringstream error;
+      error << "FieldMapCache[ERROR]: File not found: " << filename;
+      throw std::runtime_error( error.str() );
+    }
+    std::vector<char> buffer(1 << 20);
+    header.sourceChecksum = checksum(nullptr, 0);
+    while(source) {
+      source.read(buffer.data(), buffer.size());
+      header.sourceChecksum = checksum(buffer.data(), source.gcount(), header.sourceChecksum);
+    }
+
+  }
+
+  std::shared_ptr<const FieldMapCache> FieldMapCache::open(const std::string& cacheFile, const FieldMapCacheHeader& expected) {
+
+    const int fd = ::open(cacheFile.c_str(), O_RDONLY);
+    if(fd < 0) return nullptr;
+
+    struct stat status;
+    if(fstat(fd, &status) != 0 or std::size_t(status.st_size) < sizeof(FieldMapCacheHeader)) {
+      ::close(fd);
+      return nullptr;
+    }
+
+    const std::size_t size = status.st_size;
+    void* address = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(address == MAP_FAILED) return nullptr;
+
+    std::shared_ptr<const FieldMapCache> cache(new FieldMapCache(address, size));
+    const FieldMapCacheHeader& header = cache->header();
+
+    const bool valid = ( std::memcmp(header.magic, cacheMagic, sizeof(header.magic)) == 0 &&
+                         header.version        == cacheVersion            &&
+                         header.mapType        == expected.mapType        &&
+                         header.storage        == expected.storage        &&
+                         header.coorUnits      == expected.coorUnits      &&
+                         header.BfieldUnits    == expected.BfieldUnits    &&
+                         header.bScale         == expected.bScale         &&
+                         header.configChecksum == expected.configChecksum &&
+                         header.sourceSize     == expected.sourceSize     &&
+                         header.sourceModified == expected.sourceModified &&
+                         header.sourceInode    == expected.sourceInode    &&
+                         //ROOT files are identified by their metadata, sources in memory by their checksum
+                         ( expected.sourceChecksum == 0 || header.sourceChecksum == expected.sourceChecksum ) &&
+                         header.payloadSize + sizeof(FieldMapCacheHeader) == size );
+    if(not valid) {
+      std::cout << "FieldMapCache[WARNING]: Cache file " << cacheFile
+                << " does not match the field map configuration or source file, it will be rewritten" << std::endl;
+      return nullptr;
+    }
+
+    return cache;
+
+  }
+
+  bool FieldMapCache::write(const std::string& cacheFile, const FieldMapCacheHeader& header, const void* payload) {
+
+    //Write to a temporary file and rename it, so that concurrent jobs never map a partial cache
+    std::stringstream tmpFile;
+    tmpFile << cacheFile << ".tmp." << getpid();
+    {
+      std::ofstream output(tmpFile.str(), std::ios::binary | std::ios::trunc);
+      output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      output.write(static_cast<const char*>(payload), header.payloadSize);
+      if(not output) {
+        std::cout << "FieldMapCache[WARNING]: Could not write cache file " << cacheFile << std::endl;
+        std::remove(tmpFile.str().c_str());
+        return false;
+      }
+    }
+    if(std::rename(tmpFile.str().c_str(), cacheFile.c_str()) != 0) {
+      std::cout << "FieldMapCache[WARNING]: Could not write cache file " << cacheFile << std::endl;
+      std::remove(tmpFile.str().c_str());
+      return false;
+    }
+    std::cout << "FieldMapCache: Wrote cache file " << cacheFile << std::endl;
+    return true;
+
+  }
+
+  FieldMapCache::~FieldMapCache() {
+    munmap(m_address, m_size);
+  }
+
+}
@@ -0,0 +1,29 @@
+#include "FieldMapRegistry.h"
+
+namespace lcgeo {
+
+  std::mutex& FieldMapRegistry::mutex() {
+    static std::mutex registryMutex;
+    return registryMutex;
+  }
+
+  std::map< std::string, std::weak_ptr<const void> >& FieldMapRegistry::entries() {
+    static std::map< std::string, std::weak_ptr<const void> > registryEntries;
+    return registryEntries;
+  }
+
+  void FieldMapRegistry::removeExpired() {
+    std::map< std::string, std::weak_ptr<const void> >& grids = entries();
+    for(auto it = grids.begin(); it != grids.end(); ) {
+      if(it->second.expired()) it = grids.erase(it);
+      else ++it;
+    }
+  }
+
+  std::size_t FieldMapRegistry::size() {
+    std::lock_guard<std::mutex> lock(mutex());
+    removeExpired();
+    return entries().size();
+  }
+
+}
@@ -1,4 +1,8 @@
 #include "FieldMapXYZ.h"
+#include "FieldMapBrBz.h"
+#include "FieldMapRegistry.h"
+#include "FieldMapSpline.h"
+#include "FieldMapLanes.h"
 
 #include <DD4hep/Version.h>
 #if DD4HEP_VERSION_GE(0,24)
@@ -19,8 +23,14 @@
 
 #include <TFile.h>
 #include <TTree.h>
+#include <TTreeReader.h>
+#include <TTreeReaderValue.h>
 
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
 #include <string>
 #include <stdexcept>
 #include <iostream>
@@ -33,20 +43,42 @@ using dd4hep::Ref_t;
 DD4HEP_INSTANTIATE_HANDLE(FieldMapXYZ);
 
 namespace {
-  void checkBranch( int retCode ) {
+  template<typename T> void checkBranch( const TTreeReaderValue<T>& value ) {
 
-    if ( retCode != 0 ) {
+    if ( value.GetSetupStatus() < 0 ) {
       std::stringstream error;
       error << "FieldMap[ERROR]: Branch not correctly described ";
       throw std::runtime_error( error.str() );
     }
   }
+
+  /// Add the identity of the source of a field map, given by its cache header, to the configuration of a baked cache
+  void addSourceIdentity( std::ostream& config, const lcgeo::FieldMapCacheHeader& header ) {
+    config << ":" << header.mapType << ":" << header.storage << ":" << header.configChecksum
+           << ":" << header.sourceSize << ":" << header.sourceModified << ":" << header.sourceInode
+           << ":" << header.sourceChecksum << ":" << header.coorUnits << ":" << header.BfieldUnits;
+  }
 }
 
-FieldMapXYZ::FieldMapXYZ() {
+FieldMapXYZ::FieldMapXYZ() : storage(0), fieldMapPtr(nullptr), fieldMapSoAPtr(nullptr), sourceCoorUnits(0.0), sourceBfieldUnits(0.0), interpolation(1),
+                             splineCoefficientsPtr(nullptr), id(lcgeo::newFieldMapId()) {
   type = CartesianField::MAGNETIC;
 } //ctor
 
+FieldMapXYZ::~FieldMapXYZ() {
+  if(cellCacheCounters) {
+    //The other threads have flushed their lookups when they ended, the calling one may still have some
+    flushCellCache();
+    std::cout << "FieldMapXYZ: Last-cell cache hits " << cellCacheCounters->hits()
+              << " of " << cellCacheCounters->hits() + cellCacheCounters->misses() << " lookups, hit rate "
+              << cellCacheCounters->hitRate() << std::endl;
+  }
+}
+
+void FieldMapXYZ::flushCellCache() const {
+  if(cellCacheCounters) lcgeo::flushThreadCell<3,3>(id);
+}
+
 
 int FieldMapXYZ::getGlobalIndex(const int xBin, const int yBin, const int zBin)
 {
@@ -73,10 +105,10 @@ int FieldMapXYZ::getGlobalIndex(const int xBin, const int yBin, const int zBin)
 }
 
 /**
-    Use bileanar interpolation to calculate the field at the given position
-    This uses large pieces from Mokka FieldX03
+    Get the bins of the lower (bin0) and upper (bin1) corners of the cell containing the position and
+    the normalized coordinates (frac) of the position inside this cell, for the x, y and z axes
  */
-void FieldMapXYZ::fieldComponents(const double* pos , double* globalField) {
+bool FieldMapXYZ::getCell(const double* pos, int* bin0, int* bin1, double* frac, double* lower) const {
 
   //get position coordinates in our system
   const double x = pos[0];
@@ -88,7 +120,7 @@ void FieldMapXYZ::fieldComponents(const double* pos , double* globalField) {
             y >= yMin && y <= yMax &&
             z >= zMin && z <= zMax )
      ) {
-    return;
+    return false;
   }
 
   //Calculate the bins on the x, y and z axis containing the (x,y,z) point
@@ -116,63 +148,238 @@ void FieldMapXYZ::fieldComponents(const double* pos , double* globalField) {
   }
 
   //Get normalized coordinate of (x,y,z) point in bin
-  double xd = (x - x0)/xStep;
-  double yd = (y - y0)/yStep;
-  double zd = (z - z0)/zStep;
+  frac[0] = (x - x0)/xStep;
+  frac[1] = (y - y0)/yStep;
+  frac[2] = (z - z0)/zStep;
+
+  //Get the bins of the eight corners of bin containing the (x,y,z) point
+  bin0[0] = xBin;
+  bin0[1] = yBin;
+  bin0[2] = zBin;
+  bin1[0] = xBin+1;
+  bin1[1] = yBin+1;
+  bin1[2] = zBin+1;
+  //Protection in case the sampled coordinate is exactly at maximum value of fieldmap
+  if(bin1[0] > nX-1) bin1[0] = nX-1;
+  if(bin1[1] > nY-1) bin1[1] = nY-1;
+  if(bin1[2] > nZ-1) bin1[2] = nZ-1;
+
+  if(lower) {
+    lower[0] = x0;
+    lower[1] = y0;
+    lower[2] = z0;
+  }
+
+  return true;
+
+}
+
+void FieldMapXYZ::fieldComponents(const double* pos , double* globalField) {
+
+  double field[3] = {0.0, 0.0, 0.0};
+  if(cellCacheCounters) {
+    if(not interpolateCached(pos, field)) return;
+  } else {
+    int bin0[3], bin1[3];
+    double frac[3];
+    if(not getCell(pos, bin0, bin1, frac)) return;
+    interpolate(bin0, bin1, frac, field);
+  }
+
+  //The field map points can be shared with other field maps, the scale factor is applied here
+  globalField[0] += bScale*field[0];
+  globalField[1] += bScale*field[1];
+  globalField[2] += bScale*field[2];
+
+}
+
+/**
+    Evaluate the field at nPoints positions per call: the cells of a block of lcgeo::laneBlockSize points
+    are located first, then the whole block is interpolated together by interpolateBlock with one lane
+    per point, and the field is added for the points inside the map. Gives the same result as calling
+    fieldComponents for every point
+ */
+void FieldMapXYZ::fieldComponentsBatch(const double* pos, double* globalField, std::size_t nPoints) {
+
+  const double posMin[3]  = { xMin,  yMin,  zMin  };
+  const double posMax[3]  = { xMax,  yMax,  zMax  };
+  const double posStep[3] = { xStep, yStep, zStep };
+  const int    nBins[3]   = { nX,    nY,    nZ    };
+
+  const std::size_t blockSize = lcgeo::laneBlockSize;
+  int    bin0[blockSize][3], bin1[blockSize][3];
+  double frac[blockSize][3];
+  double field[blockSize][3];
+  bool   inside[blockSize];
+
+  for(std::size_t start=0;start<nPoints;start+=blockSize) {
+    const std::size_t n = std::min(blockSize, nPoints - start);
+    const double* blockPos = pos + 3*start;
+
+    //Locate the cells of all points in the block, same arithmetic as getCell
+    for(std::size_t i=0;i<n;i++) {
+      inside[i] = true;
+      for(int j=0;j<3;j++) {
+        const double p = blockPos[3*i + j];
+        inside[i] = inside[i] & (p >= posMin[j]) & (p <= posMax[j]);
+        //Clamp to the map so that the bin is valid also for points outside of the map (or NaN)
+        const double c  = p >= posMin[j] ? (p <= posMax[j] ? p : posMax[j]) : posMin[j];
+        int bin         = int((c - posMin[j])/posStep[j]);
+        double c0       = posMin[j] + bin*posStep[j];
+        const bool down = c0 > c;
+        bin            -= down;
+        c0             -= down ? posStep[j] : 0.0;
+        frac[i][j]      = (c - c0)/posStep[j];
+        bin0[i][j]      = bin;
+        bin1[i][j]      = std::min(bin+1, nBins[j]-1);
+      }
+    }
+    //Unused lanes of the last block interpolate the first cell of the map
+    for(std::size_t i=n;i<blockSize;i++) {
+      inside[i] = false;
+      for(int j=0;j<3;j++) {
+        frac[i][j] = 0.0;
+        bin0[i][j] = bin1[i][j] = 0;
+      }
+    }
+
+    for(std::size_t i=0;i<blockSize;i++) field[i][0] = field[i][1] = field[i][2] = 0.0;
+    interpolateBlock(bin0, bin1, frac, field);
+
+    for(std::size_t i=0;i<n;i++) {
+      if(not inside[i]) continue;
+      double* blockField = globalField + 3*(start + i);
+      blockField[0] += bScale*field[i][0];
+      blockField[1] += bScale*field[i][1];
+      blockField[2] += bScale*field[i][2];
+    }
+  }
+
+}
+
+/**
+    Add the field interpolated in the cells of a block of lcgeo::laneBlockSize points, with one lane per
+    point: the corner values are gathered per lane and the trilinear interpolation of interpolate is done
+    on lcgeo::LaneD, with the same operations so that the result agrees exactly. The packed float32 map
+    is interpolated by interpolateSoABlock, the tricubic interpolation point by point
+ */
+void FieldMapXYZ::interpolateBlock(const int (*bin0)[3], const int (*bin1)[3], const double (*frac)[3], double (*field)[3]) const {
+
+  const int n = lcgeo::laneBlockSize;
+  if(interpolation == 3) {
+    for(int i=0;i<n;i++) interpolateCubic(bin0[i], frac[i], field[i]);
+    return;
+  }
+
+  //Corner indices and fractions arranged by lane, corner index bit 0 (1, 2) set for the upper x (y, z) corner
+  const int nXY = nX*nY;
+  int    index[8][n];
+  double fracLanes[3][n];
+  for(int i=0;i<n;i++) {
+    for(int corner=0;corner<8;corner++) {
+      index[corner][i] = ( corner & 1 ? bin1[i][0] : bin0[i][0] ) +
+                         ( corner & 2 ? bin1[i][1] : bin0[i][1] )*nX +
+                         ( corner & 4 ? bin1[i][2] : bin0[i][2] )*nXY;
+    }
+    for(int j=0;j<3;j++) fracLanes[j][i] = frac[i][j];
+  }
+
+  if(storage == 1) {
+    interpolateSoABlock(index[0], fracLanes[0], field);
+    return;
+  }
+
+  //The components of a point are consecutive doubles in the array-of-structs map
+  for(int corner=0;corner<8;corner++) {
+    for(int i=0;i<n;i++) index[corner][i] *= 3;
+  }
+  const double* values = &fieldMapPtr[0].Bx;
+
+  using namespace lcgeo;
+  const LaneD one = laneSet(1.0);
+  for(int lane=0;lane<n;lane+=laneWidth) {
+    const LaneD xd = laneLoad(&fracLanes[0][lane]);
+    const LaneD yd = laneLoad(&fracLanes[1][lane]);
+    const LaneD zd = laneLoad(&fracLanes[2][lane]);
+    const LaneD xd1 = laneSub(one, xd);
+    const LaneD yd1 = laneSub(one, yd);
+    const LaneD zd1 = laneSub(one, zd);
+
+    for(int j=0;j<3;j++) {
+      LaneD c[8];
+      for(int corner=0;corner<8;corner++) c[corner] = laneGather(values + j, &index[corner][lane]);
+
+      const LaneD B_00 = laneMulAdd(xd, c[1], laneMul(xd1, c[0]));
+      const LaneD B_01 = laneMulAdd(xd, c[5], laneMul(xd1, c[4]));
+      const LaneD B_10 = laneMulAdd(xd, c[3], laneMul(xd1, c[2]));
+      const LaneD B_11 = laneMulAdd(xd, c[7], laneMul(xd1, c[6]));
+      const LaneD B_0  = laneMulAdd(yd, B_10, laneMul(yd1, B_00));
+      const LaneD B_1  = laneMulAdd(yd, B_11, laneMul(yd1, B_01));
+      const LaneD B    = laneMulAdd(zd, B_1,  laneMul(zd1, B_0));
+
+      double B_lanes[laneWidth];
+      laneStore(B_lanes, B);
+      for(int l=0;l<laneWidth;l++) field[lane + l][j] += B_lanes[l];
+    }
+  }
+
+}
+
+namespace {
+  /// Add the field interpolated trilinearly between the values at the eight corners of a cell,
+  /// corner index bit 0 (1, 2) set for the upper x (y, z) corner
+  inline void trilinear(const double (*corners)[3], const double* frac, double* globalField) {
+
+    const double xd = frac[0];
+    const double yd = frac[1];
+    const double zd = frac[2];
+
+    //field at (x,y,z) point is linear interpolation of fielmap values at bin corners,
+    //same operations as in FieldMapXYZ::interpolateBlock
+    double B_00,B_01,B_10,B_11,B_0,B_1,B;
+    for(int j=0;j<3;j++) {
+      B_00 = lcgeo::mulAdd(xd, corners[1][j], (1.0 - xd)*corners[0][j]);
+      B_01 = lcgeo::mulAdd(xd, corners[5][j], (1.0 - xd)*corners[4][j]);
+      B_10 = lcgeo::mulAdd(xd, corners[3][j], (1.0 - xd)*corners[2][j]);
+      B_11 = lcgeo::mulAdd(xd, corners[7][j], (1.0 - xd)*corners[6][j]);
+      B_0  = lcgeo::mulAdd(yd, B_10,          (1.0 - yd)*B_00);
+      B_1  = lcgeo::mulAdd(yd, B_11,          (1.0 - yd)*B_01);
+      B    = lcgeo::mulAdd(zd, B_1,           (1.0 - zd)*B_0);
+      globalField[j] += B;
+    }
+
+  }
+}
+
+/**
+    Use bileanar interpolation to calculate the field at the given position
+    This uses large pieces from Mokka FieldX03
+ */
+void FieldMapXYZ::interpolate(const int* bin0, const int* bin1, const double* frac, double* globalField) const {
+
+  if(interpolation == 3) {
+    interpolateCubic(bin0, frac, globalField);
+    return;
+  }
+  if(storage == 1) {
+    interpolateSoA(bin0, bin1, frac, globalField);
+    return;
+  }
 
   //Get the field values at the eight corners of bin containing the (x,y,z) point
-  int xBin0 = xBin;
-  int xBin1 = xBin+1;
-  int yBin0 = yBin;
-  int yBin1 = yBin+1;
-  int zBin0 = zBin;
-  int zBin1 = zBin+1;
-  //Protection in case the sampled coordinate is exactly at maximum value of fieldmap
-  if(xBin1 > nX-1) xBin1 = nX-1;
-  if(yBin1 > nY-1) yBin1 = nY-1;
-  if(zBin1 > nZ-1) zBin1 = nZ-1;
-  const FieldMapXYZ::FieldValues_t& B_x0y0z0 = fieldMap[xBin0 + yBin0*(nX) + zBin0*(nX*nY)];
-  const FieldMapXYZ::FieldValues_t& B_x1y0z0 = fieldMap[xBin1 + yBin0*(nX) + zBin0*(nX*nY)];
-  const FieldMapXYZ::FieldValues_t& B_x0y0z1 = fieldMap[xBin0 + yBin0*(nX) + zBin1*(nX*nY)];
-  const FieldMapXYZ::FieldValues_t& B_x1y0z1 = fieldMap[xBin1 + yBin0*(nX) + zBin1*(nX*nY)];
-  const FieldMapXYZ::FieldValues_t& B_x0y1z0 = fieldMap[xBin0 + yBin1*(nX) + zBin0*(nX*nY)];
-  const FieldMapXYZ::FieldValues_t& B_x1y1z0 = fieldMap[xBin1 + yBin1*(nX) + zBin0*(nX*nY)];
-  const FieldMapXYZ::FieldValues_t& B_x0y1z1 = fieldMap[xBin0 + yBin1*(nX) + zBin1*(nX*nY)];
-  const FieldMapXYZ::FieldValues_t& B_x1y1z1 = fieldMap[xBin1 + yBin1*(nX) + zBin1*(nX*nY)];
-
-  //field at (x,y,z) point is linear interpolation of fielmap values at bin corners
-  double B_00,B_01,B_10,B_11,B_0,B_1,B;
-
-  //X-component
-  B_00 = (1.0 - xd)*B_x0y0z0.Bx + xd*B_x1y0z0.Bx;
-  B_01 = (1.0 - xd)*B_x0y0z1.Bx + xd*B_x1y0z1.Bx;
-  B_10 = (1.0 - xd)*B_x0y1z0.Bx + xd*B_x1y1z0.Bx;
-  B_11 = (1.0 - xd)*B_x0y1z1.Bx + xd*B_x1y1z1.Bx;
-  B_0  = (1.0 - yd)*B_00        + yd*B_10;
-  B_1  = (1.0 - yd)*B_01        + yd*B_11;
-  B    = (1.0 - zd)*B_0         + zd*B_1;
-  globalField[0] += B;
-
-  //Y-component
-  B_00 = (1.0 - xd)*B_x0y0z0.By + xd*B_x1y0z0.By;
-  B_01 = (1.0 - xd)*B_x0y0z1.By + xd*B_x1y0z1.By;
-  B_10 = (1.0 - xd)*B_x0y1z0.By + xd*B_x1y1z0.By;
-  B_11 = (1.0 - xd)*B_x0y1z1.By + xd*B_x1y1z1.By;
-  B_0  = (1.0 - yd)*B_00        + yd*B_10;
-  B_1  = (1.0 - yd)*B_01        + yd*B_11;
-  B    = (1.0 - zd)*B_0         + zd*B_1;
-  globalField[1] += B;
-
-  //Z-component
-  B_00 = (1.0 - xd)*B_x0y0z0.Bz + xd*B_x1y0z0.Bz;
-  B_01 = (1.0 - xd)*B_x0y0z1.Bz + xd*B_x1y0z1.Bz;
-  B_10 = (1.0 - xd)*B_x0y1z0.Bz + xd*B_x1y1z0.Bz;
-  B_11 = (1.0 - xd)*B_x0y1z1.Bz + xd*B_x1y1z1.Bz;
-  B_0  = (1.0 - yd)*B_00        + yd*B_10;
-  B_1  = (1.0 - yd)*B_01        + yd*B_11;
-  B    = (1.0 - zd)*B_0         + zd*B_1;
-  globalField[2] += B;
-  
+  const int nXY = nX*nY;
+  double corners[8][3];
+  for(int corner=0;corner<8;corner++) {
+    const FieldMapXYZ::FieldValues_t& B = fieldMapPtr[ ( corner & 1 ? bin1[0] : bin0[0] ) +
+                                                       ( corner & 2 ? bin1[1] : bin0[1] )*nX +
+                                                       ( corner & 4 ? bin1[2] : bin0[2] )*nXY ];
+    corners[corner][0] = B.Bx;
+    corners[corner][1] = B.By;
+    corners[corner][2] = B.Bz;
+  }
+
+  trilinear(corners, frac, globalField);
+
   /* 
   std::cout << std::endl;
   std::cout << "FieldMapXYZ:: " << std::endl;
@@ -195,6 +402,519 @@ void FieldMapXYZ::fieldComponents(const double* pos , double* globalField) {
 
 }
 
+/**
+    Trilinear interpolation using the corner values of the last cell of the calling thread. The cell is
+    only refilled from the field map when the position leaves it, consecutive steps of a track mostly
+    stay inside of one cell
+ */
+bool FieldMapXYZ::interpolateCached(const double* pos, double* globalField) const {
+
+  lcgeo::FieldMapCell<3,3>& cell = lcgeo::threadCell<3,3>(id, cellCacheCounters);
+  const double step[3] = { xStep, yStep, zStep };
+  double frac[3];
+
+  const bool hit = cell.contains(pos);
+  cell.count(hit);
+  if(hit) {
+    for(int j=0;j<3;j++) frac[j] = (pos[j] - cell.lower[j])/step[j];
+  } else {
+    int bin0[3], bin1[3];
+    if(not getCell(pos, bin0, bin1, frac, cell.lower)) {
+      cell.lower[0] = 1.0;
+      cell.upper[0] = 0.0;
+      return false;
+    }
+    for(int j=0;j<3;j++) cell.upper[j] = ( bin1[j] > bin0[j] ? cell.lower[j] + step[j] : cell.lower[j] );
+
+    const int nXY = nX*nY;
+    for(int corner=0;corner<8;corner++) {
+      const FieldMapXYZ::FieldValues_t& B = fieldMapPtr[ ( corner & 1 ? bin1[0] : bin0[0] ) +
+                                                         ( corner & 2 ? bin1[1] : bin0[1] )*nX +
+                                                         ( corner & 4 ? bin1[2] : bin0[2] )*nXY ];
+      cell.corners[corner][0] = B.Bx;
+      cell.corners[corner][1] = B.By;
+      cell.corners[corner][2] = B.Bz;
+    }
+  }
+
+  trilinear(cell.corners, frac, globalField);
+  return true;
+
+}
+
+#if defined(__AVX2__)
+namespace {
+  /// Horizontal sum of the eight float lanes
+  inline float horizontalSum(__m256 v) {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x55));
+    return _mm_cvtss_f32(sum);
+  }
+}
+#elif defined(__SSE2__)
+namespace {
+  /// Horizontal sum of the four float lanes
+  inline float horizontalSum(__m128 v) {
+    __m128 sum = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x55));
+    return _mm_cvtss_f32(sum);
+  }
+}
+#endif
+
+/**
+    Trilinear interpolation on the packed float32 field map: the eight corner weights are computed once
+    and the three components are obtained as weighted sums over the eight corners, using AVX2 gathers,
+    SSE2 or plain scalar code depending on the instruction set the library is compiled for.
+    Agrees with the double array-of-structs kernel to float32 precision
+ */
+void FieldMapXYZ::interpolateSoA(const int* bin0, const int* bin1, const double* frac, double* globalField) const {
+
+  const float xd = frac[0];
+  const float yd = frac[1];
+  const float zd = frac[2];
+
+  const int nXY = nX*nY;
+  const int y0z0 = bin0[1]*nX + bin0[2]*nXY;
+  const int y1z0 = bin1[1]*nX + bin0[2]*nXY;
+  const int y0z1 = bin0[1]*nX + bin1[2]*nXY;
+  const int y1z1 = bin1[1]*nX + bin1[2]*nXY;
+
+  //Corner order: x0y0z0, x1y0z0, x0y1z0, x1y1z0, x0y0z1, x1y0z1, x0y1z1, x1y1z1
+  alignas(32) const int index[8] = { bin0[0] + y0z0, bin1[0] + y0z0, bin0[0] + y1z0, bin1[0] + y1z0,
+                                     bin0[0] + y0z1, bin1[0] + y0z1, bin0[0] + y1z1, bin1[0] + y1z1 };
+  const float wy0z0 = (1.0f - yd)*(1.0f - zd);
+  const float wy1z0 =         yd *(1.0f - zd);
+  const float wy0z1 = (1.0f - yd)*        zd;
+  const float wy1z1 =         yd *        zd;
+  alignas(32) const float weight[8] = { (1.0f - xd)*wy0z0, xd*wy0z0, (1.0f - xd)*wy1z0, xd*wy1z0,
+                                        (1.0f - xd)*wy0z1, xd*wy0z1, (1.0f - xd)*wy1z1, xd*wy1z1 };
+
+  const int nPoints = nXY*nZ;
+  const float* Bx = fieldMapSoAPtr;
+  const float* By = Bx + nPoints;
+  const float* Bz = By + nPoints;
+
+  float B[3];
+#if defined(__AVX2__)
+  const __m256i vIndex  = _mm256_load_si256(reinterpret_cast<const __m256i*>(index));
+  const __m256  vWeight = _mm256_load_ps(weight);
+  B[0] = horizontalSum(_mm256_mul_ps(vWeight, _mm256_i32gather_ps(Bx, vIndex, sizeof(float))));
+  B[1] = horizontalSum(_mm256_mul_ps(vWeight, _mm256_i32gather_ps(By, vIndex, sizeof(float))));
+  B[2] = horizontalSum(_mm256_mul_ps(vWeight, _mm256_i32gather_ps(Bz, vIndex, sizeof(float))));
+#elif defined(__SSE2__)
+  const __m128 vWeightLow  = _mm_load_ps(weight);
+  const __m128 vWeightHigh = _mm_load_ps(weight + 4);
+  const float* components[3] = { Bx, By, Bz };
+  for(int i=0;i<3;i++) {
+    const float* Bc = components[i];
+    const __m128 low  = _mm_set_ps(Bc[index[3]], Bc[index[2]], Bc[index[1]], Bc[index[0]]);
+    const __m128 high = _mm_set_ps(Bc[index[7]], Bc[index[6]], Bc[index[5]], Bc[index[4]]);
+    B[i] = horizontalSum(_mm_add_ps(_mm_mul_ps(vWeightLow, low), _mm_mul_ps(vWeightHigh, high)));
+  }
+#else
+  B[0] = B[1] = B[2] = 0.0f;
+  for(int i=0;i<8;i++) {
+    B[0] += weight[i]*Bx[index[i]];
+    B[1] += weight[i]*By[index[i]];
+    B[2] += weight[i]*Bz[index[i]];
+  }
+#endif
+
+  globalField[0] += B[0];
+  globalField[1] += B[1];
+  globalField[2] += B[2];
+
+  return;
+
+}
+
+/**
+    Trilinear interpolation of a block of lcgeo::laneBlockSize points on the packed float32 field map, with
+    one lane per point: index holds the eight corner indices and frac the three fractions, each for all
+    lanes. The corner weights and the sums over the corners are those of interpolateSoA, with eight lanes
+    and AVX2 gathers, twice four lanes with SSE2, or point by point
+ */
+void FieldMapXYZ::interpolateSoABlock(const int* index, const double* frac, double (*globalField)[3]) const {
+
+  const int n = lcgeo::laneBlockSize;
+  alignas(32) float fracLanes[3][n];
+  for(int j=0;j<3;j++) {
+    for(int i=0;i<n;i++) fracLanes[j][i] = frac[j*n + i];
+  }
+
+  const int nPoints = nX*nY*nZ;
+  const float* components[3] = { fieldMapSoAPtr, fieldMapSoAPtr + nPoints, fieldMapSoAPtr + 2*nPoints };
+
+  alignas(32) float B[3][n];
+#if defined(__AVX2__)
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 xd  = _mm256_load_ps(fracLanes[0]);
+  const __m256 yd  = _mm256_load_ps(fracLanes[1]);
+  const __m256 zd  = _mm256_load_ps(fracLanes[2]);
+  const __m256 xd1 = _mm256_sub_ps(one, xd);
+  const __m256 wy0z0 = _mm256_mul_ps(_mm256_sub_ps(one, yd), _mm256_sub_ps(one, zd));
+  const __m256 wy1z0 = _mm256_mul_ps(yd, _mm256_sub_ps(one, zd));
+  const __m256 wy0z1 = _mm256_mul_ps(_mm256_sub_ps(one, yd), zd);
+  const __m256 wy1z1 = _mm256_mul_ps(yd, zd);
+  const __m256 weight[8] = { _mm256_mul_ps(xd1, wy0z0), _mm256_mul_ps(xd, wy0z0), _mm256_mul_ps(xd1, wy1z0), _mm256_mul_ps(xd, wy1z0),
+                             _mm256_mul_ps(xd1, wy0z1), _mm256_mul_ps(xd, wy0z1), _mm256_mul_ps(xd1, wy1z1), _mm256_mul_ps(xd, wy1z1) };
+  for(int j=0;j<3;j++) {
+    __m256 p[8];
+    for(int corner=0;corner<8;corner++) {
+      const __m256i vIndex = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(index + corner*n));
+      p[corner] = _mm256_mul_ps(weight[corner], _mm256_i32gather_ps(components[j], vIndex, sizeof(float)));
+    }
+    //Same order of the additions as horizontalSum
+    const __m256 sum = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(p[0], p[4]), _mm256_add_ps(p[2], p[6])),
+                                     _mm256_add_ps(_mm256_add_ps(p[1], p[5]), _mm256_add_ps(p[3], p[7])));
+    _mm256_store_ps(B[j], sum);
+  }
+#elif defined(__SSE2__)
+  const __m128 one = _mm_set1_ps(1.0f);
+  for(int lane=0;lane<n;lane+=4) {
+    const __m128 xd  = _mm_load_ps(fracLanes[0] + lane);
+    const __m128 yd  = _mm_load_ps(fracLanes[1] + lane);
+    const __m128 zd  = _mm_load_ps(fracLanes[2] + lane);
+    const __m128 xd1 = _mm_sub_ps(one, xd);
+    const __m128 wy0z0 = _mm_mul_ps(_mm_sub_ps(one, yd), _mm_sub_ps(one, zd));
+    const __m128 wy1z0 = _mm_mul_ps(yd, _mm_sub_ps(one, zd));
+    const __m128 wy0z1 = _mm_mul_ps(_mm_sub_ps(one, yd), zd);
+    const __m128 wy1z1 = _mm_mul_ps(yd, zd);
+    const __m128 weight[8] = { _mm_mul_ps(xd1, wy0z0), _mm_mul_ps(xd, wy0z0), _mm_mul_ps(xd1, wy1z0), _mm_mul_ps(xd, wy1z0),
+                               _mm_mul_ps(xd1, wy0z1), _mm_mul_ps(xd, wy0z1), _mm_mul_ps(xd1, wy1z1), _mm_mul_ps(xd, wy1z1) };
+    for(int j=0;j<3;j++) {
+      const float* Bc = components[j];
+      __m128 p[8];
+      for(int corner=0;corner<8;corner++) {
+        const int* i = index + corner*n + lane;
+        p[corner] = _mm_mul_ps(weight[corner], _mm_set_ps(Bc[i[3]], Bc[i[2]], Bc[i[1]], Bc[i[0]]));
+      }
+      //Same order of the additions as horizontalSum
+      const __m128 sum = _mm_add_ps(_mm_add_ps(_mm_add_ps(p[0], p[4]), _mm_add_ps(p[2], p[6])),
+                                    _mm_add_ps(_mm_add_ps(p[1], p[5]), _mm_add_ps(p[3], p[7])));
+      _mm_store_ps(B[j] + lane, sum);
+    }
+  }
+#else
+  for(int i=0;i<n;i++) {
+    const float xd = fracLanes[0][i];
+    const float yd = fracLanes[1][i];
+    const float zd = fracLanes[2][i];
+    const float wy0z0 = (1.0f - yd)*(1.0f - zd);
+    const float wy1z0 =         yd *(1.0f - zd);
+    const float wy0z1 = (1.0f - yd)*        zd;
+    const float wy1z1 =         yd *        zd;
+    const float weight[8] = { (1.0f - xd)*wy0z0, xd*wy0z0, (1.0f - xd)*wy1z0, xd*wy1z0,
+                              (1.0f - xd)*wy0z1, xd*wy0z1, (1.0f - xd)*wy1z1, xd*wy1z1 };
+    for(int j=0;j<3;j++) {
+      B[j][i] = 0.0f;
+      for(int corner=0;corner<8;corner++) B[j][i] += weight[corner]*components[j][index[corner*n + i]];
+    }
+  }
+#endif
+
+  for(int i=0;i<n;i++) {
+    globalField[i][0] += B[0][i];
+    globalField[i][1] += B[1][i];
+    globalField[i][2] += B[2][i];
+  }
+
+}
+
+void FieldMapXYZ::fillFieldMapSoA() {
+
+  const std::size_t nPoints = std::size_t(nX)*nY*nZ;
+  fieldMapSoA.assign(3*nPoints, 0.0f);
+  for(std::size_t i=0;i<nPoints;i++) {
+    fieldMapSoA[i]             = fieldMapPtr[i].Bx;
+    fieldMapSoA[i +   nPoints] = fieldMapPtr[i].By;
+    fieldMapSoA[i + 2*nPoints] = fieldMapPtr[i].Bz;
+  }
+  fieldMapSoAPtr = fieldMapSoA.data();
+
+}
+
+/**
+    Tricubic interpolation with the cubic B-spline coefficients of the 4x4x4 nodes around the
+    cell, mirrored at the edges of the map
+ */
+void FieldMapXYZ::interpolateCubic(const int* bin0, const double* frac, double* globalField) const {
+
+  double wx[4], wy[4], wz[4];
+  lcgeo::splineWeights(frac[0], wx);
+  lcgeo::splineWeights(frac[1], wy);
+  lcgeo::splineWeights(frac[2], wz);
+
+  int ix[4], iy[4], iz[4];
+  for(int k=0;k<4;k++) {
+    ix[k] = lcgeo::splineMirrorIndex(bin0[0] - 1 + k, nX);
+    iy[k] = lcgeo::splineMirrorIndex(bin0[1] - 1 + k, nY)*nX;
+    iz[k] = lcgeo::splineMirrorIndex(bin0[2] - 1 + k, nZ)*nX*nY;
+  }
+
+  double B[3] = {0.0, 0.0, 0.0};
+  for(int kz=0;kz<4;kz++) {
+    for(int ky=0;ky<4;ky++) {
+      const FieldValues_t* line = splineCoefficientsPtr + iy[ky] + iz[kz];
+      double Bline[3] = {0.0, 0.0, 0.0};
+      for(int kx=0;kx<4;kx++) {
+        Bline[0] += wx[kx]*line[ix[kx]].Bx;
+        Bline[1] += wx[kx]*line[ix[kx]].By;
+        Bline[2] += wx[kx]*line[ix[kx]].Bz;
+      }
+      const double w = wy[ky]*wz[kz];
+      B[0] += w*Bline[0];
+      B[1] += w*Bline[1];
+      B[2] += w*Bline[2];
+    }
+  }
+
+  globalField[0] += B[0];
+  globalField[1] += B[1];
+  globalField[2] += B[2];
+
+}
+
+void FieldMapXYZ::fillSplineCoefficients() {
+
+  const std::size_t nPoints = std::size_t(nX)*nY*nZ;
+  splineCoefficients.assign(fieldMapPtr, fieldMapPtr + nPoints);
+
+  //The prefilter is separable: convert all lines along x, then along y, then along z, for every component
+  static_assert( sizeof(FieldValues_t) == 3*sizeof(double), "FieldValues_t must be three packed doubles" );
+  double* data = &splineCoefficients[0].Bx;
+  for(int c=0;c<3;c++) {
+    for(int iz=0;iz<nZ;iz++) {
+      for(int iy=0;iy<nY;iy++) lcgeo::splinePrefilter(data + 3*(iy*nX + iz*nX*nY) + c, nX, 3);
+      for(int ix=0;ix<nX;ix++) lcgeo::splinePrefilter(data + 3*(ix + iz*nX*nY) + c, nY, 3*nX);
+    }
+    for(int iy=0;iy<nY;iy++) {
+      for(int ix=0;ix<nX;ix++) lcgeo::splinePrefilter(data + 3*(ix + iy*nX) + c, nZ, 3*nX*nY);
+    }
+  }
+  splineCoefficientsPtr = splineCoefficients.data();
+
+}
+
+void FieldMapXYZ::useSharedGrid(const std::shared_ptr<const FieldMapXYZ>& grid) {
+
+  coorsOrder    = grid->coorsOrder;
+  strCoorsOrder = grid->strCoorsOrder;
+  nX = grid->nX;  xOrdering = grid->xOrdering;  xMin = grid->xMin;  xMax = grid->xMax;  xStep = grid->xStep;
+  nY = grid->nY;  yOrdering = grid->yOrdering;  yMin = grid->yMin;  yMax = grid->yMax;  yStep = grid->yStep;
+  nZ = grid->nZ;  zOrdering = grid->zOrdering;  zMin = grid->zMin;  zMax = grid->zMax;  zStep = grid->zStep;
+
+  storage               = grid->storage;
+  interpolation         = grid->interpolation;
+  fieldMapPtr           = grid->fieldMapPtr;
+  fieldMapSoAPtr        = grid->fieldMapSoAPtr;
+  splineCoefficientsPtr = grid->splineCoefficientsPtr;
+  sourceFile            = grid->sourceFile;
+  sourceCoorUnits       = grid->sourceCoorUnits;
+  sourceBfieldUnits     = grid->sourceBfieldUnits;
+  sharedGrid            = grid;
+
+}
+
+/**
+    Fill the field map with the sum of the given fields at the nodes of the grid, so that the field
+    is obtained with one lookup instead of one per field
+ */
+void FieldMapXYZ::fillFieldMapFromFields(const std::vector< dd4hep::CartesianField >& fields) {
+
+  fieldMap.assign(std::size_t(nX)*nY*nZ, FieldMapXYZ::FieldValues_t(0.0, 0.0, 0.0));
+  for(int iz=0;iz<nZ;iz++) {
+    for(int iy=0;iy<nY;iy++) {
+      for(int ix=0;ix<nX;ix++) {
+        const double pos[3] = { xMin + ix*xStep, yMin + iy*yStep, zMin + iz*zStep };
+        FieldMapXYZ::FieldValues_t& node = fieldMap[ix + iy*nX + iz*nX*nY];
+        for(const auto& field : fields) {
+          double B[3] = {0.0, 0.0, 0.0};
+          field.magneticField(pos, B);
+          node.Bx += B[0];
+          node.By += B[1];
+          node.Bz += B[2];
+        }
+      }
+    }
+  }
+
+  fieldMapPtr = fieldMap.data();
+
+}
+
+lcgeo::FieldMapCacheHeader FieldMapXYZ::bakedCacheHeader() const {
+
+  std::stringstream config;
+  config << std::setprecision(17) << "baked:" << storage;
+  for(const auto& field : bakedFields) config << ":" << field.name();
+  config << ":" << nX << ":" << xMin << ":" << xStep
+         << ":" << nY << ":" << yMin << ":" << yStep
+         << ":" << nZ << ":" << zMin << ":" << zStep;
+
+  //The baked fields can change without changing their names. Field maps read from a ROOT file are
+  //identified by the header of their own cache, with the size, modification time and inode of the
+  //file, and by their settings, baked field maps by their baked cache header. The sum of all other
+  //fields is probed at fixed points in the grid
+  std::vector< dd4hep::CartesianField > probed;
+  for(const auto& field : bakedFields) {
+    const FieldMapXYZ*  xyz  = dynamic_cast<const FieldMapXYZ*>(field.ptr());
+    const FieldMapBrBz* brbz = dynamic_cast<const FieldMapBrBz*>(field.ptr());
+    if(xyz and not xyz->sourceFile.empty()) {
+      addSourceIdentity(config, xyz->cacheHeader(xyz->sourceFile, xyz->sourceCoorUnits, xyz->sourceBfieldUnits));
+      config << ":" << xyz->bScale << ":" << xyz->xScale << ":" << xyz->yScale << ":" << xyz->zScale << ":" << xyz->interpolation;
+    } else if(xyz and not xyz->bakedFields.empty()) {
+      addSourceIdentity(config, xyz->bakedCacheHeader());
+      config << ":" << xyz->bScale << ":" << xyz->interpolation;
+    } else if(brbz and not brbz->sourceFile.empty()) {
+      addSourceIdentity(config, brbz->cacheHeader(brbz->sourceFile, brbz->sourceCoorUnits, brbz->sourceBfieldUnits));
+      config << ":" << brbz->bScale << ":" << brbz->rScale << ":" << brbz->zScale << ":" << brbz->interpolation;
+    } else {
+      probed.push_back(field);
+    }
+  }
+
+  std::mt19937 generator(12345);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  std::vector<double> probes;
+  for(int i=0;i<(probed.empty() ? 0 : 256);i++) {
+    const double pos[3] = { xMin + unit(generator)*(xMax - xMin),
+                            yMin + unit(generator)*(yMax - yMin),
+                            zMin + unit(generator)*(zMax - zMin) };
+    double sum[3] = {0.0, 0.0, 0.0};
+    for(const auto& field : probed) {
+      double B[3] = {0.0, 0.0, 0.0};
+      field.magneticField(pos, B);
+      for(int j=0;j<3;j++) sum[j] += B[j];
+    }
+    probes.insert(probes.end(), sum, sum + 3);
+  }
+
+  lcgeo::FieldMapCacheHeader header =
+    lcgeo::FieldMapCache::makeHeader(probes.data(), probes.size()*sizeof(double), config.str());
+  header.mapType     = 3;
+  header.storage     = storage;
+  header.coorUnits   = 1.0;
+  header.BfieldUnits = 1.0;
+  header.bScale      = 1.0;
+  return header;
+
+}
+
+double FieldMapXYZ::maxDeviationFromFields(int nPoints, double* worstPos) {
+
+  std::mt19937 generator(4242);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  double maxDeviation = 0.0;
+  for(int i=0;i<nPoints;i++) {
+    const double pos[3] = { xMin + unit(generator)*(xMax - xMin),
+                            yMin + unit(generator)*(yMax - yMin),
+                            zMin + unit(generator)*(zMax - zMin) };
+    double baked[3] = {0.0, 0.0, 0.0};
+    fieldComponents(pos, baked);
+    for(const auto& field : bakedFields) {
+      double B[3] = {0.0, 0.0, 0.0};
+      field.magneticField(pos, B);
+      for(int j=0;j<3;j++) baked[j] -= B[j];
+    }
+    const double deviation = std::sqrt(baked[0]*baked[0] + baked[1]*baked[1] + baked[2]*baked[2]);
+    if(deviation > maxDeviation) {
+      maxDeviation = deviation;
+      if(worstPos) std::copy(pos, pos + 3, worstPos);
+    }
+  }
+  return maxDeviation;
+
+}
+
+lcgeo::FieldMapCacheHeader FieldMapXYZ::cacheHeader(const std::string& filename,
+                                                    double coorUnits, double BfieldUnits) const {
+
+  std::stringstream config;
+  config << ntupleName << ":" << xVar << ":" << yVar << ":" << zVar << ":" << BxVar << ":" << ByVar << ":" << BzVar;
+
+  lcgeo::FieldMapCacheHeader header = lcgeo::FieldMapCache::makeHeader(filename, config.str());
+  header.mapType     = 2;
+  header.storage     = storage;
+  header.coorUnits   = coorUnits;
+  header.BfieldUnits = BfieldUnits;
+  header.bScale      = 1.0; //the points are stored without bScale, which is applied at lookup
+  return header;
+
+}
+
+bool FieldMapXYZ::fillFieldMapFromCache(const std::string& cacheFile, const std::string& filename,
+                                        double coorUnits, double BfieldUnits) {
+
+  if (not fillFieldMapFromCache(cacheFile, cacheHeader(filename, coorUnits, BfieldUnits))) return false;
+  sourceFile        = filename;
+  sourceCoorUnits   = coorUnits;
+  sourceBfieldUnits = BfieldUnits;
+  return true;
+
+}
+
+bool FieldMapXYZ::fillFieldMapFromCache(const std::string& cacheFile, const lcgeo::FieldMapCacheHeader& expected) {
+
+  std::shared_ptr<const lcgeo::FieldMapCache> mapped = lcgeo::FieldMapCache::open(cacheFile, expected);
+  if (not mapped) return false;
+
+  const lcgeo::FieldMapCacheHeader& header = mapped->header();
+  const std::size_t nPoints = std::size_t(header.nBins[0])*header.nBins[1]*header.nBins[2];
+  const std::size_t expectedSize = ( storage == 1 ? 3*nPoints*sizeof(float) : nPoints*sizeof(FieldValues_t) );
+  if (header.payloadSize != expectedSize) return false;
+
+  coorsOrder    = header.coorsOrder;
+  strCoorsOrder = std::string(header.strCoorsOrder, strnlen(header.strCoorsOrder, sizeof(header.strCoorsOrder)));
+  nX = header.nBins[0];  xOrdering = header.ordering[0];
+  nY = header.nBins[1];  yOrdering = header.ordering[1];
+  nZ = header.nBins[2];  zOrdering = header.ordering[2];
+  xMin = header.min[0];  xMax = header.max[0];  xStep = header.step[0];
+  yMin = header.min[1];  yMax = header.max[1];  yStep = header.step[1];
+  zMin = header.min[2];  zMax = header.max[2];  zStep = header.step[2];
+
+  //The interpolation reads the field values directly from the mapped file
+  std::vector< FieldValues_t >().swap(fieldMap);
+  std::vector< float >().swap(fieldMapSoA);
+  fieldMapPtr    = ( storage == 0 ? static_cast<const FieldValues_t*>(mapped->payload()) : nullptr );
+  fieldMapSoAPtr = ( storage == 1 ? static_cast<const float*>(mapped->payload()) : nullptr );
+  cache = mapped;
+
+  std::cout << "FieldMapXYZ: Field map mapped from cache file " << cacheFile << std::endl;
+  return true;
+
+}
+
+void FieldMapXYZ::writeFieldMapCache(const std::string& cacheFile, const std::string& filename,
+                                     double coorUnits, double BfieldUnits) const {
+
+  lcgeo::FieldMapCacheHeader header = cacheHeader(filename, coorUnits, BfieldUnits);
+  lcgeo::FieldMapCache::addSourceChecksum(header, filename);
+  writeFieldMapCache(cacheFile, header);
+
+}
+
+void FieldMapXYZ::writeFieldMapCache(const std::string& cacheFile, lcgeo::FieldMapCacheHeader header) const {
+
+  header.coorsOrder = coorsOrder;
+  strCoorsOrder.copy(header.strCoorsOrder, sizeof(header.strCoorsOrder) - 1);
+  header.nBins[0] = nX;  header.ordering[0] = xOrdering;
+  header.nBins[1] = nY;  header.ordering[1] = yOrdering;
+  header.nBins[2] = nZ;  header.ordering[2] = zOrdering;
+  header.min[0] = xMin;  header.max[0] = xMax;  header.step[0] = xStep;
+  header.min[1] = yMin;  header.max[1] = yMax;  header.step[1] = yStep;
+  header.min[2] = zMin;  header.max[2] = zMax;  header.step[2] = zStep;
+
+  const std::size_t nPoints = std::size_t(nX)*nY*nZ;
+  header.payloadSize = ( storage == 1 ? 3*nPoints*sizeof(float) : nPoints*sizeof(FieldValues_t) );
+  const void* payload = ( storage == 1 ? static_cast<const void*>(fieldMapSoAPtr) : static_cast<const void*>(fieldMapPtr) );
+
+  lcgeo::FieldMapCache::write(cacheFile, header, payload);
+
+}
+
 void FieldMapXYZ::fillFieldMapFromTree(const std::string& filename,
                                        double coorUnits, double BfieldUnits) {
 
@@ -205,6 +925,9 @@ void FieldMapXYZ::fillFieldMapFromTree(const std::string& filename,
     error << "FieldMapXYZ[ERROR]: File not found: " << filename;
     throw std::runtime_error( error.str() );
   }
+  sourceFile        = filename;
+  sourceCoorUnits   = coorUnits;
+  sourceBfieldUnits = BfieldUnits;
 
   std::cout << std::endl;
   std::cout << "Ntuple name: " << ntupleName << std::endl;
@@ -224,16 +947,7 @@ void FieldMapXYZ::fillFieldMapFromTree(const std::string& filename,
     throw std::runtime_error( error.str() );
   }
 
-  //Set branch adresses
-  float x, y, z, Bx, By, Bz;
-  checkBranch( tree->SetBranchAddress(xVar.c_str(), &x) );
-  checkBranch( tree->SetBranchAddress(yVar.c_str(), &y) );
-  checkBranch( tree->SetBranchAddress(zVar.c_str(), &z) );
-  checkBranch( tree->SetBranchAddress(BxVar.c_str(), &Bx) );
-  checkBranch( tree->SetBranchAddress(ByVar.c_str(), &By) );
-  checkBranch( tree->SetBranchAddress(BzVar.c_str(), &Bz) );
-
-  //Loop over the tree entries. In this loop get,
+  //Read the tree once, sequentially, into columns. While reading get,
   // - min, max and step-size values of fieldmap coordinates
   // - coordinates ordering
   xStep      = -1;
@@ -244,34 +958,64 @@ void FieldMapXYZ::fillFieldMapFromTree(const std::string& filename,
   zOrdering  =  1;
   strCoorsOrder = std::string("");
   const int treeEntries = tree->GetEntries();
-  fieldMap.reserve(treeEntries);
-  for(int i=0;i<treeEntries;i++) {
-    tree->GetEntry(i);
+  std::vector< float > xs, ys, zs, Bxs, Bys, Bzs;
+  xs.reserve(treeEntries);
+  ys.reserve(treeEntries);
+  zs.reserve(treeEntries);
+  Bxs.reserve(treeEntries);
+  Bys.reserve(treeEntries);
+  Bzs.reserve(treeEntries);
+  {
+    TTreeReader reader(tree);
+    TTreeReaderValue<float> x(reader, xVar.c_str());
+    TTreeReaderValue<float> y(reader, yVar.c_str());
+    TTreeReaderValue<float> z(reader, zVar.c_str());
+    TTreeReaderValue<float> Bx(reader, BxVar.c_str());
+    TTreeReaderValue<float> By(reader, ByVar.c_str());
+    TTreeReaderValue<float> Bz(reader, BzVar.c_str());
+
+    while(reader.Next()) {
+      xs.push_back(*x);
+      ys.push_back(*y);
+      zs.push_back(*z);
+      Bxs.push_back(*Bx);
+      Bys.push_back(*By);
+      Bzs.push_back(*Bz);
+
+      if(xs.size() == 1) {
+        xMin = xs.back();
+        yMin = ys.back();
+        zMin = zs.back();
+      }
 
-    if(i == 0) {
-      xMin = x;
-      yMin = y;
-      zMin = z;
-    }
-    if(i == treeEntries-1) {
-      xMax = x;
-      yMax = y;
-      zMax = z;
-    }
-    
-    if(x != xMin && xStep < 0.0) {
-      xStep       = TMath::Abs(xMin - x);
-      strCoorsOrder += std::string("X");
-    }
-    if(y != yMin && yStep < 0.0) {
-      yStep       = TMath::Abs(yMin - y);
-      strCoorsOrder += std::string("Y");
-    }
-    if(z != zMin && zStep < 0.0) {
-      zStep       = TMath::Abs(zMin - z);
-      strCoorsOrder += std::string("Z");
+      if(xs.back() != xMin && xStep < 0.0) {
+        xStep       = TMath::Abs(xMin - xs.back());
+        strCoorsOrder += std::string("X");
+      }
+      if(ys.back() != yMin && yStep < 0.0) {
+        yStep       = TMath::Abs(yMin - ys.back());
+        strCoorsOrder += std::string("Y");
+      }
+      if(zs.back() != zMin && zStep < 0.0) {
+        zStep       = TMath::Abs(zMin - zs.back());
+        strCoorsOrder += std::string("Z");
+      }
     }
+    checkBranch( x );
+    checkBranch( y );
+    checkBranch( z );
+    checkBranch( Bx );
+    checkBranch( By );
+    checkBranch( Bz );
   }
+  if ( xs.empty() || int(xs.size()) != treeEntries ) {
+    std::stringstream error;
+    error << "FieldMapXYZ[ERROR]: Could only read " << xs.size() << " of " << treeEntries << " tree entries";
+    throw std::runtime_error( error.str() );
+  }
+  xMax = xs.back();
+  yMax = ys.back();
+  zMax = zs.back();
 
   if(strCoorsOrder == TString("XYZ"))       coorsOrder = 1;
   else if(strCoorsOrder == TString("XZY"))  coorsOrder = 2;
@@ -342,21 +1086,84 @@ void FieldMapXYZ::fillFieldMapFromTree(const std::string& filename,
     throw std::runtime_error( error.str() );
   }
 
-  //Fill the array with the Bfield values in the XYZ order
-  for(int iz=0;iz<nZ;iz++) {
-    for(int iy=0;iy<nY;iy++) {
-      for(int ix=0;ix<nX;ix++) {
-        tree->GetEntry(getGlobalIndex(ix,iy,iz));
-        fieldMap.push_back( FieldMapXYZ::FieldValues_t(double(Bx)*bScale*BfieldUnits,
-                                                       double(By)*bScale*BfieldUnits,
-                                                       double(Bz)*bScale*BfieldUnits ) );
-      }
+  //Fill the array with the Bfield values in the XYZ order, placing every entry according to its coordinates
+  fieldMap.assign(elements, FieldMapXYZ::FieldValues_t(0.0, 0.0, 0.0));
+  std::vector< bool > filled(elements, false);
+  for(int i=0;i<treeEntries;i++) {
+    const long ix = std::lround((xs[i]*coorUnits - xMin)/xStep);
+    const long iy = std::lround((ys[i]*coorUnits - yMin)/yStep);
+    const long iz = std::lround((zs[i]*coorUnits - zMin)/zStep);
+    const long index = ix + iy*nX + iz*nX*nY;
+    if ( ix < 0 || ix >= nX || iy < 0 || iy >= nY || iz < 0 || iz >= nZ || filled[index] ) {
+      std::stringstream error;
+      error << "FieldMapXYZ[ERROR]: Tree entry " << i << " at (" << xs[i] << "," << ys[i] << "," << zs[i]
+            << ") is not on the regular grid of the field map";
+      throw std::runtime_error( error.str() );
     }
+    filled[index] = true;
+    fieldMap[index] = FieldMapXYZ::FieldValues_t(double(Bxs[i])*BfieldUnits,
+                                                 double(Bys[i])*BfieldUnits,
+                                                 double(Bzs[i])*BfieldUnits );
   }
 
   file->Close();
   delete file;
 
+  fieldMapPtr = fieldMap.data();
+
+}
+
+namespace {
+  /// Optional storage, interpolation and last-cell cache attributes of the FieldXYZ elements
+  struct GridSettings {
+    std::string strStorage;
+    std::string strInterpolation;
+    int  storage;
+    int  interpolation;
+    bool cellCache;
+
+    explicit GridSettings(const dd4hep::xml::Component& xmlParameter) {
+
+      //Optional storage layout of the grid: AoS (default, double precision) or SoA (packed float32)
+      strStorage = "AoS";
+      if(xmlParameter.hasAttr(_Unicode(storage))) strStorage = xmlParameter.attr< std::string >(_Unicode(storage));
+      storage = 0;
+      if(strStorage == "AoS")      storage = 0;
+      else if(strStorage == "SoA") storage = 1;
+      else {
+        std::stringstream error;
+        error << "FieldMapXYZ[ERROR]: Unknown storage " << strStorage << ", must be AoS or SoA";
+        throw std::runtime_error(error.str());
+      }
+
+      //Optional interpolation of the field map: linear (default) or cubic, using precomputed B-spline coefficients
+      strInterpolation = "linear";
+      if(xmlParameter.hasAttr(_Unicode(interpolation))) strInterpolation = xmlParameter.attr< std::string >(_Unicode(interpolation));
+      interpolation = 1;
+      if(strInterpolation == "linear")     interpolation = 1;
+      else if(strInterpolation == "cubic") interpolation = 3;
+      else {
+        std::stringstream error;
+        error << "FieldMapXYZ[ERROR]: Unknown interpolation " << strInterpolation << ", must be linear or cubic";
+        throw std::runtime_error(error.str());
+      }
+      if(interpolation == 3 && storage == 1) {
+        std::stringstream error;
+        error << "FieldMapXYZ[ERROR]: The cubic interpolation is only available with the AoS storage";
+        throw std::runtime_error(error.str());
+      }
+
+      //Optional per-thread cache of the last cell used in the interpolation
+      cellCache = false;
+      if(xmlParameter.hasAttr(_Unicode(cellCache))) cellCache = xmlParameter.attr< bool >(_Unicode(cellCache));
+      if(cellCache && (interpolation != 1 || storage != 0)) {
+        std::stringstream error;
+        error << "FieldMapXYZ[ERROR]: The last-cell cache is only available with the linear interpolation with the AoS storage";
+        throw std::runtime_error(error.str());
+      }
+
+    }
+  };
 }
 
 static Ref_t create_FieldMap_XYZ(Detector& ,
@@ -387,8 +1194,54 @@ static Ref_t create_FieldMap_XYZ(Detector& ,
   double coorUnits   = xmlParameter.attr< double >(_Unicode(coorUnits));
   double BfieldUnits = xmlParameter.attr< double >(_Unicode(BfieldUnits));
 
+  const GridSettings settings(xmlParameter);
+  const std::string& strStorage       = settings.strStorage;
+  const std::string& strInterpolation = settings.strInterpolation;
+  const int  storage       = settings.storage;
+  const int  interpolation = settings.interpolation;
+  const bool cellCache     = settings.cellCache;
+
+  //Optional binary cache of the field map, mapped read-only instead of reading the tree
+  std::string cacheFile;
+  if(xmlParameter.hasAttr(_Unicode(cacheFile))) cacheFile = xmlParameter.attr< std::string >(_Unicode(cacheFile));
+
+  //Field elements reading the same file with the same settings share one grid, the bScale is applied at lookup
+  std::stringstream key;
+  key << "FieldMapXYZ:" << filename << ":" << ntupleName << ":" << xVar << ":" << yVar << ":" << zVar
+      << ":" << BxVar << ":" << ByVar << ":" << BzVar << ":" << coorUnits << ":" << BfieldUnits
+      << ":" << strStorage << ":" << strInterpolation;
+  std::shared_ptr<const FieldMapXYZ> grid = lcgeo::FieldMapRegistry::get<FieldMapXYZ>(key.str(), [&]() {
+      std::shared_ptr<FieldMapXYZ> newGrid = std::make_shared<FieldMapXYZ>();
+      newGrid->storage       = storage;
+      newGrid->interpolation = interpolation;
+      newGrid->bScale        = 1.0;
+      newGrid->ntupleName    = ntupleName;
+      newGrid->xVar          = xVar;
+      newGrid->yVar          = yVar;
+      newGrid->zVar          = zVar;
+      newGrid->BxVar         = BxVar;
+      newGrid->ByVar         = ByVar;
+      newGrid->BzVar         = BzVar;
+
+      //Map the entries from the cache file if it is up to date, otherwise read them form the file in this place
+      if(cacheFile.empty() or not newGrid->fillFieldMapFromCache(cacheFile, filename, coorUnits, BfieldUnits)) {
+        newGrid->fillFieldMapFromTree(filename,coorUnits,BfieldUnits);
+        if(newGrid->storage == 1) {
+          //Only the packed copy is used for the interpolation, release the double precision one
+          newGrid->fillFieldMapSoA();
+          std::vector< FieldMapXYZ::FieldValues_t >().swap(newGrid->fieldMap);
+          newGrid->fieldMapPtr = nullptr;
+        }
+        if(not cacheFile.empty()) newGrid->writeFieldMapCache(cacheFile, filename, coorUnits, BfieldUnits);
+      }
+      if(newGrid->interpolation == 3) newGrid->fillSplineCoefficients();
+      return std::shared_ptr<const FieldMapXYZ>(newGrid);
+    });
+
   CartesianField obj;
   FieldMapXYZ* ptr = new FieldMapXYZ();
+  ptr->useSharedGrid(grid);
+  if(cellCache) ptr->cellCacheCounters = std::make_shared<lcgeo::FieldMapCellCounters>();
   ptr->xScale     = xScale;
   ptr->yScale     = yScale;
   ptr->zScale     = zScale;
@@ -401,9 +1254,6 @@ static Ref_t create_FieldMap_XYZ(Detector& ,
   ptr->ByVar      = ByVar;
   ptr->BzVar      = BzVar;
 
-  //Read the entries form the file in this place
-  ptr->fillFieldMapFromTree(filename,coorUnits,BfieldUnits);
-
   std::string strXOrdering("low-to-high");
   std::string strYOrdering("low-to-high");
   std::string strZOrdering("low-to-high");
@@ -431,6 +1281,9 @@ static Ref_t create_FieldMap_XYZ(Detector& ,
   std::cout << "nZ          " << std::setw(13) << ptr->nZ                               << std::endl;
   std::cout << "zOrdering   " << std::setw(13) << strZOrdering.c_str()                  << std::endl;
   std::cout << "CoorsOrder  " << std::setw(13) << ptr->strCoorsOrder.c_str()            << std::endl;
+  std::cout << "Storage     " << std::setw(13) << strStorage.c_str()                    << std::endl;
+  std::cout << "Interpolation " << std::setw(11) << strInterpolation.c_str()            << std::endl;
+  std::cout << "CellCache   " << std::setw(13) << ( cellCache ? "true" : "false" )   << std::endl;
   std::cout << "coorUnits   " << std::setw(13) << coorUnits/dd4hep::cm << " cm"         << std::endl;
   std::cout << "BfieldUnits " << std::setw(13) << BfieldUnits/dd4hep::tesla << " tesla" << std::endl;
 
@@ -451,3 +1304,111 @@ static Ref_t create_FieldMap_XYZ(Detector& ,
 }
 DECLARE_XMLELEMENT(FieldXYZ,create_FieldMap_XYZ)
 
+/**
+    Field element holding the sum of all magnetic field elements declared before it, e.g. a solenoid
+    map and the anti-DID overlay, baked into one x-y-z grid at geometry construction. The summed
+    elements are removed from the overlay, so stepping does one lookup instead of one per element.
+    There is no field outside of the grid, which must cover the region where the field is needed
+ */
+static Ref_t create_FieldMap_XYZBaked(Detector& description,
+                                      dd4hep::xml::Handle_t handle ) {
+  dd4hep::xml::Component xmlParameter(handle);
+
+  const double xMin  = xmlParameter.attr< double >(_Unicode(xMin));
+  const double xMax  = xmlParameter.attr< double >(_Unicode(xMax));
+  const double xStep = xmlParameter.attr< double >(_Unicode(xStep));
+  const double yMin  = xmlParameter.attr< double >(_Unicode(yMin));
+  const double yMax  = xmlParameter.attr< double >(_Unicode(yMax));
+  const double yStep = xmlParameter.attr< double >(_Unicode(yStep));
+  const double zMin  = xmlParameter.attr< double >(_Unicode(zMin));
+  const double zMax  = xmlParameter.attr< double >(_Unicode(zMax));
+  const double zStep = xmlParameter.attr< double >(_Unicode(zStep));
+  if (not (xMax > xMin && yMax > yMin && zMax > zMin && xStep > 0 && yStep > 0 && zStep > 0)) {
+    std::stringstream error;
+    error << "FieldMapXYZ[ERROR]: The grid of a baked field map needs min < max and step > 0 for x, y and z";
+    throw std::runtime_error(error.str());
+  }
+
+  const GridSettings settings(xmlParameter);
+
+  //Optional binary cache of the baked field map, mapped read-only instead of summing the fields again
+  std::string cacheFile;
+  if(xmlParameter.hasAttr(_Unicode(cacheFile))) cacheFile = xmlParameter.attr< std::string >(_Unicode(cacheFile));
+
+  //Optional number of random points at which the baked field is compared with the sum of the fields
+  int deviationPoints = 10000;
+  if(xmlParameter.hasAttr(_Unicode(deviationPoints))) deviationPoints = xmlParameter.attr< int >(_Unicode(deviationPoints));
+
+  dd4hep::OverlayedField::Object* overlay = description.field().data<dd4hep::OverlayedField::Object>();
+  if (not overlay or overlay->magnetic_components.empty()) {
+    std::stringstream error;
+    error << "FieldMapXYZ[ERROR]: A baked field map needs magnetic field elements declared before it";
+    throw std::runtime_error(error.str());
+  }
+
+  CartesianField obj;
+  FieldMapXYZ* ptr = new FieldMapXYZ();
+  ptr->storage       = settings.storage;
+  ptr->interpolation = settings.interpolation;
+  ptr->bScale        = 1.0;
+  ptr->xScale = ptr->yScale = ptr->zScale = 1.0;
+  ptr->coorsOrder    = 1;
+  ptr->strCoorsOrder = "XYZ";
+  ptr->nX = std::lround((xMax - xMin)/xStep) + 1;  ptr->xOrdering = 1;
+  ptr->nY = std::lround((yMax - yMin)/yStep) + 1;  ptr->yOrdering = 1;
+  ptr->nZ = std::lround((zMax - zMin)/zStep) + 1;  ptr->zOrdering = 1;
+  ptr->xMin = xMin;  ptr->xStep = xStep;  ptr->xMax = xMin + (ptr->nX - 1)*xStep;
+  ptr->yMin = yMin;  ptr->yStep = yStep;  ptr->yMax = yMin + (ptr->nY - 1)*yStep;
+  ptr->zMin = zMin;  ptr->zStep = zStep;  ptr->zMax = zMin + (ptr->nZ - 1)*zStep;
+  ptr->bakedFields   = overlay->magnetic_components;
+
+  //Map the baked points from the cache file if it is up to date, otherwise sum the fields at the nodes
+  const lcgeo::FieldMapCacheHeader header = ptr->bakedCacheHeader();
+  if(cacheFile.empty() or not ptr->fillFieldMapFromCache(cacheFile, header)) {
+    ptr->fillFieldMapFromFields(ptr->bakedFields);
+    if(ptr->storage == 1) {
+      ptr->fillFieldMapSoA();
+      std::vector< FieldMapXYZ::FieldValues_t >().swap(ptr->fieldMap);
+      ptr->fieldMapPtr = nullptr;
+    }
+    if(not cacheFile.empty()) ptr->writeFieldMapCache(cacheFile, header);
+  }
+  if(ptr->interpolation == 3) ptr->fillSplineCoefficients();
+  if(settings.cellCache) ptr->cellCacheCounters = std::make_shared<lcgeo::FieldMapCellCounters>();
+
+  //The baked elements are replaced by this one, which is added to the overlay when it is returned
+  overlay->magnetic_components.clear();
+  overlay->magnetic = CartesianField();
+
+  std::cout << "Baked fields" << std::endl;
+  for(const auto& field : ptr->bakedFields) std::cout << "            " << std::setw(13) << field.name() << std::endl;
+  std::cout << "xMin        " << std::setw(13) << ptr->xMin/dd4hep::cm << " cm"         << std::endl;
+  std::cout << "xMax        " << std::setw(13) << ptr->xMax/dd4hep::cm << " cm"         << std::endl;
+  std::cout << "xStep       " << std::setw(13) << ptr->xStep/dd4hep::cm << " cm"        << std::endl;
+  std::cout << "nX          " << std::setw(13) << ptr->nX                               << std::endl;
+  std::cout << "yMin        " << std::setw(13) << ptr->yMin/dd4hep::cm << " cm"         << std::endl;
+  std::cout << "yMax        " << std::setw(13) << ptr->yMax/dd4hep::cm << " cm"         << std::endl;
+  std::cout << "yStep       " << std::setw(13) << ptr->yStep/dd4hep::cm << " cm"        << std::endl;
+  std::cout << "nY          " << std::setw(13) << ptr->nY                               << std::endl;
+  std::cout << "zMin        " << std::setw(13) << ptr->zMin/dd4hep::cm << " cm"         << std::endl;
+  std::cout << "zMax        " << std::setw(13) << ptr->zMax/dd4hep::cm << " cm"         << std::endl;
+  std::cout << "zStep       " << std::setw(13) << ptr->zStep/dd4hep::cm << " cm"        << std::endl;
+  std::cout << "nZ          " << std::setw(13) << ptr->nZ                               << std::endl;
+  std::cout << "Storage     " << std::setw(13) << settings.strStorage.c_str()           << std::endl;
+  std::cout << "Interpolation " << std::setw(11) << settings.strInterpolation.c_str()   << std::endl;
+  std::cout << "CellCache   " << std::setw(13) << ( settings.cellCache ? "true" : "false" ) << std::endl;
+  if(deviationPoints > 0) {
+    double worstPos[3] = {0.0, 0.0, 0.0};
+    const double maxDeviation = ptr->maxDeviationFromFields(deviationPoints, worstPos);
+    std::cout << "MaxDeviation" << std::setw(13) << maxDeviation/dd4hep::tesla << " tesla at ("
+              << worstPos[0]/dd4hep::cm << "," << worstPos[1]/dd4hep::cm << "," << worstPos[2]/dd4hep::cm << ") cm"
+              << " in " << deviationPoints << " random points" << std::endl;
+  }
+
+  obj.assign(ptr, xmlParameter.nameStr(), xmlParameter.typeStr());
+
+  return obj;
+
+}
+DECLARE_XMLELEMENT(FieldXYZBaked,create_FieldMap_XYZBaked)
+
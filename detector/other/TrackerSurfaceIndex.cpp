@@ -0,0 +1,312 @@
+#include "TrackerSurfaceIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <utility>
+
+namespace {
+
+  /// Maximum number of surfaces in a leaf of the hierarchy
+  const int maxLeafSize = 4;
+
+  /// Iterations to find the crossing point on curved surfaces
+  const int maxCrossingIterations = 20;
+
+  double coordinate( const dd4hep::rec::Vector3D& v, int axis ) {
+    return ( axis == 0 ? v.x() : ( axis == 1 ? v.y() : v.z() ) );
+  }
+
+}
+
+namespace lcgeo {
+
+  TrackerSurfaceIndex::TrackerSurfaceIndex( const std::list<Surface*>& surfaces, double tolerance ) :
+    m_tolerance( tolerance ) {
+
+    m_entries.reserve( surfaces.size() );
+    for( Surface* surface : surfaces ) {
+      Entry entry;
+      entry.surface = surface;
+      const std::vector<std::pair<Vector3D, Vector3D> > lines = surface->getLines();
+      if( lines.empty() ) {
+        //Surfaces without outline get a box containing every point, so that only their surface distance counts
+        for( int axis=0;axis<3;axis++ ) {
+          entry.box.min[axis] = -std::numeric_limits<double>::max();
+          entry.box.max[axis] = std::numeric_limits<double>::max();
+        }
+        m_unbounded.push_back( entry );
+        continue;
+      }
+      for( int axis=0;axis<3;axis++ ) {
+        entry.box.min[axis] = std::numeric_limits<double>::max();
+        entry.box.max[axis] = -std::numeric_limits<double>::max();
+      }
+      for( const auto& line : lines ) {
+        for( int axis=0;axis<3;axis++ ) {
+          entry.box.min[axis] = std::min( { entry.box.min[axis], coordinate( line.first, axis ), coordinate( line.second, axis ) } );
+          entry.box.max[axis] = std::max( { entry.box.max[axis], coordinate( line.first, axis ), coordinate( line.second, axis ) } );
+        }
+      }
+      //The outline of curved surfaces is a polygon inside of the surface, the margin covers its sagitta
+      double maxExtent = 0.0;
+      for( int axis=0;axis<3;axis++ ) maxExtent = std::max( maxExtent, entry.box.max[axis] - entry.box.min[axis] );
+      const double margin = m_tolerance + 0.01*maxExtent;
+      for( int axis=0;axis<3;axis++ ) {
+        entry.box.min[axis] -= margin;
+        entry.box.max[axis] += margin;
+      }
+      m_entries.push_back( entry );
+    }
+
+    if( m_entries.empty() ) return;
+    m_nodes.reserve( 2*m_entries.size()/maxLeafSize + 1 );
+    m_nodes.resize( 1 );
+    build( 0, 0, m_entries.size() );
+  }
+
+
+  void TrackerSurfaceIndex::build( int node, int first, int last ) {
+    Box box = m_entries[first].box;
+    for( int i=first+1;i<last;i++ ) {
+      for( int axis=0;axis<3;axis++ ) {
+        box.min[axis] = std::min( box.min[axis], m_entries[i].box.min[axis] );
+        box.max[axis] = std::max( box.max[axis], m_entries[i].box.max[axis] );
+      }
+    }
+    m_nodes[node].box = box;
+    m_nodes[node].left = -1;
+    m_nodes[node].first = first;
+    m_nodes[node].count = last - first;
+    if( last - first <= maxLeafSize ) return;
+
+    //Split at the median of the box centres along the longest axis
+    int splitAxis = 0;
+    for( int axis=1;axis<3;axis++ ) {
+      if( box.max[axis] - box.min[axis] > box.max[splitAxis] - box.min[splitAxis] ) splitAxis = axis;
+    }
+    const int middle = first + ( last - first )/2;
+    std::nth_element( m_entries.begin() + first, m_entries.begin() + middle, m_entries.begin() + last,
+                      [splitAxis]( const Entry& a, const Entry& b ) {
+                        return a.box.min[splitAxis] + a.box.max[splitAxis] < b.box.min[splitAxis] + b.box.max[splitAxis];
+                      } );
+
+    const int left = m_nodes.size();
+    m_nodes.resize( left + 2 );
+    m_nodes[node].left = left;
+    m_nodes[node].count = 0;
+    build( left, first, middle );
+    build( left + 1, middle, last );
+  }
+
+
+  void TrackerSurfaceIndex::crossing( const Entry& entry, const Vector3D& start, const Vector3D& end, std::vector<Crossing>& crossings ) const {
+    const Surface* surface = entry.surface;
+    const double dStart = surface->distance( start ), dEnd = surface->distance( end );
+    if( dStart*dEnd <= 0.0 ) {
+      const double t = refine( surface, start, end, 0.0, dStart, 1.0, dEnd );
+      if( t >= 0.0 ) crossings.emplace_back( t, surface );
+      return;
+    }
+    if( surface->type().isPlane() ) return;
+
+    //Both ends on the same side of a cylinder or cone: the distance is convex (concave) along the segment,
+    //so it enters and leaves the surface if the distance changes its sign around its extremum. The
+    //extremum is searched by golden section until a point on the other side is found
+    const double sign = ( dStart > 0.0 ? 1.0 : -1.0 );
+    const double length = std::sqrt( ( end.x() - start.x() )*( end.x() - start.x() ) + ( end.y() - start.y() )*( end.y() - start.y() )
+                                     + ( end.z() - start.z() )*( end.z() - start.z() ) );
+    const double ratio = 0.5*( std::sqrt( 5.0 ) - 1.0 );
+    double a = 0.0, b = 1.0;
+    double t1 = b - ratio*( b - a ), t2 = a + ratio*( b - a );
+    double d1 = sign*surface->distance( start + t1*( end - start ) ), d2 = sign*surface->distance( start + t2*( end - start ) );
+    while( d1 > 0.0 && d2 > 0.0 && ( b - a )*length > m_tolerance ) {
+      if( d1 < d2 ) {
+        b = t2;
+        t2 = t1;
+        d2 = d1;
+        t1 = b - ratio*( b - a );
+        d1 = sign*surface->distance( start + t1*( end - start ) );
+      } else {
+        a = t1;
+        t1 = t2;
+        d1 = d2;
+        t2 = a + ratio*( b - a );
+        d2 = sign*surface->distance( start + t2*( end - start ) );
+      }
+    }
+    if( d1 > 0.0 && d2 > 0.0 ) return;
+
+    const double tSplit = ( d1 <= d2 ? t1 : t2 );
+    const double dSplit = sign*std::min( d1, d2 );
+    const double tIn = refine( surface, start, end, 0.0, dStart, tSplit, dSplit );
+    if( tIn >= 0.0 ) crossings.emplace_back( tIn, surface );
+    const double tOut = refine( surface, start, end, tSplit, dSplit, 1.0, dEnd );
+    if( tOut >= 0.0 ) crossings.emplace_back( tOut, surface );
+  }
+
+
+  double TrackerSurfaceIndex::refine( const Surface* surface, const Vector3D& start, const Vector3D& end,
+                                      double tLow, double dLow, double tHigh, double dHigh ) const {
+    if( dLow == dHigh ) return -1.0;
+
+    //Exact for planes, the crossing of curved surfaces is refined by regula falsi
+    double t = tLow + ( tHigh - tLow )*dLow/( dLow - dHigh );
+    Vector3D point = start + t*( end - start );
+    for( int i=0;i<maxCrossingIterations;i++ ) {
+      const double d = surface->distance( point );
+      if( std::fabs( d ) < m_tolerance ) break;
+      if( ( d > 0.0 ) == ( dLow > 0.0 ) ) {
+        tLow = t;
+        dLow = d;
+      } else {
+        tHigh = t;
+        dHigh = d;
+      }
+      t = tLow + ( tHigh - tLow )*dLow/( dLow - dHigh );
+      point = start + t*( end - start );
+    }
+    return ( surface->insideBounds( point, m_tolerance ) ? t : -1.0 );
+  }
+
+
+  double TrackerSurfaceIndex::distance( const Entry& entry, const Vector3D& point ) const {
+    return std::max( std::fabs( entry.surface->distance( point ) ), boxDistance( entry.box, point ) );
+  }
+
+
+  bool TrackerSurfaceIndex::overlaps( const Box& box, const Vector3D& start, const Vector3D& end ) {
+    double t0 = 0.0, t1 = 1.0;
+    for( int axis=0;axis<3;axis++ ) {
+      const double s = coordinate( start, axis );
+      const double d = coordinate( end, axis ) - s;
+      if( d == 0.0 ) {
+        if( s < box.min[axis] || s > box.max[axis] ) return false;
+        continue;
+      }
+      double ta = ( box.min[axis] - s )/d;
+      double tb = ( box.max[axis] - s )/d;
+      if( ta > tb ) std::swap( ta, tb );
+      t0 = std::max( t0, ta );
+      t1 = std::min( t1, tb );
+      if( t0 > t1 ) return false;
+    }
+    return true;
+  }
+
+
+  double TrackerSurfaceIndex::boxDistance( const Box& box, const Vector3D& point ) {
+    double d2 = 0.0;
+    for( int axis=0;axis<3;axis++ ) {
+      const double c = coordinate( point, axis );
+      const double d = ( c < box.min[axis] ? box.min[axis] - c : ( c > box.max[axis] ? c - box.max[axis] : 0.0 ) );
+      d2 += d*d;
+    }
+    return std::sqrt( d2 );
+  }
+
+
+  void TrackerSurfaceIndex::crossed( const Vector3D& start, const Vector3D& end, std::vector<const Surface*>& result ) const {
+    std::vector<Crossing> crossings;
+    for( const Entry& entry : m_unbounded ) crossing( entry, start, end, crossings );
+    if( not m_nodes.empty() ) {
+      int stack[64];
+      int nStack = 0;
+      stack[nStack++] = 0;
+      while( nStack > 0 ) {
+        const Node& node = m_nodes[stack[--nStack]];
+        if( not overlaps( node.box, start, end ) ) continue;
+        if( node.left < 0 ) {
+          for( int i=node.first;i<node.first+node.count;i++ ) {
+            if( overlaps( m_entries[i].box, start, end ) ) crossing( m_entries[i], start, end, crossings );
+          }
+        } else {
+          stack[nStack++] = node.left;
+          stack[nStack++] = node.left + 1;
+        }
+      }
+    }
+    std::sort( crossings.begin(), crossings.end(),
+               []( const Crossing& a, const Crossing& b ) { return a.first < b.first; } );
+    for( const auto& c : crossings ) result.push_back( c.second );
+  }
+
+
+  void TrackerSurfaceIndex::crossed( const std::vector<Vector3D>& points, std::vector<const Surface*>& result ) const {
+    for( std::size_t i=1;i<points.size();i++ ) {
+      //A surface through a point between two chords is crossed by both, it is reported once
+      const std::size_t before = result.size();
+      crossed( points[i-1], points[i], result );
+      if( before > 0 && result.size() > before && result[before] == result[before-1] ) result.erase( result.begin() + before );
+    }
+  }
+
+
+  const TrackerSurfaceIndex::Surface* TrackerSurfaceIndex::nearest( const Vector3D& point, double* distanceToSurface ) const {
+    const Surface* best = nullptr;
+    double bestDistance = std::numeric_limits<double>::max();
+    for( const Entry& entry : m_unbounded ) {
+      const double d = distance( entry, point );
+      if( d < bestDistance ) {
+        bestDistance = d;
+        best = entry.surface;
+      }
+    }
+
+    //Nodes are visited by increasing distance of their box, which is a lower bound of the distance of their surfaces
+    typedef std::pair<double, int> Candidate;
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate> > candidates;
+    if( not m_nodes.empty() ) candidates.emplace( boxDistance( m_nodes[0].box, point ), 0 );
+    while( not candidates.empty() && candidates.top().first < bestDistance ) {
+      const Node& node = m_nodes[candidates.top().second];
+      candidates.pop();
+      if( node.left < 0 ) {
+        for( int i=node.first;i<node.first+node.count;i++ ) {
+          const double d = distance( m_entries[i], point );
+          if( d < bestDistance ) {
+            bestDistance = d;
+            best = m_entries[i].surface;
+          }
+        }
+      } else {
+        for( int child=node.left;child<=node.left+1;child++ ) {
+          const double d = boxDistance( m_nodes[child].box, point );
+          if( d < bestDistance ) candidates.emplace( d, child );
+        }
+      }
+    }
+
+    if( distanceToSurface ) *distanceToSurface = bestDistance;
+    return best;
+  }
+
+
+  void TrackerSurfaceIndex::crossedLinear( const Vector3D& start, const Vector3D& end, std::vector<const Surface*>& result ) const {
+    std::vector<Crossing> crossings;
+    for( const std::vector<Entry>* entries : { &m_unbounded, &m_entries } ) {
+      for( const Entry& entry : *entries ) crossing( entry, start, end, crossings );
+    }
+    std::sort( crossings.begin(), crossings.end(),
+               []( const Crossing& a, const Crossing& b ) { return a.first < b.first; } );
+    for( const auto& c : crossings ) result.push_back( c.second );
+  }
+
+
+  const TrackerSurfaceIndex::Surface* TrackerSurfaceIndex::nearestLinear( const Vector3D& point, double* distanceToSurface ) const {
+    const Surface* best = nullptr;
+    double bestDistance = std::numeric_limits<double>::max();
+    for( const std::vector<Entry>* entries : { &m_unbounded, &m_entries } ) {
+      for( const Entry& entry : *entries ) {
+        const double d = distance( entry, point );
+        if( d < bestDistance ) {
+          bestDistance = d;
+          best = entry.surface;
+        }
+      }
+    }
+    if( distanceToSurface ) *distanceToSurface = bestDistance;
+    return best;
+  }
+
+}
@@ -12,6 +12,7 @@
 #include "DD4hep/Printout.h"
 #include "XML/Utilities.h"
 #include "DDRec/DetectorData.h"
+#include "NeighbourSurfacesIndex.h"
 
 #include <UTIL/BitField64.h>
 #include <UTIL/BitSet32.h>
@@ -301,6 +302,7 @@ static Ref_t create_detector(Detector& theDetector, xml_h e, SensitiveDetector s
     sdet.setAttributes(theDetector,envelope,x_det.regionStr(),x_det.limitsStr(),x_det.visStr());
     sdet.addExtension< ZPlanarData >( zPlanarData ) ;
     sdet.addExtension< NeighbourSurfacesData >( neighbourSurfacesData ) ;
+    lcgeo::addNeighbourSurfacesIndex( sdet, *neighbourSurfacesData ) ;
     
     //envelope.setVisAttributes(theDetector.invisible());
     /*pv = theDetector.pickMotherVolume(sdet).placeVolume(assembly);
@@ -15,12 +15,17 @@
 #include "XML/Utilities.h"
 #include "XML/DocumentHandler.h"
 #include "DDRec/DetectorData.h"
+#include "NeighbourSurfacesIndex.h"
+#include "NeighbourSurfacesProvider.h"
+#include "TrackerBarrelReplica.h"
 
 #include <UTIL/BitField64.h>
 #include <UTIL/BitSet32.h>
 #include "UTIL/LCTrackerConf.h"
 #include <UTIL/ILDConf.h>
 
+#include <tuple>
+
 using namespace std;
 
 using dd4hep::Assembly;
@@ -40,11 +45,15 @@ using dd4hep::Tube;
 using dd4hep::Volume;
 using dd4hep::_toString;
 using dd4hep::rec::NeighbourSurfacesData;
+using lcgeo::NeighbourSurfacesProviderData;
+using lcgeo::TrackerBarrelReplicaData;
 using dd4hep::rec::ZPlanarData;
 
 
 static Ref_t create_detector(Detector& theDetector, xml_h e, SensitiveDetector sens)  {
     typedef vector<PlacedVolume> Placements;
+    // width, length, thickness, material, region, limits, vis and sensitive flag of a module component
+    typedef std::tuple<double,double,double,string,string,string,string,bool> ComponentKey;
     xml_det_t   x_det     = e;
     Material    air       = theDetector.air();
     int         det_id    = x_det.id();
@@ -53,6 +62,7 @@ static Ref_t create_detector(Detector& theDetector, xml_h e, SensitiveDetector s
     // Assembly    assembly   (det_name);
     map<string, Volume>    volumes;
     map<string, Placements>  sensitives;
+    map<ComponentKey, Volume>  components;
     PlacedVolume pv;
     
 
@@ -74,6 +84,23 @@ static Ref_t create_detector(Detector& theDetector, xml_h e, SensitiveDetector s
     //-----------------------------------------------------------------------------------
     ZPlanarData*  zPlanarData = new ZPlanarData() ;
     NeighbourSurfacesData*  neighbourSurfacesData = new NeighbourSurfacesData() ;
+
+    // the neighbours are computed on query from the layer topology; with eagerNeighbours="false"
+    // the lists of NeighbourSurfacesData are not filled and not attached
+    bool eagerNeighbours = x_det.hasAttr(_Unicode(eagerNeighbours)) ? x_det.attr<bool>(_Unicode(eagerNeighbours)) : true ;
+    NeighbourSurfacesProviderData*  neighbourSurfacesProvider = new NeighbourSurfacesProviderData() ;
+    neighbourSurfacesProvider->setFields( encoder, lcio::LCTrackerCellID::side(), lcio::LCTrackerCellID::layer(),
+                                          lcio::LCTrackerCellID::module(), lcio::LCTrackerCellID::sensor() ) ;
+
+    // with replicaSensors="true" identical module components share their volume and no DetElements are created
+    // for the sensors and their components, the cellIDs are resolved with TrackerBarrelReplicaData or the
+    // VolumeManager; the constant TrackerBarrel_replicaSensors sets the default for all barrels of a model
+    bool replicaSensors = theDetector.constants().count("TrackerBarrel_replicaSensors") ?
+      theDetector.constant<int>("TrackerBarrel_replicaSensors") != 0 : false ;
+    if( x_det.hasAttr(_Unicode(replicaSensors)) ) replicaSensors = x_det.attr<bool>(_Unicode(replicaSensors)) ;
+    TrackerBarrelReplicaData*  trackerBarrelReplica = new TrackerBarrelReplicaData() ;
+    trackerBarrelReplica->setFields( encoder, lcio::LCTrackerCellID::layer(), lcio::LCTrackerCellID::module(),
+                                     lcio::LCTrackerCellID::sensor() ) ;
     
     sens.setType("tracker");
     
@@ -115,19 +142,27 @@ static Ref_t create_detector(Detector& theDetector, xml_h e, SensitiveDetector s
             xml_det_t incl_stack = includes;
             for (xml_coll_t ci(incl_stack, _U(module_component)); ci; ++ci, ++ncomponents) {
                 xml_comp_t x_comp = ci;
-                string c_nam = _toString(ncomponents, "component%d");
-                Box c_box(m_env.width() / 2.0, m_env.length() / 2.0, x_comp.thickness() / 2.0);
-                Volume c_vol(c_nam, c_box, theDetector.material(x_comp.materialStr()));
-
+                ComponentKey c_key(m_env.width(), m_env.length(), x_comp.thickness(), x_comp.materialStr(),
+                                   x_comp.regionStr(), x_comp.limitsStr(), x_comp.visStr(), x_comp.isSensitive());
+                Volume c_vol;
+                if (replicaSensors && components.find(c_key) != components.end()) {
+                    c_vol = components[c_key];
+                } else {
+                    string c_nam = _toString(ncomponents, "component%d");
+                    Box c_box(m_env.width() / 2.0, m_env.length() / 2.0, x_comp.thickness() / 2.0);
+                    c_vol = Volume(c_nam, c_box, theDetector.material(x_comp.materialStr()));
+
+                    c_vol.setRegion(theDetector, x_comp.regionStr());
+                    c_vol.setLimitSet(theDetector, x_comp.limitsStr());
+                    c_vol.setVisAttributes(theDetector, x_comp.visStr());
+                    if (x_comp.isSensitive()) c_vol.setSensitiveDetector(sens);
+                    if (replicaSensors) components[c_key] = c_vol;
+                }
 
                 pv = m_vol.placeVolume(c_vol, Position(0, 0, position_z + x_comp.thickness() / 2.0));
 
-                c_vol.setRegion(theDetector, x_comp.regionStr());
-                c_vol.setLimitSet(theDetector, x_comp.limitsStr());
-                c_vol.setVisAttributes(theDetector, x_comp.visStr());
                 if (x_comp.isSensitive()) {
                     //         pv.addPhysVolID("wafer",wafer_number++);
-                    c_vol.setSensitiveDetector(sens);
                     sensitives[m_nam].push_back(pv);
                 }
 
@@ -169,6 +204,20 @@ static Ref_t create_detector(Detector& theDetector, xml_h e, SensitiveDetector s
         
         
         ZPlanarData::LayerLayout thisLayer ;
+
+        NeighbourSurfacesProviderData::Layer layerTopology ;
+        layerTopology.nModules    = nphi ;
+        layerTopology.nSensors    = int(nz) ;
+        layerTopology.wrapModules = true ;
+        layerTopology.side        = lcio::ILDDetID::barrel ;
+        neighbourSurfacesProvider->setLayer( lay_id, layerTopology ) ;
+
+        TrackerBarrelReplicaData::Layer layerSensors ;
+        layerSensors.element   = lay_elt ;
+        layerSensors.nModules  = nphi ;
+        layerSensors.nSensors  = int(nz) ;
+        layerSensors.sensitive = waferVols ;
+        trackerBarrelReplica->setLayer( lay_id, layerSensors ) ;
         
        
         // Loop over the number of sensors in phi.
@@ -185,7 +234,6 @@ static Ref_t create_detector(Detector& theDetector, xml_h e, SensitiveDetector s
             int sensor_idx = 0;
             
             for (int j = 0; j < nz; j++)          {
-                string sensor_name = _toString(sensor_idx,"sensor%d");
 
 		///////////////////
 
@@ -206,6 +254,7 @@ static Ref_t create_detector(Detector& theDetector, xml_h e, SensitiveDetector s
 
 		int newmodule=0, newsensor=0;
 
+		if( eagerNeighbours )
 		for(int imodule=-n_neighbours_module; imodule<=n_neighbours_module; imodule++){ // neighbouring modules
 		  for(int isensor=-n_neighbours_sensor; isensor<=n_neighbours_sensor; isensor++){ // neighbouring sensors
 		    
@@ -234,9 +283,8 @@ static Ref_t create_detector(Detector& theDetector, xml_h e, SensitiveDetector s
 
                 
                 //FIXME
-                sensor_name = module_name + sensor_name;
-                
-                DetElement sens_elt(lay_elt,sensor_name,sensor_idx);
+                DetElement sens_elt;
+                if (!replicaSensors) sens_elt = DetElement(lay_elt,module_name + _toString(sensor_idx,"sensor%d"),sensor_idx);
                 // Module PhysicalVolume.
                 Transform3D tr(RotationZYX(0,((M_PI/2)-phic-phi_tilt),-M_PI/2),Position(x,y,sensor_z));
                 
@@ -244,12 +292,14 @@ static Ref_t create_detector(Detector& theDetector, xml_h e, SensitiveDetector s
                 pv = lay_vol.placeVolume(m_env,tr);
                 pv.addPhysVolID(_U(module), module_idx);
                 pv.addPhysVolID(_U(sensor), sensor_idx);
-                sens_elt.setPlacement(pv);
+                if (!replicaSensors) sens_elt.setPlacement(pv);
                 for(size_t ic=0; ic<waferVols.size(); ++ic)  {
 //                     std::cout<<"Layer: "<<lay_id<<" phiIdx: "<<ii<<" zidx: "<<j<<" wafer idx: "<<ic<<std::endl;
                     PlacedVolume wafer_pv = waferVols[ic];
-                    DetElement comp_elt(sens_elt,wafer_pv.volume().name(),sensor_idx);
-                    comp_elt.setPlacement(wafer_pv);
+                    if (!replicaSensors) {
+                      DetElement comp_elt(sens_elt,wafer_pv.volume().name(),sensor_idx);
+                      comp_elt.setPlacement(wafer_pv);
+                    }
                     
                     ///GET GEAR INFORMATION FROM FIRST "MODULE" IN Z AND phi
                     ///NOTE WORKS ONLY FOR ONE WAFER
@@ -257,7 +307,7 @@ static Ref_t create_detector(Detector& theDetector, xml_h e, SensitiveDetector s
                       
                       Box mod_shape(m_env.solid()), comp_shape(wafer_pv.volume().solid());
                       
-                      const double* trans = comp_elt.placement()->GetMatrix()->GetTranslation();
+                      const double* trans = wafer_pv->GetMatrix()->GetTranslation();
                       double half_module_thickness = mod_shape->GetDZ();
                       double half_silicon_thickness = comp_shape->GetDZ();
                       
@@ -314,7 +364,14 @@ static Ref_t create_detector(Detector& theDetector, xml_h e, SensitiveDetector s
     }
     sdet.setAttributes(theDetector,envelope,x_det.regionStr(),x_det.limitsStr(),x_det.visStr());
     sdet.addExtension< ZPlanarData >( zPlanarData ) ;
-    sdet.addExtension< NeighbourSurfacesData >( neighbourSurfacesData ) ;
+    if( eagerNeighbours ) {
+      sdet.addExtension< NeighbourSurfacesData >( neighbourSurfacesData ) ;
+      lcgeo::addNeighbourSurfacesIndex( sdet, *neighbourSurfacesData ) ;
+    } else {
+      delete neighbourSurfacesData ;
+    }
+    sdet.addExtension< NeighbourSurfacesProviderData >( neighbourSurfacesProvider ) ;
+    sdet.addExtension< TrackerBarrelReplicaData >( trackerBarrelReplica ) ;
     
     //envelope.setVisAttributes(theDetector.invisible());
     /*pv = theDetector.pickMotherVolume(sdet).placeVolume(assembly);
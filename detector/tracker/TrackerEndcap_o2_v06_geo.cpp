@@ -28,6 +28,7 @@
 #include "XML/DocumentHandler.h"
 #include <map>
 #include "DDRec/DetectorData.h"
+#include "NeighbourSurfacesIndex.h"
 
 #include <UTIL/BitField64.h>
 #include <UTIL/BitSet32.h>
@@ -319,6 +320,7 @@ static Ref_t create_detector(Detector& theDetector, xml_h e, SensitiveDetector s
 
     sdet.addExtension< ZDiskPetalsData >( zDiskPetalsData ) ;
     sdet.addExtension< NeighbourSurfacesData >( neighbourSurfacesData ) ;
+    lcgeo::addNeighbourSurfacesIndex( sdet, *neighbourSurfacesData ) ;
 
     
     return sdet;
@@ -18,6 +18,8 @@
 #include "XML/Utilities.h"
 #include "DD4hep/Printout.h"
 #include "DDRec/DetectorData.h"
+#include "NeighbourSurfacesIndex.h"
+#include "NeighbourSurfacesProvider.h"
 
 #include <UTIL/BitField64.h>
 #include <UTIL/BitSet32.h>
@@ -42,6 +44,7 @@ using dd4hep::Volume;
 using dd4hep::_toString;
 using dd4hep::rec::ZDiskPetalsData;
 using dd4hep::rec::NeighbourSurfacesData;
+using lcgeo::NeighbourSurfacesProviderData;
 
 static Ref_t create_detector(Detector& theDetector, xml_h e, SensitiveDetector sens)  {
     typedef vector<PlacedVolume> Placements;
@@ -80,6 +83,13 @@ static Ref_t create_detector(Detector& theDetector, xml_h e, SensitiveDetector s
     // -------- reconstruction parameters  ----------------
     ZDiskPetalsData*  zDiskPetalsData = new ZDiskPetalsData ;
     NeighbourSurfacesData*  neighbourSurfacesData = new NeighbourSurfacesData() ;
+
+    // the neighbours are computed on query from the layer topology; with eagerNeighbours="false"
+    // the lists of NeighbourSurfacesData are not filled and not attached
+    bool eagerNeighbours = x_det.hasAttr(_Unicode(eagerNeighbours)) ? x_det.attr<bool>(_Unicode(eagerNeighbours)) : true ;
+    NeighbourSurfacesProviderData*  neighbourSurfacesProvider = new NeighbourSurfacesProviderData() ;
+    neighbourSurfacesProvider->setFields( encoder, lcio::LCTrackerCellID::side(), lcio::LCTrackerCellID::layer(),
+                                          lcio::LCTrackerCellID::module(), lcio::LCTrackerCellID::sensor() ) ;
     std::map< std::string, double > moduleSensThickness;
 
     for(xml_coll_t mi(x_det,_U(module)); mi; ++mi, ++m_id)  {
@@ -176,6 +186,15 @@ static Ref_t create_detector(Detector& theDetector, xml_h e, SensitiveDetector s
             thisLayer.widthInnerSensitive =  0 ;
             thisLayer.widthOuterSensitive = 0 ;
             thisLayer.lengthSensitive   = 2*mod_shape->GetDZ();
+
+            // the sensors of the ring wrap around in phi, the side -1 disk is the reflection of the side +1 disk
+            NeighbourSurfacesProviderData::Layer layerTopology ;
+            layerTopology.nModules    = 1 ; // only 1 ring so always module 0
+            layerTopology.nSensors    = nmodules ;
+            layerTopology.wrapSensors = true ;
+            layerTopology.reflected   = reflect ;
+            layerTopology.side        = lcio::ILDDetID::fwd ;
+            neighbourSurfacesProvider->setLayer( l_id, layerTopology ) ;
             
             for(int k=0; k<nmodules; ++k) {
                 string m_base = _toString(l_id,"layer%d") + _toString(mod_num,"_module%d")+ _toString(k,"_sensor%d");;
@@ -234,6 +253,7 @@ static Ref_t create_detector(Detector& theDetector, xml_h e, SensitiveDetector s
 
 		int newsensor=0;
 
+		if( eagerNeighbours )
 		for(int isensor=-n_neighbours_sensor; isensor<=n_neighbours_sensor; isensor++){ // neighbouring sensors
 		    
 		  if (isensor==0) continue; // cellID we started with
@@ -245,6 +265,7 @@ static Ref_t create_detector(Detector& theDetector, xml_h e, SensitiveDetector s
 		  if (newsensor >= nmodules) newsensor = newsensor - nmodules;
 
 		  //encoding
+		  encoder[lcio::LCTrackerCellID::side()] = lcio::ILDDetID::fwd;
 		  encoder[lcio::LCTrackerCellID::module()] = 0;
 		  encoder[lcio::LCTrackerCellID::sensor()] = newsensor;
 
@@ -278,7 +299,13 @@ static Ref_t create_detector(Detector& theDetector, xml_h e, SensitiveDetector s
     
     //attach data to detector
     sdet.addExtension< ZDiskPetalsData >( zDiskPetalsData ) ;
-    sdet.addExtension< NeighbourSurfacesData >( neighbourSurfacesData ) ;
+    if( eagerNeighbours ) {
+      sdet.addExtension< NeighbourSurfacesData >( neighbourSurfacesData ) ;
+      lcgeo::addNeighbourSurfacesIndex( sdet, *neighbourSurfacesData ) ;
+    } else {
+      delete neighbourSurfacesData ;
+    }
+    sdet.addExtension< NeighbourSurfacesProviderData >( neighbourSurfacesProvider ) ;
 
     std::cout<<"XXX Vertex endcap layers: "<<zDiskPetalsData->layers.size()<<std::endl;
 
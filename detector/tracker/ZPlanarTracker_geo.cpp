@@ -13,6 +13,7 @@
 
 #include "DDRec/Surface.h"
 #include "DDRec/DetectorData.h"
+#include "NeighbourSurfacesIndex.h"
 #include <exception>
 
 #include <UTIL/BitField64.h>
@@ -320,6 +321,7 @@ static Ref_t create_element(Detector& theDetector, xml_h e, SensitiveDetector se
 
   tracker.addExtension< ZPlanarData >( zPlanarData ) ;
   tracker.addExtension< NeighbourSurfacesData >( neighbourSurfacesData ) ;
+  lcgeo::addNeighbourSurfacesIndex( tracker, *neighbourSurfacesData ) ;
 
 
   Volume mother =  theDetector.pickMotherVolume( tracker ) ;
@@ -0,0 +1,133 @@
+// Benchmark the cellID lookup of the calorimeter sensitive actions on synthetic showers: the linear
+// scan of Geant4HitCollection::find against the CaloHitIndex used by CaloPreShowerSDAction
+
+#include "CaloHitIndex.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock;
+
+  double elapsedMilliseconds( const Clock::time_point& start ) {
+    return std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+  }
+
+  /// The part of a calorimeter hit used in the sensitive action
+  struct Hit {
+    long long cellID = 0;
+    double energyDeposit = 0.0;
+    explicit Hit( long long id ) : cellID( id ) {}
+  };
+
+  /// Steps of a shower: cellIDs with layer, i and j of a cell, and deposits. The cells are drawn
+  /// from a longitudinal and lateral profile until nCells different cells are hit
+  void syntheticShower( int nCells, int seed, std::vector<long long>& cells, std::vector<double>& deposits ) {
+    std::mt19937 generator( seed );
+    std::gamma_distribution<double> longitudinal( 4.0, 2.5 );
+    std::normal_distribution<double> lateral( 0.0, 6.0 );
+    std::exponential_distribution<double> deposit( 10.0 );
+    std::vector<bool> seen( 1 << 24, false );
+    int nDifferent = 0;
+    while( nDifferent < nCells ) {
+      const long long layer = std::min( 29LL, (long long)longitudinal( generator ) );
+      const long long i = std::max( -127LL, std::min( 127LL, std::llround( lateral( generator ) ) ) ) + 128;
+      const long long j = std::max( -127LL, std::min( 127LL, std::llround( lateral( generator ) ) ) ) + 128;
+      const long long cell = ( layer << 16 ) | ( i << 8 ) | j;
+      if( not seen[cell] ) {
+        seen[cell] = true;
+        ++nDifferent;
+      }
+      cells.push_back( ( 1LL << 32 ) | cell );
+      deposits.push_back( deposit( generator ) );
+    }
+  }
+
+  /// Collect the deposits into hits, finding the hit of a cell with a linear scan like Geant4HitCollection::find
+  double fillLinear( const std::vector<long long>& cells, const std::vector<double>& deposits, std::vector<std::unique_ptr<Hit>>& hits ) {
+    const Clock::time_point start = Clock::now();
+    for( std::size_t s=0;s<cells.size();s++ ) {
+      Hit* hit = nullptr;
+      for( const auto& h : hits ) {
+        if( h->cellID == cells[s] ) { hit = h.get(); break; }
+      }
+      if( not hit ) {
+        hits.emplace_back( new Hit( cells[s] ) );
+        hit = hits.back().get();
+      }
+      hit->energyDeposit += deposits[s];
+    }
+    return elapsedMilliseconds( start );
+  }
+
+  /// Collect the deposits into hits, finding the hit of a cell with the index
+  double fillIndexed( const std::vector<long long>& cells, const std::vector<double>& deposits, std::vector<std::unique_ptr<Hit>>& hits,
+                      lcgeo::CaloHitIndex<Hit>& index ) {
+    const Clock::time_point start = Clock::now();
+    for( std::size_t s=0;s<cells.size();s++ ) {
+      Hit* hit = index.find( cells[s] );
+      if( not hit ) {
+        hits.emplace_back( new Hit( cells[s] ) );
+        hit = hits.back().get();
+        index.add( cells[s], hit );
+      }
+      hit->energyDeposit += deposits[s];
+    }
+    return elapsedMilliseconds( start );
+  }
+
+}
+
+
+int main (int argc, char **args) {
+
+  const int nCells  = ( argc > 1 ? atoi(args[1]) : 10000 );
+  const int nEvents = std::max( 1, ( argc > 2 ? atoi(args[2]) : 5 ) );
+
+  //The index is kept between the events and cleared at the end of each, like in the sensitive action
+  lcgeo::CaloHitIndex<Hit> index;
+  double linearTime = 0.0, indexedTime = 0.0;
+  std::size_t nSteps = 0;
+  int nMismatches = 0;
+  for( int event=0;event<nEvents;event++ ) {
+    std::vector<long long> cells;
+    std::vector<double> deposits;
+    syntheticShower( nCells, 1000 + event, cells, deposits );
+    nSteps += cells.size();
+
+    std::vector<std::unique_ptr<Hit>> linearHits, indexedHits;
+    linearTime  += fillLinear( cells, deposits, linearHits );
+    indexedTime += fillIndexed( cells, deposits, indexedHits, index );
+
+    //Both give the same hits, in the same order
+    if( linearHits.size() != indexedHits.size() || index.size() != indexedHits.size() ) ++nMismatches;
+    for( std::size_t i=0;i<std::min( linearHits.size(), indexedHits.size() );i++ ) {
+      if( linearHits[i]->cellID != indexedHits[i]->cellID || linearHits[i]->energyDeposit != indexedHits[i]->energyDeposit ) ++nMismatches;
+    }
+    index.clear();
+  }
+
+  std::cout << "Showers of " << nCells << " cells, " << nEvents << " events, " << nSteps/nEvents << " steps per event" << std::endl;
+  std::cout << std::setw(30) << std::left << "linear scan" << std::right
+            << std::setw(10) << std::fixed << std::setprecision(2) << linearTime/nEvents << " ms/event"
+            << std::setw(10) << 1e6*linearTime/nSteps << " ns/step" << std::endl;
+  std::cout << std::setw(30) << std::left << "cellID index" << std::right
+            << std::setw(10) << indexedTime/nEvents << " ms/event"
+            << std::setw(10) << 1e6*indexedTime/nSteps << " ns/step" << std::endl;
+
+  if( nMismatches > 0 ) {
+    std::cout << "ERROR: the indexed lookup gives different hits than the linear scan" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
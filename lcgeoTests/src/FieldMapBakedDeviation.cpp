@@ -0,0 +1,59 @@
+// Report the maximum deviation of the baked field maps (FieldXYZBaked, FieldXYZAdaptive) of a compact file from the sum of the fields baked into them
+
+#include "FieldMapAdaptive.h"
+#include "FieldMapXYZ.h"
+
+#include <DD4hep/DD4hepUnits.h>
+#include <DD4hep/Detector.h>
+#include <DD4hep/Fields.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main (int argc, char **args) {
+
+  if ( argc < 2 ){
+    std::cout << "Usage: FieldMapBakedDeviation <compact file name>.xml [random points per baked field map]\n";
+    exit(1);
+  }
+  const std::string compactFile = std::string(args[1]);
+  const int nPoints = ( argc > 2 ? atoi(args[2]) : 1000000 );
+
+  dd4hep::Detector& theDetector = dd4hep::Detector::getInstance();
+  theDetector.fromCompact( compactFile );
+
+  int nBaked = 0;
+  for( const auto& entry : theDetector.fields() ) {
+    dd4hep::CartesianField field = entry.second;
+    FieldMapXYZ* map = dynamic_cast<FieldMapXYZ*>( field.ptr() );
+    FieldMapAdaptive* adaptive = dynamic_cast<FieldMapAdaptive*>( field.ptr() );
+    double worstPos[3] = { 0.0, 0.0, 0.0 };
+    double maxDeviation = 0.0;
+    const std::vector<dd4hep::CartesianField>* bakedFields = nullptr;
+    if( map and not map->bakedFields.empty() ) {
+      maxDeviation = map->maxDeviationFromFields( nPoints, worstPos );
+      bakedFields = &map->bakedFields;
+    } else if( adaptive and not adaptive->bakedFields.empty() ) {
+      maxDeviation = adaptive->maxDeviationFromFields( nPoints, worstPos );
+      bakedFields = &adaptive->bakedFields;
+    } else {
+      continue;
+    }
+    ++nBaked;
+
+    std::cout << entry.first << ": sum of";
+    for( const auto& baked : *bakedFields ) std::cout << " " << baked.name();
+    std::cout << "\n  maximum deviation " << maxDeviation/dd4hep::tesla << " tesla at ("
+              << worstPos[0]/dd4hep::cm << "," << worstPos[1]/dd4hep::cm << "," << worstPos[2]/dd4hep::cm << ") cm"
+              << " in " << nPoints << " random points of the grid" << std::endl;
+  }
+
+  if( nBaked == 0 ) {
+    std::cout << "No baked field map (FieldXYZBaked, FieldXYZAdaptive) in " << compactFile << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
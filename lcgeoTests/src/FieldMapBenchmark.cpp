@@ -0,0 +1,297 @@
+// Benchmark the loading and the interpolation of the field maps shipped in lcgeo/fieldmaps
+
+#include "FieldMapBrBz.h"
+#include "FieldMapXYZ.h"
+
+#include <DD4hep/DD4hepUnits.h>
+
+#include <TFile.h>
+#include <TTree.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock;
+
+  double elapsedMilliseconds( const Clock::time_point& start ) {
+    return std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+  }
+
+  void printTiming( const std::string& name, const std::vector<double>& timings, int nPoints ) {
+    double sum = 0.0;
+    for( double t : timings ) sum += t;
+    std::cout << std::setw(60) << std::left << name << std::right
+              << "  points " << std::setw(8) << nPoints
+              << "  min " << std::setw(9) << std::fixed << std::setprecision(2) << *std::min_element( timings.begin(), timings.end() ) << " ms"
+              << "  mean " << std::setw(9) << sum/timings.size() << " ms" << std::endl;
+  }
+
+  /// Time the single-pass sequential reading of an ILD r-z map
+  void benchmarkBrBz( const std::string& filename, int nRepetitions ) {
+    std::vector<double> timings;
+    int nPoints = 0;
+    for(int i=0;i<nRepetitions;i++) {
+      FieldMapBrBz map;
+      map.bScale = 1.0;
+      map.ntupleName = "ntuple";
+      map.rhoVar = "rho_mm";
+      map.zVar = "z_mm";
+      map.BrhoVar = "Brho";
+      map.BzVar = "Bz";
+      const Clock::time_point start = Clock::now();
+      map.fillFieldMapFromTree( filename, dd4hep::mm, dd4hep::tesla );
+      timings.push_back( elapsedMilliseconds( start ) );
+      nPoints = map.nRho*map.nZ;
+    }
+    printTiming( "FieldMapBrBz " + filename.substr( filename.find_last_of( '/' ) + 1 ), timings, nPoints );
+  }
+
+  /// Time the single-pass sequential reading of an ILD x-y-z map, and for reference the random-access
+  /// reading of the tree in grid order used before
+  void benchmarkXYZ( const std::string& filename, int nRepetitions ) {
+    std::vector<double> timings, randomAccessTimings;
+    int nPoints = 0;
+    for(int i=0;i<nRepetitions;i++) {
+      FieldMapXYZ map;
+      map.bScale = 1.0;
+      map.ntupleName = "ntuple";
+      map.xVar = "x_mm";
+      map.yVar = "y_mm";
+      map.zVar = "z_mm";
+      map.BxVar = "Bx";
+      map.ByVar = "By";
+      map.BzVar = "Bz";
+      const Clock::time_point start = Clock::now();
+      map.fillFieldMapFromTree( filename, dd4hep::mm, dd4hep::tesla );
+      timings.push_back( elapsedMilliseconds( start ) );
+      nPoints = map.nX*map.nY*map.nZ;
+
+      const Clock::time_point randomStart = Clock::now();
+      TFile* file = TFile::Open( filename.c_str() );
+      TTree* tree = nullptr;
+      file->GetObject( map.ntupleName.c_str(), tree );
+      float Bx, By, Bz;
+      tree->SetBranchAddress( map.BxVar.c_str(), &Bx );
+      tree->SetBranchAddress( map.ByVar.c_str(), &By );
+      tree->SetBranchAddress( map.BzVar.c_str(), &Bz );
+      for(int iz=0;iz<map.nZ;iz++) {
+        for(int iy=0;iy<map.nY;iy++) {
+          for(int ix=0;ix<map.nX;ix++) {
+            tree->GetEntry( map.getGlobalIndex( ix, iy, iz ) );
+          }
+        }
+      }
+      file->Close();
+      delete file;
+      randomAccessTimings.push_back( elapsedMilliseconds( randomStart ) );
+    }
+    const std::string name = filename.substr( filename.find_last_of( '/' ) + 1 );
+    printTiming( "FieldMapXYZ " + name, timings, nPoints );
+    printTiming( "random-access tree reading " + name, randomAccessTimings, nPoints );
+  }
+
+
+  /// Minimum time in ms over the repetitions of evaluating the field at all positions
+  template<typename FieldMap> double timeEvaluation( FieldMap& map, const std::vector<double>& positions, int nRepetitions ) {
+    const int nPoints = positions.size()/3;
+    std::vector<double> field( 3*nPoints, 0.0 );
+    double minTime = -1.0;
+    for(int i=0;i<nRepetitions;i++) {
+      const Clock::time_point start = Clock::now();
+      for(int j=0;j<nPoints;j++) map.fieldComponents( &positions[3*j], &field[3*j] );
+      const double time = elapsedMilliseconds( start );
+      if( minTime < 0.0 || time < minTime ) minTime = time;
+    }
+    return minTime;
+  }
+
+  void printInterpolation( const std::string& name, double maxDeviation, double sumSquares, int nNodes, double time, int nPoints ) {
+    std::cout << std::setw(60) << std::left << name << std::right
+              << "  max deviation " << std::setw(9) << std::scientific << std::setprecision(2) << maxDeviation/dd4hep::tesla << " T"
+              << "  rms " << std::setw(9) << std::sqrt( sumSquares/nNodes )/dd4hep::tesla << " T"
+              << "  " << std::setw(7) << std::fixed << std::setprecision(1) << 1e6*time/nPoints << " ns/point" << std::endl;
+  }
+
+  /// Accuracy and speed of the linear and cubic interpolation of an ILD r-z map: the map is subsampled
+  /// by two and interpolated at the skipped nodes, where the true field is known
+  void benchmarkInterpolationBrBz( const std::string& filename, int nRepetitions ) {
+    FieldMapBrBz full;
+    full.bScale = 1.0;
+    full.ntupleName = "ntuple";
+    full.rhoVar = "rho_mm";
+    full.zVar = "z_mm";
+    full.BrhoVar = "Brho";
+    full.BzVar = "Bz";
+    full.fillFieldMapFromTree( filename, dd4hep::mm, dd4hep::tesla );
+
+    FieldMapBrBz coarse[2];
+    for( int mode=0;mode<2;mode++ ) {
+      FieldMapBrBz& map = coarse[mode];
+      map.bScale = 1.0;
+      map.nRho = ( full.nRho + 1 )/2;  map.rhoMin = full.rhoMin;  map.rhoStep = 2*full.rhoStep;
+      map.nZ   = ( full.nZ   + 1 )/2;  map.zMin   = full.zMin;    map.zStep   = 2*full.zStep;
+      map.rhoMax = map.rhoMin + ( map.nRho - 1 )*map.rhoStep;
+      map.zMax   = map.zMin   + ( map.nZ   - 1 )*map.zStep;
+      for(int iz=0;iz<map.nZ;iz++) {
+        for(int ir=0;ir<map.nRho;ir++) map.fieldMap.push_back( full.fieldMap[2*ir + 2*iz*full.nRho] );
+      }
+      map.fieldMapPtr = map.fieldMap.data();
+      if( mode == 1 ) {
+        map.interpolation = 3;
+        map.fillSplineCoefficients();
+      }
+    }
+
+    const std::string name = filename.substr( filename.find_last_of( '/' ) + 1 );
+    const char* modeNames[2] = { "linear", "cubic" };
+    for( int mode=0;mode<2;mode++ ) {
+      FieldMapBrBz& map = coarse[mode];
+
+      //Deviation at the skipped nodes inside the coarse map
+      double maxDeviation = 0.0, sumSquares = 0.0;
+      int nNodes = 0;
+      for(int iz=0;iz<full.nZ;iz++) {
+        for(int ir=0;ir<full.nRho;ir++) {
+          if( ( ir%2 == 0 && iz%2 == 0 ) || 2*(map.nRho-1) < ir || 2*(map.nZ-1) < iz ) continue;
+          //On the y axis the projection of Br is entirely along x
+          const double pos[3] = { 0.0, full.rhoMin + ir*full.rhoStep, full.zMin + iz*full.zStep };
+          double field[3] = { 0.0, 0.0, 0.0 };
+          map.fieldComponents( pos, field );
+          const FieldMapBrBz::FieldValues_t& node = full.fieldMap[ir + iz*full.nRho];
+          const double deviation = std::sqrt( ( field[0] - node.Br )*( field[0] - node.Br ) + ( field[2] - node.Bz )*( field[2] - node.Bz ) );
+          maxDeviation = std::max( maxDeviation, deviation );
+          sumSquares  += deviation*deviation;
+          ++nNodes;
+        }
+      }
+
+      //Time per evaluation at random positions inside the map
+      std::mt19937 generator( 42 );
+      std::uniform_real_distribution<double> xyDist( -map.rhoMax/std::sqrt(2.0), map.rhoMax/std::sqrt(2.0) );
+      std::uniform_real_distribution<double> zDist( -map.zMax, map.zMax );
+      const int nPoints = 1000000;
+      std::vector<double> positions;
+      for(int i=0;i<nPoints;i++) {
+        positions.push_back( xyDist( generator ) );
+        positions.push_back( xyDist( generator ) );
+        positions.push_back( zDist( generator ) );
+      }
+      const double time = timeEvaluation( map, positions, nRepetitions );
+
+      printInterpolation( "FieldMapBrBz " + std::string( modeNames[mode] ) + " " + name, maxDeviation, sumSquares, nNodes, time, nPoints );
+    }
+  }
+
+  /// Accuracy and speed of the trilinear and tricubic interpolation of an ILD x-y-z map: the map is
+  /// subsampled by two along every axis and interpolated at the skipped nodes, where the true field is known
+  void benchmarkInterpolationXYZ( const std::string& filename, int nRepetitions ) {
+    FieldMapXYZ full;
+    full.bScale = 1.0;
+    full.ntupleName = "ntuple";
+    full.xVar = "x_mm";
+    full.yVar = "y_mm";
+    full.zVar = "z_mm";
+    full.BxVar = "Bx";
+    full.ByVar = "By";
+    full.BzVar = "Bz";
+    full.fillFieldMapFromTree( filename, dd4hep::mm, dd4hep::tesla );
+    const int nXY = full.nX*full.nY;
+
+    FieldMapXYZ coarse[2];
+    for( int mode=0;mode<2;mode++ ) {
+      FieldMapXYZ& map = coarse[mode];
+      map.bScale = 1.0;
+      map.nX = ( full.nX + 1 )/2;  map.xMin = full.xMin;  map.xStep = 2*full.xStep;
+      map.nY = ( full.nY + 1 )/2;  map.yMin = full.yMin;  map.yStep = 2*full.yStep;
+      map.nZ = ( full.nZ + 1 )/2;  map.zMin = full.zMin;  map.zStep = 2*full.zStep;
+      map.xMax = map.xMin + ( map.nX - 1 )*map.xStep;
+      map.yMax = map.yMin + ( map.nY - 1 )*map.yStep;
+      map.zMax = map.zMin + ( map.nZ - 1 )*map.zStep;
+      for(int iz=0;iz<map.nZ;iz++) {
+        for(int iy=0;iy<map.nY;iy++) {
+          for(int ix=0;ix<map.nX;ix++) map.fieldMap.push_back( full.fieldMap[2*ix + 2*iy*full.nX + 2*iz*nXY] );
+        }
+      }
+      map.fieldMapPtr = map.fieldMap.data();
+      if( mode == 1 ) {
+        map.interpolation = 3;
+        map.fillSplineCoefficients();
+      }
+    }
+
+    const std::string name = filename.substr( filename.find_last_of( '/' ) + 1 );
+    const char* modeNames[2] = { "linear", "cubic" };
+    for( int mode=0;mode<2;mode++ ) {
+      FieldMapXYZ& map = coarse[mode];
+
+      //Deviation at the skipped nodes inside the coarse map
+      double maxDeviation = 0.0, sumSquares = 0.0;
+      int nNodes = 0;
+      for(int iz=0;iz<=2*(map.nZ-1);iz++) {
+        for(int iy=0;iy<=2*(map.nY-1);iy++) {
+          for(int ix=0;ix<=2*(map.nX-1);ix++) {
+            if( ix%2 == 0 && iy%2 == 0 && iz%2 == 0 ) continue;
+            const double pos[3] = { full.xMin + ix*full.xStep, full.yMin + iy*full.yStep, full.zMin + iz*full.zStep };
+            double field[3] = { 0.0, 0.0, 0.0 };
+            map.fieldComponents( pos, field );
+            const FieldMapXYZ::FieldValues_t& node = full.fieldMap[ix + iy*full.nX + iz*nXY];
+            const double deviation = std::sqrt( ( field[0] - node.Bx )*( field[0] - node.Bx ) +
+                                                ( field[1] - node.By )*( field[1] - node.By ) +
+                                                ( field[2] - node.Bz )*( field[2] - node.Bz ) );
+            maxDeviation = std::max( maxDeviation, deviation );
+            sumSquares  += deviation*deviation;
+            ++nNodes;
+          }
+        }
+      }
+
+      //Time per evaluation at random positions inside the map
+      std::mt19937 generator( 42 );
+      std::uniform_real_distribution<double> xDist( map.xMin, map.xMax );
+      std::uniform_real_distribution<double> yDist( map.yMin, map.yMax );
+      std::uniform_real_distribution<double> zDist( map.zMin, map.zMax );
+      const int nPoints = 1000000;
+      std::vector<double> positions;
+      for(int i=0;i<nPoints;i++) {
+        positions.push_back( xDist( generator ) );
+        positions.push_back( yDist( generator ) );
+        positions.push_back( zDist( generator ) );
+      }
+      const double time = timeEvaluation( map, positions, nRepetitions );
+
+      printInterpolation( "FieldMapXYZ " + std::string( modeNames[mode] ) + " " + name, maxDeviation, sumSquares, nNodes, time, nPoints );
+    }
+  }
+
+}
+
+
+int main (int argc, char **args) {
+
+  if ( argc < 2 ){
+    std::cout << "Usage: FieldMapBenchmark <lcgeo/fieldmaps directory> [repetitions]\n";
+    exit(1);
+  }
+  const std::string directory = std::string(args[1]) + "/";
+  const int nRepetitions = std::max( 1, ( argc > 2 ? atoi(args[2]) : 5 ) );
+
+  const std::vector<std::string> brbzMaps = { "ild_fieldMap_Solenoid3.5T_StandardYoke_10cm_v1_20170223.root",
+                                              "ild_fieldMap_Solenoid4.0T_SmallYoke_10cm_v1_20180518.root" };
+  const std::vector<std::string> xyzMaps  = { "ild_fieldMap_antiDID_10cm_v1_20170223.root" };
+
+  for( const auto& name : brbzMaps ) benchmarkBrBz( directory + name, nRepetitions );
+  for( const auto& name : xyzMaps  ) benchmarkXYZ(  directory + name, nRepetitions );
+  for( const auto& name : brbzMaps ) benchmarkInterpolationBrBz( directory + name, nRepetitions );
+  for( const auto& name : xyzMaps  ) benchmarkInterpolationXYZ(  directory + name, nRepetitions );
+
+  return 0;
+}
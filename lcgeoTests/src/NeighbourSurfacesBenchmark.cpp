@@ -0,0 +1,162 @@
+// Compare the NeighbourSurfacesData map of the tracker drivers with the flat NeighbourSurfacesIndexData
+// and, where present, the NeighbourSurfacesProviderData computing the neighbours on query: construction
+// time (for the index the map and the fill from it, as in the drivers), memory and query throughput for
+// every detector of a compact file having the map and the index
+
+#include "NeighbourSurfacesIndex.h"
+#include "NeighbourSurfacesProvider.h"
+
+#include <DD4hep/Detector.h>
+#include <DDRec/DetectorData.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock;
+  typedef dd4hep::CellID CellID;
+  typedef std::map<CellID, std::vector<CellID> > NeighbourMap;
+
+  double elapsedMilliseconds( const Clock::time_point& start ) {
+    return std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+  }
+
+  /// Heap memory of the map: a tree node per surface and the buffer of each vector, each allocation
+  /// with the usual 16 bytes of malloc overhead
+  std::size_t memoryUsage( const NeighbourMap& neighbours ) {
+    const std::size_t mallocOverhead = 16, nodeHeader = 32;
+    std::size_t bytes = 0;
+    for( const auto& entry : neighbours ) {
+      bytes += nodeHeader + sizeof( NeighbourMap::value_type ) + mallocOverhead;
+      if( entry.second.capacity() ) bytes += entry.second.capacity()*sizeof(CellID) + mallocOverhead;
+    }
+    return bytes;
+  }
+
+}
+
+
+int main (int argc, char **args) {
+
+  if ( argc < 2 ){
+    std::cout << "Usage: NeighbourSurfacesBenchmark <compact file name>.xml [queries] [repetitions of the construction]\n";
+    exit(1);
+  }
+  const std::string compactFile = std::string(args[1]);
+  const int nQueries = ( argc > 2 ? atoi(args[2]) : 10000000 );
+  const int nRepetitions = std::max( 1, ( argc > 3 ? atoi(args[3]) : 10 ) );
+
+  dd4hep::Detector& theDetector = dd4hep::Detector::getInstance();
+  theDetector.fromCompact( compactFile );
+
+  int nDetectors = 0, nMismatches = 0;
+  for( const auto& entry : theDetector.detectors() ) {
+    dd4hep::DetElement det = entry.second;
+    const dd4hep::rec::NeighbourSurfacesData* data = det.extension<dd4hep::rec::NeighbourSurfacesData>( false );
+    const lcgeo::NeighbourSurfacesIndexData* index = det.extension<lcgeo::NeighbourSurfacesIndexData>( false );
+    if( not data or not index or index->size() == 0 ) continue;
+    ++nDetectors;
+
+    //The (cellID, neighbour) pairs in the order the drivers fill them, sensor by sensor
+    std::vector<std::pair<CellID, CellID> > pairs;
+    for( const auto& surface : data->sameLayer ) {
+      for( CellID neighbour : surface.second ) pairs.emplace_back( surface.first, neighbour );
+    }
+
+    //Construction: push_back into the map like the drivers, and for the index in addition the fill
+    //from the map done by lcgeo::addNeighbourSurfacesIndex
+    double mapTime = 0.0, indexTime = 0.0;
+    for( int r=0;r<nRepetitions;r++ ) {
+      Clock::time_point start = Clock::now();
+      NeighbourMap sameLayer;
+      for( const auto& pair : pairs ) sameLayer[pair.first].push_back( pair.second );
+      const double fillMapTime = elapsedMilliseconds( start );
+      mapTime += fillMapTime;
+
+      start = Clock::now();
+      lcgeo::NeighbourSurfacesIndexStruct rebuilt;
+      rebuilt.fill( sameLayer );
+      indexTime += fillMapTime + elapsedMilliseconds( start );
+      if( rebuilt.cellIDs != index->cellIDs or rebuilt.neighbourIDs != index->neighbourIDs ) ++nMismatches;
+    }
+
+    //Queries of random surfaces, one in ten without neighbours
+    std::mt19937 generator( 4711 );
+    std::uniform_int_distribution<std::size_t> surface( 0, index->size() - 1 );
+    std::vector<CellID> queries( 1 << 16 );
+    for( std::size_t q=0;q<queries.size();q++ ) {
+      queries[q] = ( q % 10 == 0 ? CellID( -1 ) : index->cellIDs[surface( generator )] );
+    }
+    std::size_t mapSum = 0, indexSum = 0;
+    Clock::time_point start = Clock::now();
+    for( int q=0;q<nQueries;q++ ) {
+      const auto it = data->sameLayer.find( queries[q & 0xffff] );
+      if( it == data->sameLayer.end() ) continue;
+      for( CellID neighbour : it->second ) mapSum += neighbour;
+    }
+    const double mapQueryTime = elapsedMilliseconds( start );
+    start = Clock::now();
+    for( int q=0;q<nQueries;q++ ) {
+      for( CellID neighbour : index->neighbours( queries[q & 0xffff] ) ) indexSum += neighbour;
+    }
+    const double indexQueryTime = elapsedMilliseconds( start );
+    if( mapSum != indexSum ) ++nMismatches;
+
+    //The provider gives the same neighbours for radius 1, in the same order
+    const lcgeo::NeighbourSurfacesProviderData* provider = det.extension<lcgeo::NeighbourSurfacesProviderData>( false );
+    double providerQueryTime = 0.0;
+    if( provider ) {
+      std::vector<CellID> computed;
+      for( const auto& surface : data->sameLayer ) {
+        computed.clear();
+        provider->neighbours( surface.first, 1, computed );
+        if( computed != surface.second ) ++nMismatches;
+      }
+      std::size_t providerSum = 0;
+      start = Clock::now();
+      for( int q=0;q<nQueries;q++ ) {
+        computed.clear();
+        provider->neighbours( queries[q & 0xffff], 1, computed );
+        for( CellID neighbour : computed ) providerSum += neighbour;
+      }
+      providerQueryTime = elapsedMilliseconds( start );
+      if( providerSum != indexSum ) ++nMismatches;
+    }
+
+    std::cout << entry.first << ": " << index->size() << " surfaces, " << pairs.size() << " neighbours" << std::endl;
+    std::cout << std::setw(30) << std::left << "  std::map of vectors" << std::right << std::fixed
+              << std::setw(10) << std::setprecision(3) << mapTime/nRepetitions << " ms construction"
+              << std::setw(10) << std::setprecision(1) << memoryUsage( data->sameLayer )/1024.0 << " kB"
+              << std::setw(10) << std::setprecision(1) << 1e6*mapQueryTime/nQueries << " ns/query" << std::endl;
+    std::cout << std::setw(30) << std::left << "  NeighbourSurfacesIndexData" << std::right
+              << std::setw(10) << std::setprecision(3) << indexTime/nRepetitions << " ms construction"
+              << std::setw(10) << std::setprecision(1) << index->memoryUsage()/1024.0 << " kB"
+              << std::setw(10) << std::setprecision(1) << 1e6*indexQueryTime/nQueries << " ns/query" << std::endl;
+    if( provider ) {
+      std::cout << std::setw(30) << std::left << "  NeighbourSurfacesProviderData" << std::right
+                << std::setw(10) << std::setprecision(3) << 0.0 << " ms construction"
+                << std::setw(10) << std::setprecision(1) << provider->layers.capacity()*sizeof(lcgeo::NeighbourSurfacesProviderStruct::Layer)/1024.0 << " kB"
+                << std::setw(10) << std::setprecision(1) << 1e6*providerQueryTime/nQueries << " ns/query" << std::endl;
+    }
+  }
+
+  if( nDetectors == 0 ) {
+    std::cout << "No detector with NeighbourSurfacesData and NeighbourSurfacesIndexData in " << compactFile << std::endl;
+    return 1;
+  }
+  if( nMismatches > 0 ) {
+    std::cout << "ERROR: the neighbour index or provider differs from the NeighbourSurfacesData" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
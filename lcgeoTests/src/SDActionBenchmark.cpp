@@ -0,0 +1,318 @@
+// Benchmark a sensitive action of lcgeo (TPCSDAction, CaloPreShowerSDAction, ...) without a full simulation:
+// the Geant4 geometry is converted from a compact file, straight tracks from the interaction point are
+// transported through it with a G4Navigator and the steps in the sensitive detector are recorded. The
+// recorded steps are then replayed into the sensitive detector of the action, which is timed.
+
+#include <DD4hep/Detector.h>
+#include <DD4hep/DetElement.h>
+#include <DD4hep/Volumes.h>
+#include <DD4hep/Plugins.h>
+#include <DD4hep/Printout.h>
+#include <DDG4/Geant4Converter.h>
+#include <DDG4/Geant4EventAction.h>
+#include <DDG4/Geant4Kernel.h>
+#include <DDG4/Geant4Mapping.h>
+#include <DDG4/Geant4RunAction.h>
+#include <DDG4/Geant4SensDetAction.h>
+
+#include <G4Event.hh>
+#include <G4HCofThisEvent.hh>
+#include <G4LogicalVolume.hh>
+#include <G4Navigator.hh>
+#include <G4PionPlus.hh>
+#include <G4ProcessManager.hh>
+#include <G4Run.hh>
+#include <G4SDManager.hh>
+#include <G4Step.hh>
+#include <G4StepLimiter.hh>
+#include <G4SystemOfUnits.hh>
+#include <G4TouchableHistory.hh>
+#include <G4Track.hh>
+#include <G4VHitsCollection.hh>
+#include <G4VPhysicalVolume.hh>
+#include <G4VSensitiveDetector.hh>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+  /// Number of calls of operator new, allocations/step is the difference around the replay
+  std::atomic<long> nAllocations( 0 );
+
+}
+
+void* operator new( std::size_t size ) {
+  ++nAllocations;
+  void* ptr = std::malloc( size ? size : 1 );
+  if( not ptr ) throw std::bad_alloc();
+  return ptr;
+}
+void* operator new[]( std::size_t size ) {
+  ++nAllocations;
+  void* ptr = std::malloc( size ? size : 1 );
+  if( not ptr ) throw std::bad_alloc();
+  return ptr;
+}
+void operator delete( void* ptr ) noexcept { std::free( ptr ); }
+void operator delete[]( void* ptr ) noexcept { std::free( ptr ); }
+void operator delete( void* ptr, std::size_t ) noexcept { std::free( ptr ); }
+void operator delete[]( void* ptr, std::size_t ) noexcept { std::free( ptr ); }
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock;
+
+  /// Mean energy loss of a minimum ionising particle, the deposit of a step is this times density and length
+  const double dEdxMIP = 1.5 * CLHEP::MeV * CLHEP::cm2 / CLHEP::g;
+
+  /// A step in the sensitive detector, everything needed to fill the G4Step given to the sensitive detector
+  struct StepRecord {
+    int track = 0;
+    G4TouchableHandle preTouchable{};
+    G4TouchableHandle postTouchable{};
+    G4ThreeVector prePosition{};
+    G4ThreeVector postPosition{};
+    G4double preTime = 0.0;
+    G4double postTime = 0.0;
+    G4double length = 0.0;
+    G4double energyDeposit = 0.0;
+    G4StepStatus postStatus = fUndefined;
+    const G4VProcess* process = nullptr;  // process limiting the step, nullptr for the transportation
+    G4VSensitiveDetector* postSensitive = nullptr;
+  };
+
+  /// A straight track of a charged pion with constant momentum
+  struct SyntheticTrack {
+    G4ThreeVector direction{};
+    G4double kineticEnergy = 0.0;
+    G4double velocity = 0.0;
+  };
+
+  /// Transport a track from the origin through the world in steps of at most maxStep and record the steps in
+  /// the sensitive detector. Steps which are not limited by a volume boundary are limited by the stepLimiter
+  void transport( G4Navigator& navigator, const SyntheticTrack& track, int trackIndex, G4double maxStep,
+                  const G4VSensitiveDetector* sensitive, const G4VProcess* stepLimiter, std::vector<StepRecord>& steps ) {
+    G4ThreeVector position( 0.0, 0.0, 0.0 );
+    G4double time = 0.0;
+    navigator.LocateGlobalPointAndSetup( position, &track.direction, false, false );
+    G4TouchableHandle touchable( navigator.CreateTouchableHistory() );
+
+    //Safety against steps of zero length at boundaries which the navigator does not resolve
+    const int maxStepsPerTrack = 1000000;
+    for( int n=0;n<maxStepsPerTrack && touchable->GetVolume();n++ ) {
+      G4double safety = 0.0;
+      const G4double toBoundary = navigator.ComputeStep( position, track.direction, maxStep, safety );
+      const bool atBoundary = ( toBoundary <= maxStep );
+      const G4double length = ( atBoundary ? toBoundary : maxStep );
+      const G4ThreeVector postPosition = position + length * track.direction;
+      if( atBoundary ) navigator.SetGeometricallyLimitedStep();
+      navigator.LocateGlobalPointAndSetup( postPosition, &track.direction, true );
+      G4TouchableHandle postTouchable( navigator.CreateTouchableHistory() );
+      const G4double postTime = time + length / track.velocity;
+
+      G4LogicalVolume* preVolume = touchable->GetVolume()->GetLogicalVolume();
+      if( preVolume->GetSensitiveDetector() == sensitive ) {
+        StepRecord step;
+        step.track = trackIndex;
+        step.preTouchable = touchable;
+        step.postTouchable = postTouchable;
+        step.prePosition = position;
+        step.postPosition = postPosition;
+        step.preTime = time;
+        step.postTime = postTime;
+        step.length = length;
+        step.energyDeposit = dEdxMIP * preVolume->GetMaterial()->GetDensity() * length;
+        step.postStatus = ( atBoundary ? fGeomBoundary : fPostStepDoItProc );
+        step.process = ( atBoundary ? nullptr : stepLimiter );
+        step.postSensitive = ( postTouchable->GetVolume() ? postTouchable->GetVolume()->GetLogicalVolume()->GetSensitiveDetector() : nullptr );
+        steps.push_back( step );
+      }
+      position = postPosition;
+      time = postTime;
+      touchable = postTouchable;
+    }
+  }
+
+  /// Fill a step point of the G4Step given to the sensitive detector
+  void fillPoint( G4StepPoint* point, const G4TouchableHandle& touchable, const G4ThreeVector& position, G4double time,
+                  const SyntheticTrack& track, const G4ParticleDefinition* particle ) {
+    point->SetTouchableHandle( touchable );
+    point->SetPosition( position );
+    point->SetGlobalTime( time );
+    point->SetLocalTime( time );
+    point->SetMomentumDirection( track.direction );
+    point->SetKineticEnergy( track.kineticEnergy );
+    point->SetMass( particle->GetPDGMass() );
+    point->SetCharge( particle->GetPDGCharge() );
+    point->SetVelocity( track.velocity );
+    if( touchable->GetVolume() ) point->SetMaterial( touchable->GetVolume()->GetLogicalVolume()->GetMaterial() );
+  }
+
+}
+
+
+int main (int argc, char **args) {
+
+  if ( argc < 4 ){
+    std::cout << "Usage: SDActionBenchmark <compact file name>.xml <detector name> <sensitive action type> "
+              << "[events] [tracks per event] [maximum step length in mm] [seed]\n"
+              << "  e.g. SDActionBenchmark ILD_l5_v02.xml TPC TPCSDAction 10 20 5\n";
+    exit(1);
+  }
+  const std::string compactFile = std::string(args[1]);
+  const std::string detectorName = std::string(args[2]);
+  const std::string actionType = std::string(args[3]);
+  const int nEvents = std::max( 1, ( argc > 4 ? atoi(args[4]) : 10 ) );
+  const int nTracks = std::max( 1, ( argc > 5 ? atoi(args[5]) : 20 ) );
+  const G4double maxStep = ( argc > 6 ? atof(args[6]) : 5.0 ) * CLHEP::mm;
+  const int seed = ( argc > 7 ? atoi(args[7]) : 4711 );
+
+  dd4hep::Detector& theDetector = dd4hep::Detector::getInstance();
+  theDetector.fromCompact( compactFile );
+  dd4hep::DetElement detElement = theDetector.detector( detectorName );
+  dd4hep::SensitiveDetector sensDet = theDetector.sensitiveDetector( detectorName );
+  if( not sensDet.isValid() ) {
+    std::cout << "ERROR: " << detectorName << " is not a sensitive detector of " << compactFile << std::endl;
+    return 1;
+  }
+
+  //The Geant4 geometry, as made by the Geant4DetectorConstruction of DDG4
+  const Clock::time_point startConversion = Clock::now();
+  dd4hep::sim::Geant4Converter converter( theDetector, dd4hep::WARNING );
+  dd4hep::sim::Geant4GeometryInfo* geometryInfo = converter.create( theDetector.world() ).detach();
+  dd4hep::sim::Geant4Mapping::instance().attach( geometryInfo );
+  G4VPhysicalVolume* world = geometryInfo->world();
+  const double conversionTime = std::chrono::duration<double, std::milli>( Clock::now() - startConversion ).count();
+
+  //The sensitive action in the sequence of the sensitive detector, as set up by ddsim
+  dd4hep::sim::Geant4Kernel& kernel = dd4hep::sim::Geant4Kernel::instance( theDetector );
+  dd4hep::sim::Geant4Context* context = kernel.workerContext();
+  dd4hep::sim::Geant4SensDetActionSequence* sequence = kernel.sensitiveAction( detectorName );
+  dd4hep::sim::Geant4Sensitive* action =
+    dd4hep::PluginService::Create<dd4hep::sim::Geant4Sensitive*>( actionType, context, detectorName, &detElement, &theDetector );
+  if( not action ) {
+    std::cout << "ERROR: cannot create the sensitive action " << actionType << std::endl;
+    return 1;
+  }
+  sequence->adopt( action );
+  G4VSensitiveDetector* sensitive =
+    dd4hep::PluginService::Create<G4VSensitiveDetector*>( std::string( "Geant4SensDet" ), detectorName, &theDetector );
+  G4SDManager* sdManager = G4SDManager::GetSDMpointer();
+  sdManager->AddNewDetector( sensitive );
+
+  //Attach the sensitive detector to the Geant4 volumes of the detector
+  int nSensitiveVolumes = 0;
+  for( const auto& entry : geometryInfo->g4Volumes ) {
+    dd4hep::Volume volume( entry.first );
+    if( volume.isSensitive() and volume.sensitiveDetector().name() == sensDet.name() ) {
+      entry.second->SetSensitiveDetector( sensitive );
+      ++nSensitiveVolumes;
+    }
+  }
+
+  //The step limiter is known to the process table, like with the step limit physics of ddsim
+  G4ParticleDefinition* particle = G4PionPlus::Definition();
+  if( not particle->GetProcessManager() ) particle->SetProcessManager( new G4ProcessManager( particle ) );
+  G4StepLimiter* stepLimiter = new G4StepLimiter();
+  particle->GetProcessManager()->AddDiscreteProcess( stepLimiter );
+
+  G4Navigator navigator;
+  navigator.SetWorldVolume( world );
+
+  std::mt19937 generator( seed );
+  std::uniform_real_distribution<double> cosTheta( -0.95, 0.95 );
+  std::uniform_real_distribution<double> phi( 0.0, 2.0*M_PI );
+  std::uniform_real_distribution<double> logMomentum( std::log( 0.1*CLHEP::GeV ), std::log( 50.0*CLHEP::GeV ) );
+
+  G4Run run;
+  kernel.runAction().begin( &run );
+
+  double replayTime = 0.0;
+  long nSteps = 0, nStepAllocations = 0, nHits = 0;
+  for( int event=0;event<nEvents;event++ ) {
+    //The step stream of the event, recorded before the replay
+    std::vector<SyntheticTrack> tracks( nTracks );
+    std::vector<StepRecord> steps;
+    for( int t=0;t<nTracks;t++ ) {
+      const double ct = cosTheta( generator ), st = std::sqrt( 1.0 - ct*ct ), ph = phi( generator );
+      const double momentum = std::exp( logMomentum( generator ) );
+      const double mass = particle->GetPDGMass(), energy = std::sqrt( momentum*momentum + mass*mass );
+      tracks[t].direction = G4ThreeVector( st*std::cos( ph ), st*std::sin( ph ), ct );
+      tracks[t].kineticEnergy = energy - mass;
+      tracks[t].velocity = CLHEP::c_light * momentum / energy;
+      transport( navigator, tracks[t], t, maxStep, sensitive, stepLimiter, steps );
+    }
+    std::vector<std::unique_ptr<G4Track>> g4tracks;
+    for( int t=0;t<nTracks;t++ ) {
+      g4tracks.emplace_back( new G4Track( new G4DynamicParticle( particle, tracks[t].direction, tracks[t].kineticEnergy ), 0.0, G4ThreeVector() ) );
+      g4tracks.back()->SetTrackID( t+1 );
+      g4tracks.back()->SetParentID( 0 );
+    }
+
+    G4Event g4event( event );
+    kernel.eventAction().begin( &g4event );
+    G4HCofThisEvent* hce = sdManager->PrepareNewEvent();
+
+    //The replay through the single G4Step, which Geant4 reuses for all steps as well
+    G4Step g4step;
+    const long allocationsBefore = nAllocations;
+    const Clock::time_point start = Clock::now();
+    for( const StepRecord& step : steps ) {
+      G4Track* track = g4tracks[step.track].get();
+      const SyntheticTrack& synthetic = tracks[step.track];
+      fillPoint( g4step.GetPreStepPoint(), step.preTouchable, step.prePosition, step.preTime, synthetic, particle );
+      fillPoint( g4step.GetPostStepPoint(), step.postTouchable, step.postPosition, step.postTime, synthetic, particle );
+      g4step.GetPreStepPoint()->SetSensitiveDetector( sensitive );
+      g4step.GetPostStepPoint()->SetSensitiveDetector( step.postSensitive );
+      g4step.GetPostStepPoint()->SetStepStatus( step.postStatus );
+      g4step.GetPostStepPoint()->SetProcessDefinedStep( step.process );
+      g4step.SetStepLength( step.length );
+      g4step.SetTotalEnergyDeposit( step.energyDeposit );
+      g4step.SetTrack( track );
+      track->SetStep( &g4step );
+      track->SetPosition( step.postPosition );
+      track->SetGlobalTime( step.postTime );
+      track->SetTouchableHandle( step.preTouchable );
+      track->SetNextTouchableHandle( step.postTouchable );
+      sensitive->Hit( &g4step );
+    }
+    //Hits made at the end of the event, e.g. the low pt hits of the TPC, are part of the sensitive action
+    kernel.eventAction().end( &g4event );
+    sdManager->TerminateCurrentEvent( hce );
+    replayTime += std::chrono::duration<double, std::nano>( Clock::now() - start ).count();
+    nStepAllocations += nAllocations - allocationsBefore;
+    nSteps += steps.size();
+
+    for( int i=0;i<hce->GetNumberOfCollections();i++ ) {
+      if( hce->GetHC( i ) ) nHits += hce->GetHC( i )->GetSize();
+    }
+    delete hce;
+  }
+
+  kernel.runAction().end( &run );
+
+  std::cout << compactFile << ": " << actionType << " of " << detectorName << " in " << nSensitiveVolumes << " Geant4 volumes, "
+            << "geometry conversion " << std::fixed << std::setprecision(0) << conversionTime << " ms" << std::endl;
+  std::cout << nEvents << " events of " << nTracks << " tracks, maximum step " << maxStep/CLHEP::mm << " mm, "
+            << nSteps/nEvents << " steps per event" << std::endl;
+  if( nSteps == 0 ) {
+    std::cout << "ERROR: no step in the sensitive volumes of " << detectorName << std::endl;
+    return 1;
+  }
+  std::cout << std::setw(20) << std::left << "ns/step" << std::right << std::setw(12) << std::setprecision(1) << replayTime/nSteps << "\n"
+            << std::setw(20) << std::left << "allocations/step" << std::right << std::setw(12) << std::setprecision(2) << double( nStepAllocations )/nSteps << "\n"
+            << std::setw(20) << std::left << "hits/event" << std::right << std::setw(12) << std::setprecision(1) << double( nHits )/nEvents << std::endl;
+
+  return 0;
+}
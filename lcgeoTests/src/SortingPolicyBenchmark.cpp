@@ -0,0 +1,126 @@
+// Time the lcgeo_LinearSortingPolicy plugin of a compact file and check its SortingPolicy parameters against
+// the reference implementation scanning the paths of all surfaces of the SurfaceHelper
+
+#include <DD4hep/DetFactoryHelper.h>
+#include <DD4hep/Detector.h>
+#include <DDRec/DetectorData.h>
+#include <DDRec/SurfaceHelper.h>
+#include <XML/DocumentHandler.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock;
+
+  double elapsedMilliseconds( const Clock::time_point& start ) {
+    return std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+  }
+
+  /// Sorting policy of the DetElements with surfaces from the patterns and parameters of the plugin:
+  /// the path of the DetElement of every surface is matched against the patterns in order
+  std::map<dd4hep::DetElement::Object*, double> referenceSortingPolicy( dd4hep::Detector& theDetector, const std::vector<std::string>& arguments ) {
+    std::vector<std::pair<std::string, std::vector<double> > > pathToLinear;
+    for( std::size_t i=0;i<arguments.size();i++ ) {
+      if( i % 4 == 0 ) pathToLinear.emplace_back( arguments[i], std::vector<double>( 3, 0.0 ) );
+      else pathToLinear.back().second[( i % 4 ) - 1] = dd4hep::_toDouble( arguments[i] );
+    }
+
+    std::map<dd4hep::DetElement::Object*, double> values;
+    dd4hep::rec::SurfaceHelper ds( theDetector.world() );
+    for( dd4hep::rec::ISurface* surf : ds.surfaceList() ) {
+      auto* ddsurf = static_cast<dd4hep::rec::Surface*>( surf );
+      if( not ddsurf->detElement().isValid() ) continue;
+      const std::string path = ddsurf->detElement().path();
+      for( const auto& pathAndValues : pathToLinear ) {
+        if( path.find( pathAndValues.first ) == std::string::npos ) continue;
+        const std::vector<double>& parameters = pathAndValues.second;
+        const double zPosition = std::fabs( surf->origin()[2] );
+        values[ddsurf->detElement().ptr()] = parameters[2] * ( zPosition - parameters[0] ) + parameters[1];
+        break;
+      }
+    }
+    return values;
+  }
+
+}
+
+
+int main (int argc, char **args) {
+
+  if ( argc < 2 ){
+    std::cout << "Usage: SortingPolicyBenchmark <compact file name>.xml [repetitions]\n";
+    exit(1);
+  }
+  const std::string compactFile = std::string(args[1]);
+  const int nRepetitions = std::max( 1, ( argc > 2 ? atoi(args[2]) : 5 ) );
+
+  dd4hep::Detector& theDetector = dd4hep::Detector::getInstance();
+  Clock::time_point start = Clock::now();
+  theDetector.fromCompact( compactFile );
+  const double loadTime = elapsedMilliseconds( start );
+
+  //The arguments of the plugin in the compact file
+  std::vector<std::string> arguments;
+  {
+    dd4hep::xml::DocumentHolder doc( dd4hep::xml::DocumentHandler().load( compactFile ) );
+    xml_h root = doc.root();
+    for( xml_coll_t plugins( root, _Unicode(plugins) ); plugins; ++plugins ) {
+      for( xml_coll_t plugin( plugins, _Unicode(plugin) ); plugin; ++plugin ) {
+        if( xml_comp_t( plugin ).nameStr() != "lcgeo_LinearSortingPolicy" ) continue;
+        for( xml_coll_t argument( plugin, _Unicode(argument) ); argument; ++argument ) {
+          arguments.push_back( xml_comp_t( argument ).attr<std::string>( _Unicode(value) ) );
+        }
+      }
+    }
+  }
+  if( arguments.empty() ) {
+    std::cout << "No lcgeo_LinearSortingPolicy plugin with arguments in " << compactFile << std::endl;
+    return 1;
+  }
+  std::vector<char*> argv;
+  for( auto& argument : arguments ) argv.push_back( &argument[0] );
+
+  //The plugin again, the extensions made when loading the compact file are updated
+  start = Clock::now();
+  for( int r=0;r<nRepetitions;r++ ) theDetector.apply( "lcgeo_LinearSortingPolicy", argv.size(), argv.data() );
+  const double pluginTime = elapsedMilliseconds( start ) / nRepetitions;
+
+  start = Clock::now();
+  std::map<dd4hep::DetElement::Object*, double> expected;
+  for( int r=0;r<nRepetitions;r++ ) expected = referenceSortingPolicy( theDetector, arguments );
+  const double referenceTime = elapsedMilliseconds( start ) / nRepetitions;
+
+  int nMismatches = 0;
+  for( const auto& entry : expected ) {
+    dd4hep::DetElement det( entry.first );
+    const dd4hep::rec::DoubleParameters* para = det.extension<dd4hep::rec::DoubleParameters>( false );
+    const auto it = ( para ? para->doubleParameters.find( "SortingPolicy" ) : std::map<std::string, double>::const_iterator() );
+    if( not para or it == para->doubleParameters.end() or std::fabs( it->second - entry.second ) > 1e-9 * std::max( 1.0, std::fabs( entry.second ) ) ) {
+      std::cout << "Mismatch for " << det.path() << ": expected SortingPolicy " << entry.second << std::endl;
+      ++nMismatches;
+    }
+  }
+
+  std::cout << compactFile << ": " << arguments.size()/4 << " patterns, " << expected.size() << " DetElements with a SortingPolicy" << std::endl;
+  std::cout << std::setw(40) << std::left << "compact file, including the plugin" << std::right << std::setw(12) << std::fixed
+            << std::setprecision(1) << loadTime << " ms" << std::endl;
+  std::cout << std::setw(40) << std::left << "lcgeo_LinearSortingPolicy" << std::right << std::setw(12) << pluginTime << " ms" << std::endl;
+  std::cout << std::setw(40) << std::left << "scan of all surface paths" << std::right << std::setw(12) << referenceTime << " ms" << std::endl;
+
+  if( nMismatches > 0 ) {
+    std::cout << "ERROR: " << nMismatches << " DetElements with a different SortingPolicy than the reference" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,708 @@
+// Test the interpolation kernels of the FieldMapXYZ and FieldMapBrBz field maps on synthetic grids
+
+#include "FieldMapAdaptive.h"
+#include "FieldMapBrBz.h"
+#include "FieldMapRegistry.h"
+#include "FieldMapXYZ.h"
+
+#include <DD4hep/DD4hepUnits.h>
+#include <DD4hep/DDTest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <utime.h>
+
+static dd4hep::DDTest test( "FieldMaps" ) ;
+
+namespace {
+
+  /// Smooth analytic field used to fill the synthetic grids
+  void analyticField( double x, double y, double z, double* B ) {
+    B[0] = 0.3*dd4hep::tesla * std::sin( x/(70*dd4hep::cm) ) * std::cos( z/(90*dd4hep::cm) );
+    B[1] = 0.2*dd4hep::tesla * std::cos( y/(50*dd4hep::cm) ) + 0.01*dd4hep::tesla * x/dd4hep::m;
+    B[2] = 3.5*dd4hep::tesla * std::exp( -(x*x + y*y)/(4*dd4hep::m*dd4hep::m) ) - 0.1*dd4hep::tesla * z/dd4hep::m;
+  }
+
+  /// Fill a FieldMapXYZ with a uniform grid of the analytic field, as fillFieldMapFromTree would
+  void fillSyntheticMap( FieldMapXYZ& map ) {
+    map.bScale = 1.0;
+    map.coorsOrder = 1; map.strCoorsOrder = "XYZ";
+    map.xOrdering = map.yOrdering = map.zOrdering = 1;
+    map.xScale = map.yScale = map.zScale = 1.0;
+    map.nX = 21; map.xMin = -100*dd4hep::cm; map.xStep = 10*dd4hep::cm; map.xMax = map.xMin + (map.nX-1)*map.xStep;
+    map.nY = 17; map.yMin =  -80*dd4hep::cm; map.yStep = 10*dd4hep::cm; map.yMax = map.yMin + (map.nY-1)*map.yStep;
+    map.nZ = 31; map.zMin = -300*dd4hep::cm; map.zStep = 20*dd4hep::cm; map.zMax = map.zMin + (map.nZ-1)*map.zStep;
+    map.fieldMap.clear();
+    for(int iz=0;iz<map.nZ;iz++) {
+      for(int iy=0;iy<map.nY;iy++) {
+        for(int ix=0;ix<map.nX;ix++) {
+          double B[3];
+          analyticField( map.xMin + ix*map.xStep, map.yMin + iy*map.yStep, map.zMin + iz*map.zStep, B );
+          map.fieldMap.push_back( FieldMapXYZ::FieldValues_t( B[0], B[1], B[2] ) );
+        }
+      }
+    }
+    map.fieldMapPtr = map.fieldMap.data();
+  }
+
+  /// Fill a FieldMapBrBz with a uniform (rho,z) grid of a solenoid-like field
+  void fillSyntheticMap( FieldMapBrBz& map ) {
+    map.bScale = 1.0;
+    map.coorsOrder = 1; map.strCoorsOrder = "RZ";
+    map.rhoOrdering = map.zOrdering = 1;
+    map.rScale = map.zScale = 1.0;
+    map.nRho = 41; map.rhoMin = 0.0; map.rhoStep = 10*dd4hep::cm; map.rhoMax = map.rhoMin + (map.nRho-1)*map.rhoStep;
+    map.nZ   = 61; map.zMin   = 0.0; map.zStep   = 10*dd4hep::cm; map.zMax   = map.zMin   + (map.nZ-1)*map.zStep;
+    map.fieldMap.clear();
+    for(int iz=0;iz<map.nZ;iz++) {
+      for(int ir=0;ir<map.nRho;ir++) {
+        const double r = map.rhoMin + ir*map.rhoStep;
+        const double z = map.zMin   + iz*map.zStep;
+        map.fieldMap.push_back( FieldMapBrBz::FieldValues_t( 0.2*dd4hep::tesla * (r/dd4hep::m) * (z/dd4hep::m),
+                                                             3.5*dd4hep::tesla / ( 1.0 + std::pow( z/(3*dd4hep::m), 6 ) ) ) );
+      }
+    }
+    map.fieldMapPtr = map.fieldMap.data();
+  }
+
+  /// Random positions covering the map and some margin around it, as (x,y,z) triplets
+  std::vector<double> randomPositions( int nPoints, double xyMax, double zMax ) {
+    std::mt19937 generator( 815 );
+    std::uniform_real_distribution<double> xyDist( -1.1*xyMax, 1.1*xyMax );
+    std::uniform_real_distribution<double> zDist(  -1.1*zMax,  1.1*zMax  );
+    std::vector<double> positions;
+    for(int i=0;i<nPoints;i++) {
+      positions.push_back( xyDist( generator ) );
+      positions.push_back( xyDist( generator ) );
+      positions.push_back( zDist( generator ) );
+    }
+    return positions;
+  }
+
+  /// The batch evaluation must give exactly the same result as the single point evaluation
+  template<typename FieldMap> void testBatch( FieldMap& map, const std::vector<double>& positions, const std::string& name ) {
+    const std::size_t nPoints = positions.size()/3;
+    std::vector<double> single( 3*nPoints, 0.0 );
+    std::vector<double> batch(  3*nPoints, 0.0 );
+    for(std::size_t i=0;i<nPoints;i++) map.fieldComponents( &positions[3*i], &single[3*i] );
+    map.fieldComponentsBatch( positions.data(), batch.data(), nPoints );
+    int nDifferent = 0;
+    for(std::size_t i=0;i<3*nPoints;i++) if( single[i] != batch[i] ) ++nDifferent;
+    test( nDifferent, 0, name + " batch vs single point evaluation" );
+  }
+
+  /// Compare the packed float32 kernel with the double precision kernel
+  void testXYZStorage() {
+
+    FieldMapXYZ aos;
+    fillSyntheticMap( aos );
+    FieldMapXYZ soa;
+    fillSyntheticMap( soa );
+    soa.fillFieldMapSoA();
+    soa.storage = 1;
+
+    // float32 storage: allow for a relative precision of 1e-6 of the largest field component
+    const double tolerance = 1e-6 * 3.5*dd4hep::tesla;
+
+    std::mt19937 generator( 4711 );
+    std::uniform_real_distribution<double> xDist( aos.xMin, aos.xMax );
+    std::uniform_real_distribution<double> yDist( aos.yMin, aos.yMax );
+    std::uniform_real_distribution<double> zDist( aos.zMin, aos.zMax );
+
+    double maxDeviation = 0.0;
+    for(int i=0;i<100000;i++) {
+      const double pos[3] = { xDist( generator ), yDist( generator ), zDist( generator ) };
+      double fieldAoS[3] = { 0.0, 0.0, 0.0 };
+      double fieldSoA[3] = { 0.0, 0.0, 0.0 };
+      aos.fieldComponents( pos, fieldAoS );
+      soa.fieldComponents( pos, fieldSoA );
+      for(int j=0;j<3;j++) maxDeviation = std::max( maxDeviation, std::fabs( fieldAoS[j] - fieldSoA[j] ) );
+    }
+    std::stringstream msg;
+    msg << "FieldMapXYZ SoA vs AoS: maximum deviation " << maxDeviation/dd4hep::tesla << " tesla";
+    test( maxDeviation < tolerance, msg.str() );
+
+    // the grid corners, including the upper edges of the map, are reproduced
+    const double corner[3] = { aos.xMax, aos.yMax, aos.zMax };
+    double fieldAoS[3] = { 0.0, 0.0, 0.0 };
+    double fieldSoA[3] = { 0.0, 0.0, 0.0 };
+    aos.fieldComponents( corner, fieldAoS );
+    soa.fieldComponents( corner, fieldSoA );
+    test( std::fabs( fieldAoS[2] - fieldSoA[2] ) < tolerance, "FieldMapXYZ SoA vs AoS at the upper corner of the map" );
+
+    // points outside of the map do not add any field
+    const double outside[3] = { aos.xMax + 1*dd4hep::mm, 0.0, 0.0 };
+    double fieldOutside[3] = { 0.0, 0.0, 0.0 };
+    soa.fieldComponents( outside, fieldOutside );
+    test( fieldOutside[0] == 0.0 && fieldOutside[1] == 0.0 && fieldOutside[2] == 0.0, "FieldMapXYZ SoA outside of the map" );
+
+    // 1001 points, not a multiple of the block size of the batch evaluation
+    const std::vector<double> positions = randomPositions( 1001, aos.xMax, aos.zMax );
+    testBatch( aos, positions, "FieldMapXYZ AoS" );
+    testBatch( soa, positions, "FieldMapXYZ SoA" );
+  }
+
+  /// Write the field map to a binary cache and map it back, the field must be unchanged
+  void testXYZCache() {
+
+    // any file serves as source, only its metadata and checksum enter the cache header
+    const std::string sourceFile( "TestFieldMaps_source.dat" );
+    const std::string cacheFile(  "TestFieldMaps_cache.fmc" );
+    {
+      std::ofstream source( sourceFile );
+      source << "field map source version 1" << std::endl;
+    }
+
+    FieldMapXYZ original;
+    fillSyntheticMap( original );
+    original.writeFieldMapCache( cacheFile, sourceFile, dd4hep::mm, dd4hep::tesla );
+
+    FieldMapXYZ mapped;
+    mapped.bScale = original.bScale;
+    test( mapped.fillFieldMapFromCache( cacheFile, sourceFile, dd4hep::mm, dd4hep::tesla ), "FieldMapXYZ mapped from cache" );
+    const std::string content( "field map source version 1\n" );
+    test( mapped.cache && mapped.cache->header().sourceChecksum == lcgeo::FieldMapCache::checksum( content.data(), content.size() ),
+          "FieldMapXYZ checksum of the source written to the cache" );
+    test( mapped.nX == original.nX && mapped.nY == original.nY && mapped.nZ == original.nZ &&
+          mapped.strCoorsOrder == original.strCoorsOrder, "FieldMapXYZ grid from cache" );
+
+    const std::vector<double> positions = randomPositions( 1000, original.xMax, original.zMax );
+    int nDifferent = 0;
+    for(std::size_t i=0;i<positions.size();i+=3) {
+      double fieldOriginal[3] = { 0.0, 0.0, 0.0 };
+      double fieldMapped[3]   = { 0.0, 0.0, 0.0 };
+      original.fieldComponents( &positions[i], fieldOriginal );
+      mapped.fieldComponents( &positions[i], fieldMapped );
+      for(int j=0;j<3;j++) if( fieldOriginal[j] != fieldMapped[j] ) ++nDifferent;
+    }
+    test( nDifferent, 0, "FieldMapXYZ field from cache" );
+
+    // the cached points are not scaled, a field map with another bScale uses the same cache
+    FieldMapXYZ scaled;
+    scaled.bScale = 2.0;
+    test( scaled.fillFieldMapFromCache( cacheFile, sourceFile, dd4hep::mm, dd4hep::tesla ), "FieldMapXYZ cache used with other bScale" );
+    const double pos[3] = { 12*dd4hep::cm, -34*dd4hep::cm, 56*dd4hep::cm };
+    double fieldOriginal[3] = { 0.0, 0.0, 0.0 };
+    double fieldScaled[3]   = { 0.0, 0.0, 0.0 };
+    original.fieldComponents( pos, fieldOriginal );
+    scaled.fieldComponents( pos, fieldScaled );
+    test( fieldScaled[0] == 2.0*fieldOriginal[0] && fieldScaled[1] == 2.0*fieldOriginal[1] && fieldScaled[2] == 2.0*fieldOriginal[2],
+          "FieldMapXYZ bScale applied to the cached points" );
+
+    // a modified source file of the same size must not be used; the modification time is moved on
+    // explicitly, as both writes may fall into the same tick of the file system clock
+    struct stat status;
+    stat( sourceFile.c_str(), &status );
+    {
+      std::ofstream source( sourceFile );
+      source << "field map source version 2" << std::endl;
+    }
+    struct utimbuf times;
+    times.actime  = status.st_atime;
+    times.modtime = status.st_mtime + 10;
+    utime( sourceFile.c_str(), &times );
+    FieldMapXYZ outdated;
+    outdated.bScale = original.bScale;
+    test( not outdated.fillFieldMapFromCache( cacheFile, sourceFile, dd4hep::mm, dd4hep::tesla ), "FieldMapXYZ outdated cache rejected" );
+
+    std::remove( sourceFile.c_str() );
+    std::remove( cacheFile.c_str() );
+  }
+
+  /// The cubic B-spline interpolation reproduces the grid values and is closer to the analytic field than the trilinear one
+  void testXYZCubic() {
+
+    FieldMapXYZ linear;
+    fillSyntheticMap( linear );
+    FieldMapXYZ cubic;
+    fillSyntheticMap( cubic );
+    cubic.interpolation = 3;
+    cubic.fillSplineCoefficients();
+
+    double maxNodeDeviation = 0.0;
+    for(int iz=0;iz<cubic.nZ;iz+=3) {
+      for(int iy=0;iy<cubic.nY;iy+=2) {
+        for(int ix=0;ix<cubic.nX;ix+=2) {
+          const double pos[3] = { cubic.xMin + ix*cubic.xStep, cubic.yMin + iy*cubic.yStep, cubic.zMin + iz*cubic.zStep };
+          const FieldMapXYZ::FieldValues_t& node = cubic.fieldMap[ix + iy*cubic.nX + iz*cubic.nX*cubic.nY];
+          double field[3] = { 0.0, 0.0, 0.0 };
+          cubic.fieldComponents( pos, field );
+          maxNodeDeviation = std::max( maxNodeDeviation, std::fabs( field[0] - node.Bx ) );
+          maxNodeDeviation = std::max( maxNodeDeviation, std::fabs( field[1] - node.By ) );
+          maxNodeDeviation = std::max( maxNodeDeviation, std::fabs( field[2] - node.Bz ) );
+        }
+      }
+    }
+    std::stringstream msg;
+    msg << "FieldMapXYZ cubic at the grid nodes: maximum deviation " << maxNodeDeviation/dd4hep::tesla << " tesla";
+    test( maxNodeDeviation < 1e-9*dd4hep::tesla, msg.str() );
+
+    // compare away from the edges of the map, where the mirror boundary condition is not exact
+    std::mt19937 generator( 1234 );
+    std::uniform_real_distribution<double> xDist( linear.xMin + 3*linear.xStep, linear.xMax - 3*linear.xStep );
+    std::uniform_real_distribution<double> yDist( linear.yMin + 3*linear.yStep, linear.yMax - 3*linear.yStep );
+    std::uniform_real_distribution<double> zDist( linear.zMin + 3*linear.zStep, linear.zMax - 3*linear.zStep );
+    double maxLinear = 0.0, maxCubic = 0.0;
+    for(int i=0;i<10000;i++) {
+      const double pos[3] = { xDist( generator ), yDist( generator ), zDist( generator ) };
+      double B[3];
+      analyticField( pos[0], pos[1], pos[2], B );
+      double fieldLinear[3] = { 0.0, 0.0, 0.0 };
+      double fieldCubic[3]  = { 0.0, 0.0, 0.0 };
+      linear.fieldComponents( pos, fieldLinear );
+      cubic.fieldComponents( pos, fieldCubic );
+      for(int j=0;j<3;j++) {
+        maxLinear = std::max( maxLinear, std::fabs( fieldLinear[j] - B[j] ) );
+        maxCubic  = std::max( maxCubic,  std::fabs( fieldCubic[j]  - B[j] ) );
+      }
+    }
+    std::stringstream msgAccuracy;
+    msgAccuracy << "FieldMapXYZ cubic (" << maxCubic/dd4hep::tesla << " tesla) more accurate than linear ("
+                << maxLinear/dd4hep::tesla << " tesla)";
+    test( maxCubic < maxLinear, msgAccuracy.str() );
+
+    testBatch( cubic, randomPositions( 1001, cubic.xMax, cubic.zMax ), "FieldMapXYZ cubic" );
+  }
+
+  /// Positions along straight tracks with steps much shorter than the grid spacing, as (x,y,z) triplets
+  std::vector<double> trackPositions( int nTracks, int nSteps, double step, unsigned seed ) {
+    std::mt19937 generator( seed );
+    std::uniform_real_distribution<double> unit( -1.0, 1.0 );
+    std::vector<double> positions;
+    for(int i=0;i<nTracks;i++) {
+      double direction[3] = { unit( generator ), unit( generator ), unit( generator ) };
+      const double norm = std::sqrt( direction[0]*direction[0] + direction[1]*direction[1] + direction[2]*direction[2] );
+      for(int j=0;j<nSteps;j++) {
+        for(int k=0;k<3;k++) positions.push_back( j*step*direction[k]/norm );
+      }
+    }
+    return positions;
+  }
+
+  /// The last-cell cache gives the same field as the direct lookup, also when the map is shared between threads
+  template<typename FieldMap> void testCellCache( FieldMap& direct, FieldMap& cached, const std::string& name ) {
+
+    const int nThreads = 4;
+    const int nTracks = 100;
+    const int nSteps = 500;
+    std::vector<int> nDifferent( nThreads, 0 );
+    std::vector<std::thread> threads;
+    for(int t=0;t<nThreads;t++) {
+      threads.emplace_back( [&direct, &cached, &nDifferent, t]() {
+          const std::vector<double> positions = trackPositions( nTracks, nSteps, 1.5*dd4hep::mm, 100 + t );
+          for(std::size_t i=0;i<positions.size();i+=3) {
+            double fieldDirect[3] = { 0.0, 0.0, 0.0 };
+            double fieldCached[3] = { 0.0, 0.0, 0.0 };
+            direct.fieldComponents( &positions[i], fieldDirect );
+            cached.fieldComponents( &positions[i], fieldCached );
+            // allow for rounding where a position is on the edge of two cells
+            for(int j=0;j<3;j++) if( std::fabs( fieldDirect[j] - fieldCached[j] ) > 1e-12*dd4hep::tesla ) ++nDifferent[t];
+          }
+        } );
+    }
+    for( auto& thread : threads ) thread.join();
+
+    int nDifferentTotal = 0;
+    for( int n : nDifferent ) nDifferentTotal += n;
+    test( nDifferentTotal, 0, name + " last-cell cache vs direct lookup in " + std::to_string( nThreads ) + " threads" );
+
+    // the counters of the threads are added when the threads end
+    const uint64_t nLookups = cached.cellCacheCounters->hits() + cached.cellCacheCounters->misses();
+    test( nLookups == uint64_t( nThreads*nTracks*nSteps ), name + " last-cell cache counts all lookups" );
+    std::stringstream msg;
+    msg << name << " last-cell cache hit rate " << cached.cellCacheCounters->hitRate();
+    test( cached.cellCacheCounters->hitRate() > 0.8, msg.str() );
+
+    // the lookups of the calling thread are only added when it flushes its cell, as the destructor does
+    const std::vector<double> positions = trackPositions( 1, 100, 1.5*dd4hep::mm, 99 );
+    for(std::size_t i=0;i<positions.size();i+=3) {
+      double field[3] = { 0.0, 0.0, 0.0 };
+      cached.fieldComponents( &positions[i], field );
+    }
+    cached.flushCellCache();
+    const uint64_t nLookupsMain = cached.cellCacheCounters->hits() + cached.cellCacheCounters->misses();
+    test( nLookupsMain == nLookups + 100, name + " last-cell cache counts the lookups of the calling thread" );
+  }
+
+  void testXYZCellCache() {
+    FieldMapXYZ direct;
+    fillSyntheticMap( direct );
+    FieldMapXYZ cached;
+    fillSyntheticMap( cached );
+    cached.cellCacheCounters = std::make_shared<lcgeo::FieldMapCellCounters>();
+    testCellCache( direct, cached, "FieldMapXYZ" );
+  }
+
+  /// FieldMapBrBz field computed with the atan2, sin and cos projection of Br used before
+  void referenceBrBz( const FieldMapBrBz& map, const double* pos, double* B ) {
+    int bin0[2], bin1[2];
+    double frac[2];
+    if( not map.getCell( pos, bin0, bin1, frac ) ) return;
+    double field[2] = { 0.0, 0.0 };
+    map.interpolate( bin0, bin1, frac, field );
+    double phi = std::atan2( pos[1], pos[0] );
+    if( pos[2] < 0 ) phi += M_PI;
+    B[0] += field[0] * std::sin( phi );
+    B[1] += field[0] * std::cos( phi );
+    B[2] += field[1];
+  }
+
+  /// The projection of Br without transcendental functions agrees with the one used before
+  void testBrBzProjection() {
+    FieldMapBrBz map;
+    fillSyntheticMap( map );
+
+    // dense grid covering both signs of x, y and z, the axes and points outside of the map
+    const double tolerance = 1e-12*dd4hep::tesla;
+    const int nSteps = 40;
+    int nPoints = 0, nDifferent = 0;
+    for(int ix=-nSteps;ix<=nSteps;ix++) {
+      for(int iy=-nSteps;iy<=nSteps;iy++) {
+        for(int iz=-nSteps;iz<=nSteps;iz+=4) {
+          const double pos[3] = { ix*1.1*map.rhoMax/nSteps, iy*1.1*map.rhoMax/nSteps, iz*1.1*map.zMax/nSteps };
+          double field[3]     = { 0.0, 0.0, 0.0 };
+          double reference[3] = { 0.0, 0.0, 0.0 };
+          map.fieldComponents( pos, field );
+          referenceBrBz( map, pos, reference );
+          for(int j=0;j<3;j++) if( std::fabs( field[j] - reference[j] ) > tolerance ) ++nDifferent;
+          ++nPoints;
+        }
+      }
+    }
+    test( nDifferent, 0, "FieldMapBrBz projection vs atan2 projection on " + std::to_string( nPoints ) + " points" );
+
+    // negative z: phi is rotated by pi, the transverse field is mirrored and Bz is unchanged
+    int nMirrored = 0;
+    for(int i=0;i<8;i++) {
+      const double angle = 0.25*M_PI*i + 0.1;
+      const double pos[3]      = { 1.2*dd4hep::m*std::cos( angle ), 1.2*dd4hep::m*std::sin( angle ),  2.3*dd4hep::m };
+      const double mirrored[3] = { pos[0], pos[1], -pos[2] };
+      double field[3]          = { 0.0, 0.0, 0.0 };
+      double fieldMirrored[3]  = { 0.0, 0.0, 0.0 };
+      double reference[3]      = { 0.0, 0.0, 0.0 };
+      map.fieldComponents( pos, field );
+      map.fieldComponents( mirrored, fieldMirrored );
+      referenceBrBz( map, mirrored, reference );
+      if( fieldMirrored[0] == -field[0] && fieldMirrored[1] == -field[1] && fieldMirrored[2] == field[2] &&
+          std::fabs( fieldMirrored[0] - reference[0] ) <= tolerance &&
+          std::fabs( fieldMirrored[1] - reference[1] ) <= tolerance ) ++nMirrored;
+    }
+    test( nMirrored, 8, "FieldMapBrBz projection at negative z" );
+
+    // on the z axis, where atan2(0,0) gave phi = 0, for both signs of z. Use a map with Br != 0 on the axis
+    FieldMapBrBz offset;
+    fillSyntheticMap( offset );
+    for( auto& B : offset.fieldMap ) B.Br += 0.01*dd4hep::tesla;
+    for( double z : { 1.5*dd4hep::m, -1.5*dd4hep::m } ) {
+      const double pos[3] = { 0.0, 0.0, z };
+      double field[3]     = { 0.0, 0.0, 0.0 };
+      double reference[3] = { 0.0, 0.0, 0.0 };
+      offset.fieldComponents( pos, field );
+      referenceBrBz( offset, pos, reference );
+      test( std::fabs( field[0] - reference[0] ) <= tolerance && std::fabs( field[1] - reference[1] ) <= tolerance &&
+            field[2] == reference[2], "FieldMapBrBz projection on the z axis at z = " + std::to_string( z/dd4hep::m ) + " m" );
+    }
+  }
+
+  /// Field maps using the same file share one grid through the registry, each with its own bScale
+  void testRegistry() {
+
+    int nCreated = 0;
+    const std::function<std::shared_ptr<const FieldMapXYZ>()> create = [&nCreated]() {
+      ++nCreated;
+      std::shared_ptr<FieldMapXYZ> grid = std::make_shared<FieldMapXYZ>();
+      fillSyntheticMap( *grid );
+      return std::shared_ptr<const FieldMapXYZ>( grid );
+    };
+
+    const std::size_t nGrids = lcgeo::FieldMapRegistry::size();
+    {
+      FieldMapXYZ solenoid;
+      solenoid.bScale = 1.0;
+      solenoid.useSharedGrid( lcgeo::FieldMapRegistry::get<FieldMapXYZ>( "TestFieldMaps:grid", create ) );
+      FieldMapXYZ scaled;
+      scaled.bScale = -0.5;
+      scaled.useSharedGrid( lcgeo::FieldMapRegistry::get<FieldMapXYZ>( "TestFieldMaps:grid", create ) );
+      FieldMapXYZ other;
+      other.bScale = 1.0;
+      other.useSharedGrid( lcgeo::FieldMapRegistry::get<FieldMapXYZ>( "TestFieldMaps:other", create ) );
+
+      test( nCreated, 2, "FieldMapRegistry creates one grid per key" );
+      test( solenoid.fieldMapPtr == scaled.fieldMapPtr && solenoid.fieldMapPtr != other.fieldMapPtr, "FieldMapRegistry shares the points of one key" );
+      test( lcgeo::FieldMapRegistry::size() == nGrids + 2, "FieldMapRegistry holds the grids in use" );
+
+      const std::vector<double> positions = randomPositions( 1000, solenoid.xMax, solenoid.zMax );
+      int nDifferent = 0;
+      for(std::size_t i=0;i<positions.size();i+=3) {
+        double field[3]       = { 0.0, 0.0, 0.0 };
+        double fieldScaled[3] = { 0.0, 0.0, 0.0 };
+        solenoid.fieldComponents( &positions[i], field );
+        scaled.fieldComponents( &positions[i], fieldScaled );
+        for(int j=0;j<3;j++) if( fieldScaled[j] != -0.5*field[j] ) ++nDifferent;
+      }
+      test( nDifferent, 0, "FieldMapRegistry bScale applied at lookup" );
+    }
+
+    // the grids are released with the last field map using them, and created again afterwards
+    test( lcgeo::FieldMapRegistry::size() == nGrids, "FieldMapRegistry releases unused grids" );
+    lcgeo::FieldMapRegistry::get<FieldMapXYZ>( "TestFieldMaps:grid", create );
+    test( nCreated, 3, "FieldMapRegistry recreates released grids" );
+  }
+
+  /// The sum of an r-z and an x-y-z field baked into one grid
+  void testBaked() {
+    FieldMapBrBz solenoid;
+    fillSyntheticMap( solenoid );
+    FieldMapXYZ overlay;
+    fillSyntheticMap( overlay );
+    dd4hep::CartesianField solenoidField;
+    solenoidField.assign( &solenoid, "Solenoid", "FieldBrBz" );
+    dd4hep::CartesianField overlayField;
+    overlayField.assign( &overlay, "Overlay", "FieldXYZ" );
+
+    FieldMapXYZ baked;
+    baked.bScale = 1.0;
+    // a grid not aligned with the grids of the fields
+    baked.nX = 34; baked.xMin = -100*dd4hep::cm; baked.xStep =  6*dd4hep::cm; baked.xMax = baked.xMin + (baked.nX-1)*baked.xStep;
+    baked.nY = 27; baked.yMin =  -80*dd4hep::cm; baked.yStep =  6*dd4hep::cm; baked.yMax = baked.yMin + (baked.nY-1)*baked.yStep;
+    baked.nZ = 41; baked.zMin = -300*dd4hep::cm; baked.zStep = 15*dd4hep::cm; baked.zMax = baked.zMin + (baked.nZ-1)*baked.zStep;
+    baked.bakedFields = { solenoidField, overlayField };
+    baked.fillFieldMapFromFields( baked.bakedFields );
+
+    // the nodes hold the sum of the fields
+    int nDifferent = 0;
+    for(int iz=0;iz<baked.nZ;iz+=5) {
+      for(int iy=0;iy<baked.nY;iy+=4) {
+        for(int ix=0;ix<baked.nX;ix+=4) {
+          const double pos[3] = { baked.xMin + ix*baked.xStep, baked.yMin + iy*baked.yStep, baked.zMin + iz*baked.zStep };
+          double field[3] = { 0.0, 0.0, 0.0 };
+          double sum[3]   = { 0.0, 0.0, 0.0 };
+          baked.fieldComponents( pos, field );
+          solenoid.fieldComponents( pos, sum );
+          overlay.fieldComponents( pos, sum );
+          for(int j=0;j<3;j++) if( std::fabs( field[j] - sum[j] ) > 1e-12*dd4hep::tesla ) ++nDifferent;
+        }
+      }
+    }
+    test( nDifferent, 0, "FieldMapXYZ baked field at the grid nodes" );
+
+    // in between, the deviation is given by the interpolation of the baked grid
+    double worstPos[3];
+    const double maxDeviation = baked.maxDeviationFromFields( 10000, worstPos );
+    std::stringstream msg;
+    msg << "FieldMapXYZ baked field: maximum deviation from the sum " << maxDeviation/dd4hep::tesla << " tesla at ("
+        << worstPos[0]/dd4hep::cm << "," << worstPos[1]/dd4hep::cm << "," << worstPos[2]/dd4hep::cm << ") cm";
+    test( maxDeviation < 0.02*dd4hep::tesla, msg.str() );
+
+    // the cache of the baked field depends on the baked fields
+    const lcgeo::FieldMapCacheHeader header = baked.bakedCacheHeader();
+    test( baked.bakedCacheHeader().sourceChecksum == header.sourceChecksum, "FieldMapXYZ baked cache header reproducible" );
+    overlay.bScale = 1.1;
+    test( baked.bakedCacheHeader().sourceChecksum != header.sourceChecksum, "FieldMapXYZ baked cache header follows the baked fields" );
+
+    // a field map read from a file is identified by the file, not by the probes: a local change of
+    // the file which the probes miss changes the header
+    const std::string sourceFile( "TestFieldMaps_baked_source.dat" );
+    {
+      std::ofstream source( sourceFile );
+      source << "solenoid map source version 1" << std::endl;
+    }
+    solenoid.sourceFile        = sourceFile;
+    solenoid.sourceCoorUnits   = dd4hep::mm;
+    solenoid.sourceBfieldUnits = dd4hep::tesla;
+    const lcgeo::FieldMapCacheHeader fileHeader = baked.bakedCacheHeader();
+    test( baked.bakedCacheHeader().configChecksum == fileHeader.configChecksum, "FieldMapXYZ baked cache header with a source file reproducible" );
+    struct stat status;
+    stat( sourceFile.c_str(), &status );
+    {
+      std::ofstream source( sourceFile );
+      source << "solenoid map source version 2" << std::endl;
+    }
+    struct utimbuf times;
+    times.actime  = status.st_atime;
+    times.modtime = status.st_mtime + 10;
+    utime( sourceFile.c_str(), &times );
+    test( baked.bakedCacheHeader().configChecksum != fileHeader.configChecksum, "FieldMapXYZ baked cache header follows the source files" );
+    solenoid.sourceFile.clear();
+    std::remove( sourceFile.c_str() );
+  }
+
+  void testAdaptive() {
+    FieldMapBrBz solenoid;
+    fillSyntheticMap( solenoid );
+    FieldMapXYZ overlay;
+    fillSyntheticMap( overlay );
+    dd4hep::CartesianField solenoidField;
+    solenoidField.assign( &solenoid, "Solenoid", "FieldBrBz" );
+    dd4hep::CartesianField overlayField;
+    overlayField.assign( &overlay, "Overlay", "FieldXYZ" );
+
+    const double gridMin[3]  = { -100*dd4hep::cm,  -80*dd4hep::cm, -300*dd4hep::cm };
+    const double gridMax[3]  = {  100*dd4hep::cm,   80*dd4hep::cm,  260*dd4hep::cm };
+    const double gridStep[3] = {    5*dd4hep::cm,    5*dd4hep::cm,   10*dd4hep::cm };
+
+    FieldMapAdaptive adaptive;
+    adaptive.tolerance = 0.01*dd4hep::tesla;
+    adaptive.bakedFields = { solenoidField, overlayField };
+    adaptive.setGrid( gridMin, gridMax, gridStep, 4 );
+    adaptive.fillFromFields( adaptive.bakedFields );
+
+    std::stringstream sizeMsg;
+    sizeMsg << "FieldMapAdaptive uses " << adaptive.values.size() << " of " << adaptive.uniformSize() << " points of the uniform grid";
+    test( adaptive.values.size() < adaptive.uniformSize()/2, sizeMsg.str() );
+
+    // the blocks are checked at the finest nodes and cell centres, the interpolation of the
+    // synthetic maps in between adds little to the tolerance
+    double worstPos[3];
+    const double maxDeviation = adaptive.maxDeviationFromFields( 10000, worstPos );
+    std::stringstream msg;
+    msg << "FieldMapAdaptive: maximum deviation from the sum " << maxDeviation/dd4hep::tesla << " tesla at ("
+        << worstPos[0]/dd4hep::cm << "," << worstPos[1]/dd4hep::cm << "," << worstPos[2]/dd4hep::cm << ") cm";
+    test( maxDeviation < 1.5*adaptive.tolerance, msg.str() );
+
+    // the field is continuous across the faces of blocks of different resolution, with a larger
+    // tolerance the blocks have 2 or 4 cells per axis, which differ by up to the tolerance on their faces
+    FieldMapAdaptive conforming;
+    conforming.tolerance = 0.02*dd4hep::tesla;
+    conforming.bakedFields = { solenoidField, overlayField };
+    conforming.setGrid( gridMin, gridMax, gridStep, 4 );
+    conforming.fillFromFields( conforming.bakedFields );
+    test( conforming.maxDeviationFromFields( 10000 ) < 1.5*conforming.tolerance, "FieldMapAdaptive conforming faces within the tolerance" );
+    int nFaces = 0;
+    double maxJump = 0.0;
+    for(int bz=0;bz<conforming.nBlocks[2];bz++) {
+      for(int by=0;by<conforming.nBlocks[1];by++) {
+        for(int bx=0;bx<conforming.nBlocks[0];bx++) {
+          const int blk[3] = { bx, by, bz };
+          const std::size_t lower = bx + conforming.nBlocks[0]*(by + conforming.nBlocks[1]*bz);
+          for(int d=0;d<3;d++) {
+            if( blk[d] + 1 >= conforming.nBlocks[d] ) continue;
+            int next[3] = { bx, by, bz };
+            ++next[d];
+            const std::size_t upper = next[0] + conforming.nBlocks[0]*(next[1] + conforming.nBlocks[1]*next[2]);
+            if( conforming.blocks[lower].nCells == conforming.blocks[upper].nCells ) continue;
+            ++nFaces;
+            for(int a=0;a<=12;a++) {
+              for(int b=0;b<=12;b++) {
+                double lowerFrac[3], upperFrac[3];
+                lowerFrac[d] = 1.0;
+                upperFrac[d] = 0.0;
+                lowerFrac[(d + 1) % 3] = upperFrac[(d + 1) % 3] = a/12.0;
+                lowerFrac[(d + 2) % 3] = upperFrac[(d + 2) % 3] = b/12.0;
+                double lowerField[3] = { 0.0, 0.0, 0.0 }, upperField[3] = { 0.0, 0.0, 0.0 };
+                conforming.blockField( lower, lowerFrac, lowerField );
+                conforming.blockField( upper, upperFrac, upperField );
+                for(int j=0;j<3;j++) maxJump = std::max( maxJump, std::fabs( lowerField[j] - upperField[j] ) );
+              }
+            }
+          }
+        }
+      }
+    }
+    std::stringstream faceMsg;
+    faceMsg << "FieldMapAdaptive: " << nFaces << " faces between blocks of different resolution, maximum jump "
+            << maxJump/dd4hep::tesla << " tesla";
+    test( nFaces > 0 && maxJump < 1e-12*dd4hep::tesla, faceMsg.str() );
+
+    // with a vanishing tolerance the blocks of 4 cells per axis are reduced to the 2 cells per
+    // axis of the grid of the synthetic map, which is reproduced exactly
+    FieldMapAdaptive exact;
+    exact.tolerance = 1e-12*dd4hep::tesla;
+    exact.bakedFields = { overlayField };
+    exact.setGrid( gridMin, gridMax, gridStep, 3 );
+    exact.fillFromFields( exact.bakedFields );
+    test( exact.values.size(), std::size_t( exact.blocks.size()*3*3*3 ), "FieldMapAdaptive finds the grid of the source map" );
+    test( exact.maxDeviationFromFields( 10000 ) < 1e-12*dd4hep::tesla, "FieldMapAdaptive reproduces the source map" );
+
+    // a field linear in x, y and z is reproduced by one cell per block
+    FieldMapXYZ linear;
+    fillSyntheticMap( linear );
+    for(int iz=0;iz<linear.nZ;iz++) {
+      for(int iy=0;iy<linear.nY;iy++) {
+        for(int ix=0;ix<linear.nX;ix++) {
+          const double x = linear.xMin + ix*linear.xStep, y = linear.yMin + iy*linear.yStep, z = linear.zMin + iz*linear.zStep;
+          linear.fieldMap[ix + iy*linear.nX + iz*linear.nX*linear.nY] =
+            FieldMapXYZ::FieldValues_t( 0.1*dd4hep::tesla*x/dd4hep::m, -0.2*dd4hep::tesla*y/dd4hep::m, 3.5*dd4hep::tesla + 0.05*dd4hep::tesla*z/dd4hep::m );
+        }
+      }
+    }
+    linear.fieldMapPtr = linear.fieldMap.data();
+    dd4hep::CartesianField linearField;
+    linearField.assign( &linear, "Linear", "FieldXYZ" );
+    FieldMapAdaptive coarse;
+    coarse.tolerance = 1e-9*dd4hep::tesla;
+    coarse.bakedFields = { linearField };
+    coarse.setGrid( gridMin, gridMax, gridStep, 4 );
+    coarse.fillFromFields( coarse.bakedFields );
+    test( coarse.values.size(), std::size_t( coarse.blocks.size()*8 ), "FieldMapAdaptive linear field in one cell per block" );
+    test( coarse.maxDeviationFromFields( 10000 ) < 1e-9*dd4hep::tesla, "FieldMapAdaptive linear field reproduced" );
+
+    // bScale is applied at lookup, positions outside of the map add nothing
+    const double pos[3] = { 12*dd4hep::cm, -7*dd4hep::cm, 33*dd4hep::cm };
+    double field[3] = { 0.0, 0.0, 0.0 };
+    coarse.fieldComponents( pos, field );
+    coarse.bScale = 2.0;
+    double scaled[3] = { 0.0, 0.0, 0.0 };
+    coarse.fieldComponents( pos, scaled );
+    test( scaled[2], 2.0*field[2], "FieldMapAdaptive bScale" );
+    const double outside[3] = { 0.0, 0.0, 400*dd4hep::cm };
+    double none[3] = { 0.0, 0.0, 0.0 };
+    coarse.fieldComponents( outside, none );
+    test( none[2], 0.0, "FieldMapAdaptive outside of the map" );
+  }
+
+  void testBrBzBatch() {
+    FieldMapBrBz map;
+    fillSyntheticMap( map );
+    testBatch( map, randomPositions( 1001, map.rhoMax, map.zMax ), "FieldMapBrBz" );
+
+    FieldMapBrBz cubic;
+    fillSyntheticMap( cubic );
+    cubic.interpolation = 3;
+    cubic.fillSplineCoefficients();
+    double maxNodeDeviation = 0.0;
+    for(int iz=0;iz<cubic.nZ;iz++) {
+      for(int ir=0;ir<cubic.nRho;ir++) {
+        const double pos[3] = { 0.0, cubic.rhoMin + ir*cubic.rhoStep, cubic.zMin + iz*cubic.zStep };
+        double field[3] = { 0.0, 0.0, 0.0 };
+        cubic.fieldComponents( pos, field );
+        maxNodeDeviation = std::max( maxNodeDeviation, std::fabs( field[2] - cubic.fieldMap[ir + iz*cubic.nRho].Bz ) );
+      }
+    }
+    test( maxNodeDeviation < 1e-9*dd4hep::tesla, "FieldMapBrBz cubic at the grid nodes" );
+    testBatch( cubic, randomPositions( 1001, cubic.rhoMax, cubic.zMax ), "FieldMapBrBz cubic" );
+
+    FieldMapBrBz cached;
+    fillSyntheticMap( cached );
+    cached.cellCacheCounters = std::make_shared<lcgeo::FieldMapCellCounters>();
+    testCellCache( map, cached, "FieldMapBrBz" );
+  }
+
+}
+
+
+int main (int, char**) {
+
+  testXYZStorage();
+  testXYZCache();
+  testXYZCubic();
+  testXYZCellCache();
+  testRegistry();
+  testBaked();
+  testAdaptive();
+  testBrBzProjection();
+  testBrBzBatch();
+
+  return 0;
+}
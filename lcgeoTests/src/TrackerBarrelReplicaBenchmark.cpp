@@ -0,0 +1,154 @@
+// Build time and memory of a compact file with a DetElement for every sensor of the TrackerBarrel_o1_v05
+// barrels and with replicaSensors, and check the placements of TrackerBarrelReplicaData against the
+// VolumeManager for all sensors. Every mode is built in its own process, as the Detector is a singleton.
+
+#include "TrackerBarrelReplica.h"
+
+#include <DD4hep/DD4hepUnits.h>
+#include <DD4hep/Detector.h>
+#include <DD4hep/DetElement.h>
+#include <DD4hep/Objects.h>
+#include <DD4hep/VolumeManager.h>
+
+#include <TGeoMatrix.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock;
+
+  struct Result {
+    double buildTime = 0.0;     // ms
+    double memory = 0.0;        // MB
+    long nDetElements = 0;
+    long nSensors = 0;
+    long nMismatches = 0;
+  };
+
+  /// Resident memory of the process in MB
+  double residentMemory() {
+    long pages = 0, resident = 0;
+    FILE* statm = fopen( "/proc/self/statm", "r" );
+    if( not statm ) return 0.0;
+    if( fscanf( statm, "%ld %ld", &pages, &resident ) != 2 ) resident = 0;
+    fclose( statm );
+    return double( resident ) * sysconf( _SC_PAGESIZE ) / ( 1024.0 * 1024.0 );
+  }
+
+  /// Load the compact file and check the sensors of all detectors with a TrackerBarrelReplicaData
+  Result build( const std::string& compactFile, bool replicaSensors ) {
+    Result result;
+    dd4hep::Detector& theDetector = dd4hep::Detector::getInstance();
+    if( replicaSensors ) theDetector.addConstant( dd4hep::Constant( "TrackerBarrel_replicaSensors", "1" ) );
+
+    const double memoryBefore = residentMemory();
+    const Clock::time_point start = Clock::now();
+    theDetector.fromCompact( compactFile );
+    result.buildTime = std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+    result.memory = residentMemory() - memoryBefore;
+
+    dd4hep::VolumeManager volumeManager = dd4hep::VolumeManager::getVolumeManager( theDetector );
+    std::vector<dd4hep::DetElement> elements( 1, theDetector.world() );
+    while( not elements.empty() ) {
+      dd4hep::DetElement det = elements.back();
+      elements.pop_back();
+      ++result.nDetElements;
+      for( const auto& child : det.children() ) elements.push_back( child.second );
+
+      const lcgeo::TrackerBarrelReplicaData* replica = det.extension<lcgeo::TrackerBarrelReplicaData>( false );
+      if( not replica ) continue;
+      for( std::size_t layer=0;layer<replica->layers.size();layer++ ) {
+        for( int module=0;module<replica->layers[layer].nModules;module++ ) {
+          for( int sensor=0;sensor<replica->layers[layer].nSensors;sensor++ ) {
+            ++result.nSensors;
+            const dd4hep::CellID cellID = replica->cellID( layer, module, sensor );
+            TGeoHMatrix matrix;
+            const dd4hep::VolumeManagerContext* context = volumeManager.lookupContext( cellID );
+            if( not context or not replica->worldTransformation( cellID, matrix ) ) {
+              ++result.nMismatches;
+              continue;
+            }
+            TGeoHMatrix expected = context->element.nominal().worldTransformation();
+            expected.Multiply( &context->toElement() );
+            for( int i=0;i<3;i++ ) {
+              if( std::fabs( matrix.GetTranslation()[i] - expected.GetTranslation()[i] ) > 1e-6*dd4hep::mm ) {
+                ++result.nMismatches;
+                break;
+              }
+            }
+          }
+        }
+      }
+    }
+    return result;
+  }
+
+  /// Run build in a child process and read its result through a pipe
+  bool buildInChild( const std::string& compactFile, bool replicaSensors, Result& result ) {
+    int fd[2];
+    if( pipe( fd ) != 0 ) return false;
+    const pid_t pid = fork();
+    if( pid < 0 ) return false;
+    if( pid == 0 ) {
+      close( fd[0] );
+      const Result childResult = build( compactFile, replicaSensors );
+      const bool written = write( fd[1], &childResult, sizeof( childResult ) ) == sizeof( childResult );
+      close( fd[1] );
+      _exit( written ? 0 : 1 );
+    }
+    close( fd[1] );
+    const bool complete = read( fd[0], &result, sizeof( result ) ) == sizeof( result );
+    close( fd[0] );
+    int status = 0;
+    waitpid( pid, &status, 0 );
+    return complete and WIFEXITED( status ) and WEXITSTATUS( status ) == 0;
+  }
+
+}
+
+
+int main (int argc, char **args) {
+
+  if ( argc < 2 ){
+    std::cout << "Usage: TrackerBarrelReplicaBenchmark <compact file name>.xml\n";
+    exit(1);
+  }
+  const std::string compactFile = std::string(args[1]);
+
+  Result results[2];
+  for( int replicaSensors=0;replicaSensors<2;replicaSensors++ ) {
+    if( not buildInChild( compactFile, replicaSensors, results[replicaSensors] ) ) {
+      std::cout << "ERROR: building " << compactFile << ( replicaSensors ? " with" : " without" ) << " replicaSensors failed" << std::endl;
+      return 1;
+    }
+  }
+
+  std::cout << compactFile << ": " << results[0].nSensors << " sensors in TrackerBarrel_o1_v05 barrels" << std::endl;
+  std::cout << std::setw(20) << std::left << "" << std::right << std::setw(14) << "build [ms]" << std::setw(14) << "memory [MB]"
+            << std::setw(14) << "DetElements" << std::endl;
+  const char* names[2] = { "DetElements", "replicaSensors" };
+  for( int replicaSensors=0;replicaSensors<2;replicaSensors++ ) {
+    const Result& r = results[replicaSensors];
+    std::cout << std::setw(20) << std::left << names[replicaSensors] << std::right << std::fixed << std::setprecision(1)
+              << std::setw(14) << r.buildTime << std::setw(14) << r.memory << std::setw(14) << r.nDetElements << std::endl;
+  }
+
+  if( results[0].nSensors != results[1].nSensors or results[0].nMismatches > 0 or results[1].nMismatches > 0 ) {
+    std::cout << "ERROR: TrackerBarrelReplicaData and the VolumeManager differ for " << results[0].nMismatches << " and "
+              << results[1].nMismatches << " sensors" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
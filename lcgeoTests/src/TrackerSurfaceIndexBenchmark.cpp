@@ -0,0 +1,198 @@
+// Compare the TrackerSurfaceIndex with the linear scan of the surface list for the surfaces of the
+// trackers of a compact file: surfaces crossed by helices from the IP and by chords through the cylinders,
+// and the nearest surface to random points
+
+#include "TrackerSurfaceIndex.h"
+
+#include <DD4hep/DD4hepUnits.h>
+#include <DD4hep/DetType.h>
+#include <DD4hep/Detector.h>
+#include <DDRec/SurfaceHelper.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <list>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock;
+  typedef dd4hep::rec::Vector3D Vector3D;
+  typedef lcgeo::TrackerSurfaceIndex::Surface Surface;
+
+  double elapsedMilliseconds( const Clock::time_point& start ) {
+    return std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+  }
+
+  /// Chords of a helix from the IP with the given transverse momentum in a solenoid field bz, up to the path length
+  std::vector<Vector3D> helix( double pt, double phi0, double cotTheta, int charge, double bz, double length, int nChords ) {
+    const double radius = pt / ( 0.3 * bz / dd4hep::tesla ) * dd4hep::m / dd4hep::GeV;
+    const double sinTheta = 1.0 / std::sqrt( 1.0 + cotTheta*cotTheta );
+    std::vector<Vector3D> points;
+    for( int i=0;i<=nChords;i++ ) {
+      const double s = length * i / nChords * sinTheta;  // transverse path length
+      const double alpha = charge * s / radius;
+      const double x = radius * charge * ( std::sin( phi0 + alpha ) - std::sin( phi0 ) );
+      const double y = -radius * charge * ( std::cos( phi0 + alpha ) - std::cos( phi0 ) );
+      points.push_back( Vector3D( x, y, s * cotTheta ) );
+    }
+    return points;
+  }
+
+  /// Same set of surfaces, a surface through a chord end is reported twice by the linear scan of the chords
+  bool sameSurfaces( std::vector<const Surface*> a, std::vector<const Surface*> b ) {
+    std::sort( a.begin(), a.end() );
+    std::sort( b.begin(), b.end() );
+    a.erase( std::unique( a.begin(), a.end() ), a.end() );
+    b.erase( std::unique( b.begin(), b.end() ), b.end() );
+    return a == b;
+  }
+
+}
+
+
+int main (int argc, char **args) {
+
+  if ( argc < 2 ){
+    std::cout << "Usage: TrackerSurfaceIndexBenchmark <compact file name>.xml [tracks] [points] [field in tesla]\n";
+    exit(1);
+  }
+  const std::string compactFile = std::string(args[1]);
+  const int nTracks = ( argc > 2 ? atoi(args[2]) : 10000 );
+  const int nPoints = ( argc > 3 ? atoi(args[3]) : 100000 );
+  const double bz = ( argc > 4 ? atof(args[4]) : 4.0 ) * dd4hep::tesla;
+
+  dd4hep::Detector& theDetector = dd4hep::Detector::getInstance();
+  theDetector.fromCompact( compactFile );
+
+  //The surfaces of all trackers, the helpers own them and have to live as long as the index
+  std::list<Surface*> surfaces;
+  std::vector<dd4hep::rec::SurfaceHelper*> helpers;
+  double rMax = 0.0, zMax = 0.0;
+  for( const auto& entry : theDetector.detectors() ) {
+    dd4hep::DetElement det = entry.second;
+    if( not dd4hep::DetType( det.typeFlag() ).is( dd4hep::DetType::TRACKER ) ) continue;
+    helpers.push_back( new dd4hep::rec::SurfaceHelper( det ) );
+    for( Surface* surface : helpers.back()->surfaceList() ) {
+      surfaces.push_back( surface );
+      rMax = std::max( rMax, surface->origin().rho() );
+      zMax = std::max( zMax, std::fabs( surface->origin().z() ) );
+    }
+  }
+  if( surfaces.empty() ) {
+    std::cout << "No tracker surfaces in " << compactFile << std::endl;
+    return 1;
+  }
+
+  Clock::time_point start = Clock::now();
+  const lcgeo::TrackerSurfaceIndex index( surfaces );
+  const double buildTime = elapsedMilliseconds( start );
+
+  //Helices up to the outer radius of the trackers, the chords are 1 cm long
+  std::mt19937 generator( 4711 );
+  std::uniform_real_distribution<double> phi( 0.0, 2.0*M_PI );
+  std::uniform_real_distribution<double> cotTheta( -3.0, 3.0 );
+  std::uniform_real_distribution<double> logPt( std::log( 0.5 ), std::log( 100.0 ) );
+  const double length = std::sqrt( rMax*rMax + zMax*zMax );
+  const int nChords = std::max( 1, int( length / dd4hep::cm ) );
+  std::vector<std::vector<Vector3D> > tracks;
+  for( int t=0;t<nTracks;t++ ) {
+    tracks.push_back( helix( std::exp( logPt( generator ) )*dd4hep::GeV, phi( generator ), cotTheta( generator ), ( t % 2 ? 1 : -1 ),
+                             bz, length, nChords ) );
+  }
+
+  int nMismatches = 0;
+  std::size_t nCrossed = 0;
+  std::vector<std::vector<const Surface*> > crossedIndex( nTracks ), crossedLinear( nTracks );
+  start = Clock::now();
+  for( int t=0;t<nTracks;t++ ) {
+    index.crossed( tracks[t], crossedIndex[t] );
+    nCrossed += crossedIndex[t].size();
+  }
+  const double crossedTime = elapsedMilliseconds( start );
+  start = Clock::now();
+  for( int t=0;t<nTracks;t++ ) {
+    for( std::size_t i=1;i<tracks[t].size();i++ ) index.crossedLinear( tracks[t][i-1], tracks[t][i], crossedLinear[t] );
+  }
+  const double crossedLinearTime = elapsedMilliseconds( start );
+  for( int t=0;t<nTracks;t++ ) {
+    if( not sameSurfaces( crossedIndex[t], crossedLinear[t] ) ) ++nMismatches;
+  }
+
+  //Chords through the cylinders, e.g. the pad rows of a TPC: with both ends outside of the cylinder and
+  //the closest approach to the axis inside, a straight segment enters and leaves it, it is crossed twice
+  int nCylinders = 0, nChordMismatches = 0;
+  for( Surface* surface : surfaces ) {
+    if( not surface->type().isCylinder() ) continue;
+    ++nCylinders;
+    double zLow = std::numeric_limits<double>::max(), zHigh = -std::numeric_limits<double>::max();
+    for( const auto& line : surface->getLines() ) {
+      zLow  = std::min( { zLow,  line.first.z(), line.second.z() } );
+      zHigh = std::max( { zHigh, line.first.z(), line.second.z() } );
+    }
+    if( zLow > zHigh ) zLow = zHigh = surface->origin().z();
+    const double radius = surface->origin().rho();
+    const double angle = phi( generator );
+    const Vector3D centre( 0.0, 0.0, 0.5*( zLow + zHigh ) );
+    const Vector3D direction( std::cos( angle ), std::sin( angle ), 0.0 );
+    const Vector3D offset( -std::sin( angle ), std::cos( angle ), 0.0 );
+    const Vector3D chordStart = centre + 0.5*radius*offset + ( -1.5*radius )*direction;
+    const Vector3D chordEnd   = centre + 0.5*radius*offset + 1.5*radius*direction;
+    std::vector<const Surface*> chordIndex, chordLinear;
+    index.crossed( chordStart, chordEnd, chordIndex );
+    index.crossedLinear( chordStart, chordEnd, chordLinear );
+    if( std::count( chordIndex.begin(), chordIndex.end(), surface ) != 2 or
+        std::count( chordLinear.begin(), chordLinear.end(), surface ) != 2 ) ++nChordMismatches;
+  }
+
+  //Random points inside of the trackers
+  std::uniform_real_distribution<double> coordinate( -1.0, 1.0 );
+  std::vector<Vector3D> points;
+  for( int p=0;p<nPoints;p++ ) points.push_back( Vector3D( rMax*coordinate( generator ), rMax*coordinate( generator ), zMax*coordinate( generator ) ) );
+  std::vector<double> nearestDistance( nPoints ), nearestLinearDistance( nPoints );
+  start = Clock::now();
+  for( int p=0;p<nPoints;p++ ) index.nearest( points[p], &nearestDistance[p] );
+  const double nearestTime = elapsedMilliseconds( start );
+  start = Clock::now();
+  for( int p=0;p<nPoints;p++ ) index.nearestLinear( points[p], &nearestLinearDistance[p] );
+  const double nearestLinearTime = elapsedMilliseconds( start );
+  for( int p=0;p<nPoints;p++ ) {
+    if( nearestDistance[p] != nearestLinearDistance[p] ) ++nMismatches;
+  }
+
+  std::cout << compactFile << ": " << index.size() << " tracker surfaces, " << index.nNodes() << " nodes, built in "
+            << std::fixed << std::setprecision(1) << buildTime << " ms" << std::endl;
+  std::cout << nTracks << " helices of " << nChords << " chords, " << std::setprecision(1) << double( nCrossed )/nTracks
+            << " crossed surfaces per helix" << std::endl;
+  std::cout << std::setw(30) << std::left << "crossed, index" << std::right << std::setw(12) << std::setprecision(2)
+            << 1e3*crossedTime/nTracks << " us/helix" << std::endl;
+  std::cout << std::setw(30) << std::left << "crossed, linear scan" << std::right << std::setw(12)
+            << 1e3*crossedLinearTime/nTracks << " us/helix" << std::endl;
+  std::cout << std::setw(30) << std::left << "nearest, index" << std::right << std::setw(12)
+            << 1e3*nearestTime/nPoints << " us/point" << std::endl;
+  std::cout << std::setw(30) << std::left << "nearest, linear scan" << std::right << std::setw(12)
+            << 1e3*nearestLinearTime/nPoints << " us/point" << std::endl;
+
+  std::cout << nCylinders << " cylinders crossed twice by a chord, " << nChordMismatches << " of them not" << std::endl;
+
+  for( auto* helper : helpers ) delete helper;
+
+  if( nChordMismatches > 0 ) {
+    std::cout << "ERROR: " << nChordMismatches << " cylinders not crossed twice by a chord through them" << std::endl;
+    return 1;
+  }
+
+  if( nMismatches > 0 ) {
+    std::cout << "ERROR: the index gives different surfaces than the linear scan for " << nMismatches << " queries" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -5,6 +5,14 @@
 #include "G4OpticalPhoton.hh"
 #include "G4VProcess.hh"
 
+#include "CaloHitIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+
 #if DD4HEP_VERSION_GE(1, 21)
 #define GEANT4_CONST_STEP const
 #else
@@ -22,6 +30,25 @@ namespace dd4hep {
      *  case of a calorimeter that has a pre-shower layer, i.e. one sensitive layer before
      *  the first absorber layer. This is for example used in the ILD Ecal. 
      *  Hits from the first layer are stored in a separate collection named READOUT_NAME_preShower.
+     *  The hits of all collections are indexed by cellID for the duration of the event.
+     *
+     *  Instead of the pre-shower layer, the hits can be split into several collections by layer,
+     *  with the string constant READOUT_NAME_LayerCollections in the compact file holding entries
+     *  collection:first:last separated by spaces, e.g.
+     *    <constant name="EcalBarrelCollection_LayerCollections" type="string"
+     *              value="EcalBarrelCollectionFront:1:10 EcalBarrelCollectionBack:11:30"/>
+     *  Hits of layers outside of the ranges go to the collection READOUT_NAME. The collections are
+     *  defined when the action is constructed, before steering properties are applied, so the
+     *  routing is taken from the compact file and not from properties. The ranges are turned into
+     *  a table of collections by layer when the collections are defined.
+     *
+     *  Optionally the truth contributions of a hit are compacted: with TruthMergeTimeBin > 0 the
+     *  contributions of the same track and PDG code in the same time bin are merged into one, and
+     *  with MaxTruthContributions > 0, once a hit has that many contributions, further deposits of a
+     *  track are added to the last contribution of that track. The limit is soft: a track without a
+     *  contribution in the hit still gets a new one, so no deposit is attributed to another track.
+     *  The deposits and lengths of all steps stay in the contributions, merged contributions keep
+     *  the earliest time and the position and momentum of the first step stored in them.
      *
      *  \author  F.Gaede
      *  \version 1.0
@@ -31,11 +58,69 @@ namespace dd4hep {
       G4int _preShowerCollectionID ;
       G4int _firstLayerNumber ; 
       Geant4HitCollection *_preShowerCollection;
+      const BitFieldElement* _layerField ;           // layer field of the readout, resolved once in initialize
+      std::vector<int> _layerRanges ;                // first and last layer of each routed collection, from the compact file
+      std::vector<std::string> _layerCollections ;   // names of the routed collections, from the compact file
+      std::vector<int> _layerSlots ;                 // slot of the collection by layer, empty without ranges
+      std::vector<int> _collectionIDs ;              // collection IDs by slot, slot 0 is the READOUT_NAME collection
+      std::vector< lcgeo::CaloHitIndex<Hit> > _hitIndices ; // hits by cellID for each slot
+      double _truthMergeTimeBin ;                    // time bin for merging truth contributions, no merging if <= 0
+      int _maxTruthContributions ;                   // soft limit of the truth contributions per hit, unbounded if <= 0
+      long _nStepContributions ;                     // contributions of the steps in this event
+      long _nTruthContributions ;                    // contributions stored in the hits in this event
       CalorimeterWithPreShowerLayer() : Geant4Calorimeter(), 
 					_preShowerCollectionID(0),
 					_firstLayerNumber(1), //fixme: can we make this a parameter ?
-					_preShowerCollection(0)
+					_preShowerCollection(0),
+					_layerField(0),
+					_truthMergeTimeBin(0),
+					_maxTruthContributions(0),
+					_nStepContributions(0),
+					_nTruthContributions(0)
       {}
+
+      /// Slot of the collection for the hits of the given layer
+      int slot( int layer ) const {
+        if( _layerSlots.empty() ) return ( layer == _firstLayerNumber ? 1 : 0 ) ;
+        return ( layer >= 0 && layer < int(_layerSlots.size()) ? _layerSlots[layer] : 0 ) ;
+      }
+
+      /// Reserve the truth contributions of a new hit, so that a bounded truth does not grow in small steps
+      void reserveTruth( Hit* hit ) const {
+        if( _maxTruthContributions > 0 ) hit->truth.reserve( std::min( _maxTruthContributions, 16 ) ) ;
+      }
+
+      /// Add the contribution of a step to the truth of the hit, merging it if compaction is enabled
+      void addContribution( Hit* hit, const HitContribution& contrib ) {
+        std::vector<HitContribution>& truth = hit->truth ;
+        ++_nStepContributions ;
+        HitContribution* merged = 0 ;
+        if( _truthMergeTimeBin > 0 ) {
+          const double bin = std::floor( contrib.time / _truthMergeTimeBin ) ;
+          for( auto it = truth.rbegin() ; it != truth.rend() ; ++it ) {
+            if( it->trackID == contrib.trackID && it->pdgID == contrib.pdgID && std::floor( it->time / _truthMergeTimeBin ) == bin ) {
+              merged = &*it ;
+              break ;
+            }
+          }
+        }
+        if( !merged && _maxTruthContributions > 0 && int(truth.size()) >= _maxTruthContributions ) {
+          for( auto it = truth.rbegin() ; it != truth.rend() ; ++it ) {
+            if( it->trackID == contrib.trackID ) {
+              merged = &*it ;
+              break ;
+            }
+          }
+        }
+        if( merged ) {
+          merged->deposit += contrib.deposit ;
+          merged->length  += contrib.length ;
+          merged->time = std::min( merged->time, contrib.time ) ;
+        } else {
+          truth.push_back( contrib ) ;
+          ++_nTruthContributions ;
+        }
+      }
     };
 
 
@@ -43,14 +128,46 @@ namespace dd4hep {
 
    /// Define collections created by this sensitivie action object
     template <> void Geant4SensitiveAction<CalorimeterWithPreShowerLayer>::defineCollections() {
+      CalorimeterWithPreShowerLayer& data = m_userData ;
       std::string name = m_sensitive.readout().name() ;
       m_collectionID = defineCollection<CalorimeterWithPreShowerLayer::Hit>(name);
-      name += std::string("_preShower") ;
-      m_userData._preShowerCollectionID = defineCollection<CalorimeterWithPreShowerLayer::Hit>( name );
+      data._collectionIDs.assign( 1, m_collectionID ) ;
+      data._layerSlots.clear() ;
+
+      if( data._layerRanges.empty() && data._layerCollections.empty() ) {
+        name += std::string("_preShower") ;
+        data._preShowerCollectionID = defineCollection<CalorimeterWithPreShowerLayer::Hit>( name );
+        data._collectionIDs.push_back( data._preShowerCollectionID ) ;
+      } else {
+        for( std::size_t i=0 ; i<data._layerCollections.size() ; ++i ) {
+          const int first = data._layerRanges[2*i] ;
+          const int last  = data._layerRanges[2*i+1] ;
+          if( first < 0 || last < first ) {
+            except("+++ Invalid layer range %d to %d for the collection %s", first, last, data._layerCollections[i].c_str());
+          }
+          if( int(data._layerSlots.size()) <= last ) data._layerSlots.resize( last+1, 0 ) ;
+          const int slot = data._collectionIDs.size() ;
+          for( int layer=first ; layer<=last ; ++layer ) {
+            if( data._layerSlots[layer] != 0 ) {
+              except("+++ Layer %d is in more than one range of %s_LayerCollections", layer, m_sensitive.readout().name());
+            }
+            data._layerSlots[layer] = slot ;
+          }
+          data._collectionIDs.push_back( defineCollection<CalorimeterWithPreShowerLayer::Hit>( data._layerCollections[i] ) ) ;
+        }
+      }
+      data._hitIndices.resize( data._collectionIDs.size() ) ;
     }
 
 
-    /// template specialization for c'tor in order to define property: FirstLayerNumber
+    /// Initialization overload for specialization: resolve the layer field of the readout once
+    template <> void Geant4SensitiveAction<CalorimeterWithPreShowerLayer>::initialize() {
+      IDDescriptor idspec = m_sensitive.readout().idSpec() ;
+      m_userData._layerField = idspec.field( "layer" ) ;
+    }
+
+    /// template specialization for c'tor in order to define properties: FirstLayerNumber, TruthMergeTimeBin and
+    /// MaxTruthContributions, and to read the layer routing from the compact file
     template <> 
     Geant4SensitiveAction<CalorimeterWithPreShowerLayer>::Geant4SensitiveAction(Geant4Context* ctxt,
 										const std::string& nam,
@@ -58,10 +175,57 @@ namespace dd4hep {
 										Detector& lcdd_ref)
       : Geant4Sensitive(ctxt,nam,det,lcdd_ref), m_collectionID(0)
     {
+      declareProperty("FirstLayerNumber", m_userData._firstLayerNumber = 1 );
+      declareProperty("TruthMergeTimeBin", m_userData._truthMergeTimeBin = 0 );
+      declareProperty("MaxTruthContributions", m_userData._maxTruthContributions = 0 );
+
+      // entries collection:first:last of READOUT_NAME_LayerCollections
+      const std::string routing = m_sensitive.readout().name() + std::string("_LayerCollections") ;
+      if( lcdd_ref.constants().count( routing ) ) {
+        std::istringstream entries( lcdd_ref.constantAsString( routing ) ) ;
+        std::string entry ;
+        while( entries >> entry ) {
+          const std::size_t first = entry.find(':') ;
+          const std::size_t last  = entry.rfind(':') ;
+          if( first == std::string::npos || first == last || first == 0 ) {
+            except("+++ Invalid entry %s of %s, expected collection:first:last", entry.c_str(), routing.c_str());
+          }
+          // the layer numbers must be integers without any other characters
+          auto layerNumber = [&]( const std::string& text ) {
+            std::istringstream number( text ) ;
+            int layer = 0 ;
+            char trailing ;
+            if( !( number >> std::noskipws >> layer ) || ( number >> trailing ) ) {
+              except("+++ Invalid layer number '%s' in the entry %s of %s", text.c_str(), entry.c_str(), routing.c_str());
+            }
+            return layer ;
+          } ;
+          m_userData._layerCollections.push_back( entry.substr( 0, first ) ) ;
+          m_userData._layerRanges.push_back( layerNumber( entry.substr( first+1, last-first-1 ) ) ) ;
+          m_userData._layerRanges.push_back( layerNumber( entry.substr( last+1 ) ) ) ;
+        }
+      }
       initialize();
       defineCollections();
       InstanceCount::increment(this);
-      declareProperty("FirstLayerNumber", m_userData._firstLayerNumber = 1 );
+    }
+
+    /// The collections are new in every event, start with empty hit indices
+    template <> void Geant4SensitiveAction<CalorimeterWithPreShowerLayer>::begin(G4HCofThisEvent* hce) {
+      for( auto& index : m_userData._hitIndices ) index.clear() ;
+      Geant4Sensitive::begin(hce);
+    }
+
+    /// The collections are handed over at the end of the event, forget their hits
+    template <> void Geant4SensitiveAction<CalorimeterWithPreShowerLayer>::end(G4HCofThisEvent* hce) {
+      for( auto& index : m_userData._hitIndices ) index.clear() ;
+      if( m_userData._truthMergeTimeBin > 0 || m_userData._maxTruthContributions > 0 ) {
+        printM1("%s> kept %ld truth contributions of %ld steps", c_name(),
+                m_userData._nTruthContributions, m_userData._nStepContributions);
+      }
+      m_userData._nStepContributions = 0 ;
+      m_userData._nTruthContributions = 0 ;
+      Geant4Sensitive::end(hce);
     }
 
     /// Method for generating hit(s) using the information of G4Step object.
@@ -92,13 +256,13 @@ namespace dd4hep {
       }
 
       // get the layer number by decoding the cellID
-      IDDescriptor idspec = m_sensitive.readout().idSpec() ;
-      const DDSegmentation::BitFieldCoder& bc = *idspec.decoder() ;
-      int layer = bc.get(cell, "layer") ;
+      int layer = m_userData._layerField->value( cell ) ;
       
-      Geant4HitCollection*  coll = ( layer== m_userData._firstLayerNumber ?  collection( m_userData._preShowerCollectionID ) : collection(m_collectionID) ) ;
+      const int slot = m_userData.slot( layer ) ;
+      Geant4HitCollection*  coll = collection( m_userData._collectionIDs[slot] ) ;
+      lcgeo::CaloHitIndex<Hit>& index = m_userData._hitIndices[slot] ;
       
-      Hit* hit = coll->find<Hit>(CellIDCompare<Hit>(cell));
+      Hit* hit = index.find(cell);
       if ( h.totalEnergy() < std::numeric_limits<double>::epsilon() )  {
         return true;
       }
@@ -108,7 +272,9 @@ namespace dd4hep {
         Position global = h.localToGlobal(pos);
         hit = new Hit(global);
         hit->cellID = cell;
+        m_userData.reserveTruth(hit);
         coll->add(hit);
+        index.add(cell, hit);
         printM2("%s> CREATE hit with deposit:%e MeV  Pos:%8.2f %8.2f %8.2f  %s",
                 c_name(),contrib.deposit,pos.X,pos.Y,pos.Z,handler.path().c_str());
         if ( 0 == hit->cellID )  { // for debugging only!
@@ -116,7 +282,7 @@ namespace dd4hep {
           except("+++ Invalid CELL ID for hit!");
         }
       }
-      hit->truth.push_back(contrib);
+      m_userData.addContribution(hit, contrib);
       hit->energyDeposit += contrib.deposit;
       mark(step);
       return true;
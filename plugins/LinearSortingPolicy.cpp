@@ -12,7 +12,8 @@
 //
 // Adds the sorting policy variable to surface DetElements following a
 // linear function, surfaces are selected depending on the placement path
-// of their DetElement
+// of their DetElement. The DetElement tree is walked once, matching the
+// paths of the DetElements instead of the paths of all surfaces
 //
 //==========================================================================
 
@@ -22,11 +23,11 @@
 #include <DD4hep/Printout.h>
 
 #include <DDRec/DetectorData.h>
-#include <DDRec/SurfaceHelper.h>
+#include <DDRec/Surface.h>
 
-#include <map>
+#include <cmath>
 #include <string>
-#include <tuple>
+#include <utility>
 #include <vector>
 
 using dd4hep::DetElement;
@@ -73,40 +74,59 @@ namespace {
       }
     }
 
-    auto world = description.world();
-
-    dd4hep::rec::SurfaceHelper ds( world );
-    dd4hep::rec::SurfaceList const& detSL = ds.surfaceList();
-    for(dd4hep::rec::ISurface* surf: detSL){
-      dd4hep::Volume volume = ((dd4hep::rec::Surface*)surf)->volume();
-      auto* ddsurf  = ((dd4hep::rec::Surface*)surf);
-      auto const volumeName = std::string(volume->GetName());
-      if(not ddsurf->detElement().isValid()) continue;
-      std::string path = ddsurf->detElement().path();
-      for (auto const& pathAndValues : pathToLinear) {
-        if(path.find(pathAndValues.first) != std::string::npos) {
-          std::vector<double> const& parameters = pathAndValues.second;
-          double zPosition = std::fabs(surf->origin()[2]);
-          double rValue = parameters.at(2) * (zPosition-parameters.at(0)) + parameters.at(1);
-
-          dd4hep::rec::DoubleParameters* para = nullptr;
-          try { // use existing map, or create a new one
-            para = ddsurf->detElement().extension<dd4hep::rec::DoubleParameters>();
-            para->doubleParameters["SortingPolicy"] = rValue;
-          } catch(...){
-            para = new dd4hep::rec::DoubleParameters;
-            para->doubleParameters["SortingPolicy"] = rValue;
-            ddsurf->detElement().addExtension<dd4hep::rec::DoubleParameters>(para);
-          }
-          printout(PrintLevel::DEBUG, LOG_SOURCE, "Added extension to %s, matching %s "
-                   " path %s, type %s, zPos %3.5f, value %3.5f",
-                   volumeName.c_str(), pathAndValues.first.c_str(),
-                   ddsurf->detElement().path().c_str(),
-                   ddsurf->detElement().type().c_str(),
-                   zPosition, para->doubleParameters["SortingPolicy"]);
+    // walk the DetElement tree once: the path of a DetElement is built from the path of its parent
+    // and the first matching pattern is found once per DetElement. A DetElement matches at least the
+    // pattern of its parent, as its path contains the path of the parent, so only the patterns before
+    // that have to be tried
+    const int noMatch = pathToLinear.size();
+    const bool debug = dd4hep::printLevel() <= PrintLevel::DEBUG;
+    struct Node {
+      DetElement det;
+      std::string path;
+      int parentMatch;
+    };
+    DetElement world = description.world();
+    std::vector<Node> stack { { world, world.path(), noMatch } };
+    while(not stack.empty()) {
+      Node node = std::move(stack.back());
+      stack.pop_back();
+
+      int match = node.parentMatch;
+      for(int i=0; i<node.parentMatch; ++i) {
+        if(node.path.find(pathToLinear[i].first) != std::string::npos) {
+          match = i;
           break;
         }
-      }// for all paths
+      }
+
+      for(auto const& child: node.det.children()) {
+        stack.push_back({ child.second, node.path + "/" + child.first, match });
+      }
+
+      if(match == noMatch) continue;
+      const dd4hep::rec::VolSurfaceList* volSurfaces = node.det.extension<dd4hep::rec::VolSurfaceList>(false);
+      if(not volSurfaces or volSurfaces->empty()) continue;
+
+      // the last surface of the DetElement sets the value, like for the surfaces of the SurfaceHelper
+      std::vector<double> const& parameters = pathToLinear[match].second;
+      dd4hep::rec::Surface surf(node.det, volSurfaces->back());
+      double zPosition = std::fabs(surf.origin()[2]);
+      double rValue = parameters.at(2) * (zPosition-parameters.at(0)) + parameters.at(1);
+
+      // use existing map, or create a new one
+      dd4hep::rec::DoubleParameters* para = node.det.extension<dd4hep::rec::DoubleParameters>(false);
+      if(not para) {
+        para = new dd4hep::rec::DoubleParameters;
+        node.det.addExtension<dd4hep::rec::DoubleParameters>(para);
+      }
+      para->doubleParameters["SortingPolicy"] = rValue;
+      if(debug) {
+        printout(PrintLevel::DEBUG, LOG_SOURCE, "Added extension to %s, matching %s "
+                 " path %s, type %s, zPos %3.5f, value %3.5f",
+                 node.det.name(), pathToLinear[match].first.c_str(),
+                 node.path.c_str(), node.det.type().c_str(),
+                 zPosition, rValue);
+      }
     }
 
     return 1;
@@ -1,9 +1,22 @@
 #include "DD4hep/Version.h"
+#include "DD4hep/DD4hepUnits.h"
+#include "DDRec/DetectorData.h"
 #include "DDG4/Geant4SensDetAction.inl"
 #include "DDG4/Geant4EventAction.h"
+#include "DDG4/Geant4RunAction.h"
 #include "DDG4/Geant4Mapping.h"
 #include "G4OpticalPhoton.hh"
 #include "G4VProcess.hh"
+#include "G4TouchableHandle.hh"
+#include "G4VPhysicalVolume.hh"
+#include "G4LogicalVolume.hh"
+#include "G4ProcessTable.hh"
+#include "G4ProcessVector.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
 
 #if DD4HEP_VERSION_GE(1, 21)
 #define GEANT4_CONST_STEP const
@@ -22,6 +35,8 @@ namespace dd4hep {
      *  of a TPC, where every pad row is devided into two halfs in order to get
      *  the position from the crossing of the middle of the pad row from
      *  geant4 via volume boundary. Ported of Mokka/TPCSD04.cc
+     *  The radii of the pad row centres are taken from the FixedPadSizeTPCData of the
+     *  detector if present, otherwise they are memorised from the first crossings.
      * 
      *  \author  F.Gaede ( ported from Mokka/TPCSD04.cc )
      *  \version 1.0
@@ -34,11 +49,75 @@ namespace dd4hep {
 	double TPCLowPtCut {};
 	bool   TPCLowPtStepLimit {};
         double TPCLowPtMaxHitSeparation {};
+        double TPCSpacePointSeparation {};
+        bool   TPCProfile {};
       } Control {};
 
+      /// optional timing of the branches of process, enabled with the property TPCProfile
+      struct Profile {
+	typedef std::chrono::steady_clock Clock;
+	enum { HighPt, LowPt, HitCreation, nBins };
+	double time[nBins] {};                // ns per bin, hit creation is included in the branches as well
+	long   count[nBins] {};
+      } profile {};
+
+      /// adds the time of its scope to a bin of the profile if profiling is enabled
+      struct ProfileScope {
+	Profile* profile ;
+	int bin ;
+	Profile::Clock::time_point start ;
+	ProfileScope( TPCSDData& data, int b ) : profile( data.Control.TPCProfile ? &data.profile : 0 ), bin( b ) {
+	  if( profile ) start = Profile::Clock::now() ;
+	}
+	~ProfileScope() {
+	  if( !profile ) return ;
+	  profile->time[bin] += std::chrono::duration<double, std::nano>( Profile::Clock::now() - start ).count() ;
+	  ++profile->count[bin] ;
+	}
+      };
+
+      /// the quantities of a step needed to make a hit after Geant4 has moved on to the next step
+      struct StepSnapshot {
+	G4int trackID{};
+	G4int pdg{};
+	long long cellID{};
+	int layer{};                          // layer of the pre-step volume
+	G4ThreeVector prePosition{};
+	G4ThreeVector postPosition{};
+	G4ThreeVector preMomentum{};
+	G4ThreeVector postMomentum{};
+	G4double globalTime{};
+      };
+
+      /// accumulation state of one track: the pad row crossing of high pt tracks and the
+      /// cumulative hits of low pt tracks are never mixed between tracks
+      struct TrackState {
+	bool inPadRow{};                      // the track has steps in the current pad row
+	StepSnapshot entrance{};              // first step in the current pad row
+	G4ThreeVector CrossingOfPadRingCentre{};
+	G4ThreeVector MomentumAtPadRingCentre{};
+	G4double dEInPadRow{};
+	G4double globalTimeAtPadRingCentre{};
+	G4double pathLengthInPadRow{};
+
+	G4double CumulativePathLength{};
+	G4double CumulativeEnergyDeposit{};
+	G4double CumulativeMeanTime{};
+	G4ThreeVector CumulativeMeanPosition{};
+	G4ThreeVector CumulativeMeanMomentum{};
+	G4int CumulativeNumSteps{};
+
+	bool hasPreviousStep{};
+	StepSnapshot previousStep{};          // last step of the track
+
+	bool hasSpacePoint{};
+	G4ThreeVector lastSpacePoint{};       // position of the last space point of the track
+      };
+
       typedef Geant4HitCollection HitCollection;
       Geant4Sensitive*  sensitive{};
       const BitFieldElement* layerField {};
+      bool cellIDFromVolume{};                // the readout has no segmentation, the cellID only changes with the volume
 
       G4double fThresholdEnergyDeposit{};
       Geant4HitCollection *fHitCollection{};
@@ -47,23 +126,26 @@ namespace dd4hep {
       G4int fHCID{};
       G4int fSpaceHitCollectionID{};
       G4int fLowPtHitCollectionID{};
-      
-      G4Step GEANT4_CONST_STEP * StepAtEntranceToPadRing{};
-      G4ThreeVector CrossingOfPadRingCentre{};
-      G4ThreeVector MomentumAtPadRingCentre{};
-      G4double dEInPadRow{};
-      G4double globalTimeAtPadRingCentre{};
-      G4double pathLengthInPadRow{};
-
-      G4double CumulativePathLength{};
-      G4double CumulativeEnergyDeposit{};
-      G4double CumulativeMeanTime{};
-      G4ThreeVector CumulativeMeanPosition{};
-      G4ThreeVector CumulativeMeanMomentum{};
-      G4int CumulativeNumSteps{};
-
-      G4Step GEANT4_CONST_STEP * previousStep{};
-      std::map < int, G4double > padRowCentralRadii{};
+      long nSpacePoints{};                    // space points written in this event
+      long nSpacePointsThinned{};             // space points skipped in this event because of TPCSpacePointSeparation
+
+      // one instance per worker thread: the state of the tracks of the current event, by track ID
+      std::unordered_map< G4int, TrackState > trackStates{};
+      G4int currentTrackID{};
+      TrackState* currentTrackState{};
+
+      // cellID of the last pre-step volume, the handle keeps the touchable alive for the comparison
+      G4TouchableHandle lastTouchable{};
+      long long lastCellID{};
+
+      std::vector< G4double > padRowCentralRadii{};  // radius of the centre of each pad row, 0 if not known
+
+      // the StepLimiter processes of this thread, resolved at the begin of each run
+      std::vector< const G4VProcess* > stepLimiters{};
+
+      // layer of the volumes of this sensitive detector, filled on first use: the layer ID is
+      // attached to the placement of the pad row halves, so it is the same for every path to them
+      std::unordered_map< const G4VPhysicalVolume*, int > layerByVolume{};
 
       TPCSDData() : 
 	fThresholdEnergyDeposit(0),
@@ -76,22 +158,114 @@ namespace dd4hep {
 	Control.TPCLowPtCut = CLHEP::MeV ;
 	Control.TPCLowPtStepLimit = false ;
 	Control.TPCLowPtMaxHitSeparation = 5. * CLHEP::mm ;
+	Control.TPCSpacePointSeparation = 0. ;
+	Control.TPCProfile = false ;
 
       }
 
 
      /// Clear collected information and restart for new hit
       void clear()  {
-	// nothing to clear
+	trackStates.clear() ;
+	currentTrackState = 0 ;
+      }
+
+
+      /// Pre-run action callback: resolve the StepLimiter processes once instead of comparing process names per step
+      void beginRun(const G4Run* /* run */) {
+	stepLimiters.clear() ;
+	G4ProcessVector* processes = G4ProcessTable::GetProcessTable()->FindProcesses( "StepLimiter" ) ;
+	for( std::size_t i=0 ; i<processes->size() ; ++i ) stepLimiters.push_back( (*processes)[i] ) ;
+	delete processes ;
+	for( int bin=0 ; bin<Profile::nBins ; ++bin ) {
+	  profile.time[bin] = 0 ;
+	  profile.count[bin] = 0 ;
+	}
+      }
+
+
+      /// Post-run action callback: print the profile
+      void endRun(const G4Run* /* run */) {
+	if( !Control.TPCProfile ) return ;
+	const char* names[Profile::nBins] = { "high pt branch", "low pt branch", "hit creation" } ;
+	for( int bin=0 ; bin<Profile::nBins ; ++bin ) {
+	  sensitive->info("+++ [%s] profile %-15s %12ld calls %12.1f ns/call %12.3f s", sensitive->c_name(), names[bin], profile.count[bin],
+			  ( profile.count[bin] > 0 ? profile.time[bin]/profile.count[bin] : 0.0 ), profile.time[bin]*1e-9);
+	}
+      }
+
+
+      /// return whether the step was limited by a StepLimiter process
+      bool isStepLimiter( const G4VProcess* process ) const {
+	for( const G4VProcess* stepLimiter : stepLimiters ) {
+	  if( process == stepLimiter ) return true ;
+	}
+	return false ;
+      }
+
+
+      /// return the state of the track, created for the first step of the track in this event
+      TrackState& trackState( G4int trackID ) {
+	if( !currentTrackState || trackID != currentTrackID ) {
+	  currentTrackState = &trackStates[ trackID ] ;  // node based, the pointer stays valid
+	  currentTrackID = trackID ;
+	}
+	return *currentTrackState ;
+      }
+
+
+      /// return the cellID of the pre-step volume, computed once per volume for a readout without segmentation
+      long long cellID( G4Step GEANT4_CONST_STEP * step ) {
+	if( !cellIDFromVolume ) return sensitive->cellID( step ) ;
+	const G4TouchableHandle& touchable = step->GetPreStepPoint()->GetTouchableHandle() ;
+	if( !( touchable == lastTouchable ) ) {
+	  lastCellID = sensitive->cellID( step ) ;
+	  lastTouchable = touchable ;
+	}
+	return lastCellID ;
+      }
+
+
+      /// return the snapshot of the step
+      StepSnapshot snapshot( G4Step GEANT4_CONST_STEP * step ) {
+	StepSnapshot s ;
+	s.trackID      = step->GetTrack()->GetTrackID() ;
+	s.pdg          = step->GetTrack()->GetDefinition()->GetPDGEncoding() ;
+	s.cellID       = cellID( step ) ;
+	s.layer        = layerField->value( s.cellID ) ;
+	s.prePosition  = step->GetPreStepPoint()->GetPosition() ;
+	s.postPosition = step->GetPostStepPoint()->GetPosition() ;
+	s.preMomentum  = step->GetPreStepPoint()->GetMomentum() ;
+	s.postMomentum = step->GetPostStepPoint()->GetMomentum() ;
+	s.globalTime   = step->GetTrack()->GetGlobalTime() ;
+	return s ;
+      }
+
+
+      /// return the radius of the centre of the pad row, 0 if not known
+      G4double padRowCentralRadius( int row ) const {
+	return ( row >= 0 && row < int(padRowCentralRadii.size()) ? padRowCentralRadii[row] : 0.0 ) ;
       }
 
 
       /// return the layer number of the volume (either pre or post-position )
       int getCopyNumber(G4Step GEANT4_CONST_STEP * step, bool usePostPos ){
 
+	const G4StepPoint* point = ( usePostPos ? step->GetPostStepPoint() : step->GetPreStepPoint() ) ;
+	const G4VPhysicalVolume* pv = point->GetPhysicalVolume() ;
+
+	// only the volumes of this sensitive detector are cached, others are resolved by the volume manager
+	const bool cached = ( pv && pv->GetLogicalVolume()->GetSensitiveDetector() == step->GetPreStepPoint()->GetSensitiveDetector() ) ;
+	if( cached ) {
+	  auto it = layerByVolume.find( pv ) ;
+	  if( it != layerByVolume.end() ) return it->second ;
+	}
+
 	int cellID = this->volID( step , usePostPos) ;
+	int layer = this->layerField->value( cellID ) ;
 
-	return this->layerField->value( cellID ) ;
+	if( cached ) layerByVolume.emplace( pv, layer ) ;
+	return layer ;
       }
 
 
@@ -148,10 +322,14 @@ namespace dd4hep {
   
   
 	if (fabs(step->GetTrack()->GetDefinition()->GetPDGCharge()) < 0.01) return true;
+
+	// Geant4 reuses the G4Step object for all steps, keep what is needed later in the state of the track
+	TrackState& state = trackState( step->GetTrack()->GetTrackID() ) ;
+	const StepSnapshot current = snapshot( step ) ;
   
-	const G4ThreeVector PrePosition = step->GetPreStepPoint()->GetPosition();
-	const G4ThreeVector PostPosition = step->GetPostStepPoint()->GetPosition();
-	const G4ThreeVector thisMomentum = step->GetPostStepPoint()->GetMomentum();
+	const G4ThreeVector& PrePosition = current.prePosition;
+	const G4ThreeVector& PostPosition = current.postPosition;
+	const G4ThreeVector& thisMomentum = current.postMomentum;
   
 	float ptSQRD = thisMomentum[0]*thisMomentum[0]+thisMomentum[1]*thisMomentum[1];
 
@@ -159,65 +337,79 @@ namespace dd4hep {
 	//=========================================================================================================
 
 	if( ptSQRD >= (Control.TPCLowPtCut*Control.TPCLowPtCut) ){
+	  ProfileScope scope( *this, Profile::HighPt ) ;
 
 	  // ===================== first check we have no left-over low-pt stuff
           // This step does not continue the previous path. Deposit the energy up to the previous step
-          if (CumulativeEnergyDeposit > fThresholdEnergyDeposit) {
-            DepositLowPtHit( previousStep );
+          if (state.CumulativeEnergyDeposit > fThresholdEnergyDeposit) {
+            DepositLowPtHit( state, state.previousStep );
           } else {
-            ResetCumulativeVariables(); // set low pt cumulation to zero
+            ResetCumulativeVariables( state ); // set low pt cumulation to zero
           }
           //=== end of low pt cleaning-up
 
 	  //=========================================================================================================
 
-	  if ( !StepAtEntranceToPadRing ) { // first step in this padrow
-            StepAtEntranceToPadRing=step;
+	  if ( !state.inPadRow ) { // first step in this padrow
+            state.inPadRow = true;
+            state.entrance = current;
           }
 
 	  // Step finishes at a geometric boundry
 	  if(step->GetPostStepPoint()->GetStepStatus() == fGeomBoundary) {
 
 	    // accumulate step in current pad row
-            dEInPadRow += step->GetTotalEnergyDeposit();
-            pathLengthInPadRow += step->GetStepLength();
-            int innercopy = getCopyNumber( step, false );
+            state.dEInPadRow += step->GetTotalEnergyDeposit();
+            state.pathLengthInPadRow += step->GetStepLength();
+            int innercopy = current.layer;
 	    if ( innercopy == getCopyNumber( step, true ) ){ // pre == post; step within the same pair of upper and lower pad ring halves
 	      //this step must have ended on the boundry between these two pad ring halfves
               //record the tracks coordinates at this position
-              CrossingOfPadRingCentre = PostPosition;
-              MomentumAtPadRingCentre = thisMomentum;
-              globalTimeAtPadRingCentre = step->GetTrack()->GetGlobalTime();
+              state.CrossingOfPadRingCentre = PostPosition;
+              state.MomentumAtPadRingCentre = thisMomentum;
+              state.globalTimeAtPadRingCentre = current.globalTime;
 
 
-	      // here we memorise the padrow positions, we need them in some special cases
-              if ( padRowCentralRadii.find( innercopy ) == padRowCentralRadii.end() ) {
-                padRowCentralRadii[ innercopy ] = sqrt( pow( CrossingOfPadRingCentre.x(), 2 ) + pow( CrossingOfPadRingCentre.y(), 2 ) );
+	      // here we memorise the padrow positions if the geometry did not provide them, we need them in some special cases
+              if ( innercopy >= 0 && padRowCentralRadius( innercopy ) == 0.0 ) {
+                if ( int(padRowCentralRadii.size()) <= innercopy ) padRowCentralRadii.resize( innercopy+1, 0.0 );
+                padRowCentralRadii[ innercopy ] = sqrt( pow( state.CrossingOfPadRingCentre.x(), 2 ) + pow( state.CrossingOfPadRingCentre.y(), 2 ) );
               }
 
 	    } else { // has crossed into new padrow, consider making hit
-              DepositHiPtHit( step );
+              DepositHiPtHit( state, current );
             }
 
 	  } else {  // case for which the step remains within geometric volume
 
 	    // accumulate
-	    dEInPadRow += step->GetTotalEnergyDeposit();
-            pathLengthInPadRow += step->GetStepLength();
+	    state.dEInPadRow += step->GetTotalEnergyDeposit();
+            state.pathLengthInPadRow += step->GetStepLength();
 
             if ( step->GetPostStepPoint()->GetKineticEnergy() == 0 ) { // particle stopped in padring
-	      DepositHiPtHit( step );
-	    } else if ( step->GetPostStepPoint()->GetProcessDefinedStep()->GetProcessName() == "StepLimiter"){ // step limited by distance
-	      // write out a zero energy hit in the spacehitcollection
-	      Geant4Tracker::Hit* hit = new Geant4Tracker::Hit(step->GetTrack()->GetTrackID(),
-							       step->GetTrack()->GetDefinition()->GetPDGEncoding(),
-							       0.0,                          // dE set to ZERO
-							       globalTimeAtPadRingCentre);  // this time may or may not be defined already
-	      hit->position = 0.5*( PrePosition + PostPosition );
-	      hit->momentum = thisMomentum ;
-	      hit->length   = step->GetStepLength();
-	      hit->cellID   = sensitive->cellID( step ) ;
-	      fSpaceHitCollection->add(hit);
+	      DepositHiPtHit( state, current );
+	    } else if ( isStepLimiter( step->GetPostStepPoint()->GetProcessDefinedStep() ) ){ // step limited by distance
+	      const G4ThreeVector spacePoint = 0.5*( PrePosition + PostPosition );
+	      // with TPCSpacePointSeparation only space points at least this far from the last one of the track are written
+	      if ( Control.TPCSpacePointSeparation > 0 && state.hasSpacePoint &&
+		   ( spacePoint - state.lastSpacePoint ).mag2() < Control.TPCSpacePointSeparation*Control.TPCSpacePointSeparation ) {
+		++nSpacePointsThinned;
+	      } else {
+		state.hasSpacePoint = true;
+		state.lastSpacePoint = spacePoint;
+		++nSpacePoints;
+		// write out a zero energy hit in the spacehitcollection
+		ProfileScope hitScope( *this, Profile::HitCreation ) ;
+		Geant4Tracker::Hit* hit = new Geant4Tracker::Hit(current.trackID,
+								 current.pdg,
+								 0.0,                          // dE set to ZERO
+								 state.globalTimeAtPadRingCentre);  // this time may or may not be defined already
+		hit->position = spacePoint;
+		hit->momentum = thisMomentum ;
+		hit->length   = step->GetStepLength();
+		hit->cellID   = current.cellID ;
+		fSpaceHitCollection->add(hit);
+	      }
 	    }
 
 	  }
@@ -229,64 +421,66 @@ namespace dd4hep {
 	//   ptSQRD < (Control.TPCLowPtCut*Control.TPCLowPtCut)
 
 	else if (Control.TPCLowPtStepLimit) { // low pt tracks will be treated differently as their step length is limited by the special low pt steplimiter
+	  ProfileScope scope( *this, Profile::LowPt ) ;
     
 	  //--------------------------------
           // first check if there is padrow stuff left over to deposit
-          if ( dEInPadRow > 0 ) {
+          if ( state.dEInPadRow > 0 ) {
             G4cout << " WARNING left over padrow stuff (from high pt tracks) deposit hipt" << std::endl;
-            DepositHiPtHit( previousStep ); // use stored previous step
+            DepositHiPtHit( state, state.previousStep ); // use stored previous step
           }
           //--------------------------------
 
 
-	  if ( previousStep && 
-	       (  previousStep->GetPostStepPoint()->GetPosition() - step->GetPreStepPoint()->GetPosition() ).mag() > 1.0e-6 * CLHEP::mm ) {
+	  if ( state.hasPreviousStep && 
+	       (  state.previousStep.postPosition - PrePosition ).mag() > 1.0e-6 * CLHEP::mm ) {
       
 	    // This step does not continue the previous path. Deposit the energy and begin a new Pt hit.
       
-	    if (CumulativeEnergyDeposit > fThresholdEnergyDeposit) {
+	    if (state.CumulativeEnergyDeposit > fThresholdEnergyDeposit) {
 	      //dumpStep( h , step ) ;
-	      DepositLowPtHit( previousStep );
+	      DepositLowPtHit( state, state.previousStep );
 	    }
       
 	    else {
 	      // reset the cumulative variables if the hit has not been deposited.
 	      // The previous track has ended and the cumulated energy left at the end 
 	      // was not enough to ionize
-	      ResetCumulativeVariables();
+	      ResetCumulativeVariables( state );
 	    }
 
 	  }
 
-	  CumulateLowPtStep(step);  
+	  CumulateLowPtStep( state, step );  
 
     
 	  // check whether to deposit the hit
           if ( step->GetPostStepPoint()->GetKineticEnergy() == 0 ) { // particle stopped
-            if ( CumulativeEnergyDeposit > fThresholdEnergyDeposit ) { // enough energy
-              DepositLowPtHit( step ); // make hit ending with this step
+            if ( state.CumulativeEnergyDeposit > fThresholdEnergyDeposit ) { // enough energy
+              DepositLowPtHit( state, current ); // make hit ending with this step
             } else {
-              ResetCumulativeVariables(); // not enough energy: reset/ignore it
+              ResetCumulativeVariables( state ); // not enough energy: reset/ignore it
             }
           }
 
 
 
-	  if( ( CumulativePathLength > Control.TPCLowPtMaxHitSeparation )  ) {
+	  if( ( state.CumulativePathLength > Control.TPCLowPtMaxHitSeparation )  ) {
       
 	    // hit is deposited because the step limit is reached and there is enough energy
 	    // to ionize
       
-	    if ( CumulativeEnergyDeposit > fThresholdEnergyDeposit) {
+	    if ( state.CumulativeEnergyDeposit > fThresholdEnergyDeposit) {
 	      //dumpStep( h , step ) ;
-	      DepositLowPtHit( step );
+	      DepositLowPtHit( state, current );
 	    }
 	  }
 
 	}
 
 	// keep track of previous step
-        previousStep = step;
+        state.previousStep = current;
+        state.hasPreviousStep = true;
 
 	return true;
 	
@@ -297,116 +491,128 @@ namespace dd4hep {
       /// Post-event action callback
       void endEvent(const G4Event* /* event */)   {
 
-        ResetPadrowVariables();
+	// in the order of the track IDs, independent of the order of the hash map
+	std::vector< G4int > trackIDs ;
+	trackIDs.reserve( trackStates.size() ) ;
+	for( const auto& entry : trackStates ) trackIDs.push_back( entry.first ) ;
+	std::sort( trackIDs.begin(), trackIDs.end() ) ;
+
+	for( G4int trackID : trackIDs ) {
+	  TrackState& state = trackStates[ trackID ] ;
+	  ResetPadrowVariables( state );
+
+	  // ===================== finally check we have no left-over low-pt stuff
+	  if (state.CumulativeEnergyDeposit > fThresholdEnergyDeposit) {
+	    DepositLowPtHit( state, state.previousStep );        // Deposit the energy
+	  }
+	  ResetCumulativeVariables( state );
+	}
+
+	if ( Control.TPCSpacePointSeparation > 0 ) {
+	  sensitive->printM1("+++ [%s] wrote %ld space points, %ld thinned with TPCSpacePointSeparation %e mm",
+			     sensitive->c_name(), nSpacePoints, nSpacePointsThinned, Control.TPCSpacePointSeparation/CLHEP::mm);
+	}
+	nSpacePoints = 0 ;
+	nSpacePointsThinned = 0 ;
 
-	// ===================== finally check we have no left-over low-pt stuff
-        if (CumulativeEnergyDeposit > fThresholdEnergyDeposit) {
-          DepositLowPtHit( previousStep );        // Deposit the energy
-        }
-        ResetCumulativeVariables();
+	clear();
 
       }
   
-      void ResetPadrowVariables () // DJ added
+      void ResetPadrowVariables ( TrackState& state ) // DJ added
       {
-        dEInPadRow = 0.0;
-        globalTimeAtPadRingCentre=0.0;
-        pathLengthInPadRow=0.0;
-        CrossingOfPadRingCentre[0]=0.0;
-        CrossingOfPadRingCentre[1]=0.0;
-        CrossingOfPadRingCentre[2]=0.0;
-        MomentumAtPadRingCentre[0]=0.0;
-        MomentumAtPadRingCentre[1]=0.0;
-        MomentumAtPadRingCentre[2]=0.0;
-        StepAtEntranceToPadRing=0;
+        state.dEInPadRow = 0.0;
+        state.globalTimeAtPadRingCentre=0.0;
+        state.pathLengthInPadRow=0.0;
+        state.CrossingOfPadRingCentre.set(0.0,0.0,0.0);
+        state.MomentumAtPadRingCentre.set(0.0,0.0,0.0);
+        state.inPadRow=false;
       }
 
-      void DepositHiPtHit(G4Step GEANT4_CONST_STEP * step) // DJ extracted to separate fn
+      void DepositHiPtHit( TrackState& state, const StepSnapshot& step ) // DJ extracted to separate fn
       {
-        if ( dEInPadRow > fThresholdEnergyDeposit ) {
+        if ( state.dEInPadRow > fThresholdEnergyDeposit ) {
 
           bool rareError=false;
 
-          if( CrossingOfPadRingCentre[0]<0.1 && CrossingOfPadRingCentre[1]<0.1 && CrossingOfPadRingCentre[2]<0.1 ) {
+          if( state.CrossingOfPadRingCentre[0]<0.1 && state.CrossingOfPadRingCentre[1]<0.1 && state.CrossingOfPadRingCentre[2]<0.1 ) {
             // series of steps did not cross the centre of pad row; make reasonable estimate
-            int innercopy = getCopyNumber( step, false );
-            if ( padRowCentralRadii.find( innercopy ) != padRowCentralRadii.end() ) { // we know radius of this pad row
+            const G4double padRowRadius = padRowCentralRadius( step.layer );
+            if ( padRowRadius > 0.0 ) { // we know radius of this pad row
               // average of first and last points of this series of steps
-              const G4ThreeVector AvePos = 0.5*( StepAtEntranceToPadRing->GetPreStepPoint()->GetPosition() + step->GetPostStepPoint()->GetPosition() );
+              const G4ThreeVector AvePos = 0.5*( state.entrance.prePosition + step.postPosition );
               G4double radius = sqrt( pow(AvePos.x(), 2)+pow(AvePos.y(), 2) );
-              CrossingOfPadRingCentre = AvePos*( padRowCentralRadii[innercopy]/radius ); // move radially to centre of pad row
+              state.CrossingOfPadRingCentre = AvePos*( padRowRadius/radius ); // move radially to centre of pad row
               // time and momentum: average of intial and final
-              globalTimeAtPadRingCentre = 0.5*(StepAtEntranceToPadRing->GetTrack()->GetGlobalTime() + step->GetTrack()->GetGlobalTime() );
-              MomentumAtPadRingCentre = 0.5*(StepAtEntranceToPadRing->GetPreStepPoint()->GetMomentum() + step->GetPostStepPoint()->GetMomentum() );
-            } else { // have not yet seen this pad row in this job
-              // in principle we can get this from geometry information, but don't want to add extra dependencies...
+              state.globalTimeAtPadRingCentre = 0.5*( state.entrance.globalTime + step.globalTime );
+              state.MomentumAtPadRingCentre = 0.5*( state.entrance.preMomentum + step.postMomentum );
+            } else { // no FixedPadSizeTPCData and have not yet seen this pad row in this job
               G4cout << " WARNING: dont yet know radius of this pad row...ignoring this energy deposit (should be v rare: eg possibly in first track(s) of first event)" << std::endl;
               rareError=true;
             }
           }
 
           if ( !rareError ) {
-	    Geant4Tracker::Hit* hit = new Geant4Tracker::Hit(step->GetTrack()->GetTrackID(),
-                                                             step->GetTrack()->GetDefinition()->GetPDGEncoding(),
-                                                             dEInPadRow, globalTimeAtPadRingCentre);
-            hit->position = CrossingOfPadRingCentre;
-            hit->momentum = MomentumAtPadRingCentre;
-            hit->length   = pathLengthInPadRow;
-            hit->cellID   = sensitive->cellID( step ) ;
+	    ProfileScope hitScope( *this, Profile::HitCreation ) ;
+	    Geant4Tracker::Hit* hit = new Geant4Tracker::Hit(step.trackID,
+                                                             step.pdg,
+                                                             state.dEInPadRow, state.globalTimeAtPadRingCentre);
+            hit->position = state.CrossingOfPadRingCentre;
+            hit->momentum = state.MomentumAtPadRingCentre;
+            hit->length   = state.pathLengthInPadRow;
+            hit->cellID   = step.cellID ;
             fHitCollection->add(hit);
             sensitive->printM2("+++ TrackID:%6d [%s] CREATE TPC hit at pad row crossing :"
                                " %e MeV  Pos:%8.2f %8.2f %8.2f",
-                               step->GetTrack()->GetTrackID(),sensitive->c_name(), dEInPadRow,
+                               step.trackID,sensitive->c_name(), state.dEInPadRow,
                                hit->position.X()/CLHEP::mm,hit->position.Y()/CLHEP::mm,hit->position.Z()/CLHEP::mm);
           }
         } // en threshold
-        ResetPadrowVariables();
+        ResetPadrowVariables( state );
       }
 
 
 
-      void ResetCumulativeVariables()
+      void ResetCumulativeVariables( TrackState& state )
       {
-	CumulativeMeanPosition.set(0.0,0.0,0.0);
-	CumulativeMeanMomentum.set(0.0,0.0,0.0);
-        CumulativeMeanTime=0;
-	CumulativeNumSteps = 0;
-	CumulativeEnergyDeposit = 0;
-	CumulativePathLength = 0;
+	state.CumulativeMeanPosition.set(0.0,0.0,0.0);
+	state.CumulativeMeanMomentum.set(0.0,0.0,0.0);
+        state.CumulativeMeanTime=0;
+	state.CumulativeNumSteps = 0;
+	state.CumulativeEnergyDeposit = 0;
+	state.CumulativePathLength = 0;
       }
 
-      void DepositLowPtHit( G4Step GEANT4_CONST_STEP * step )
+      void DepositLowPtHit( TrackState& state, const StepSnapshot& step )
       {
+	ProfileScope hitScope( *this, Profile::HitCreation ) ;
 
-	Geant4Tracker::Hit* hit = new Geant4Tracker::Hit( step->GetTrack()->GetTrackID(),
-                                                          step->GetTrack()->GetDefinition()->GetPDGEncoding(),
-                                                          CumulativeEnergyDeposit,
-                                                          CumulativeMeanTime/CumulativeNumSteps ); // DJ : simple average of all steps' time
+	Geant4Tracker::Hit* hit = new Geant4Tracker::Hit( step.trackID,
+                                                          step.pdg,
+                                                          state.CumulativeEnergyDeposit,
+                                                          state.CumulativeMeanTime/state.CumulativeNumSteps ); // DJ : simple average of all steps' time
   
-	hit->position = CumulativeMeanPosition/CumulativeNumSteps ;
-	hit->momentum = CumulativeMeanMomentum/CumulativeNumSteps ;
-	hit->length   = CumulativePathLength ;
-        hit->cellID   = sensitive->cellID(step) ;
+	hit->position = state.CumulativeMeanPosition/state.CumulativeNumSteps ;
+	hit->momentum = state.CumulativeMeanMomentum/state.CumulativeNumSteps ;
+	hit->length   = state.CumulativePathLength ;
+        hit->cellID   = step.cellID ;
 
 
 	fLowPtHitCollection->add(hit);
 
 	// reset the cumulative variables after positioning the hit
-	ResetCumulativeVariables();
+	ResetCumulativeVariables( state );
       }
       
-      void CumulateLowPtStep(G4Step GEANT4_CONST_STEP * step)
+      void CumulateLowPtStep( TrackState& state, G4Step GEANT4_CONST_STEP * step )
       {
 	
-	const G4ThreeVector meanPosition = (step->GetPreStepPoint()->GetPosition() + step->GetPostStepPoint()->GetPosition()) / 2;
-	const G4ThreeVector meanMomentum = (step->GetPreStepPoint()->GetMomentum() + step->GetPostStepPoint()->GetMomentum()) / 2;
-	
-	++CumulativeNumSteps;    
-        CumulativeMeanPosition += (step->GetPreStepPoint()->GetPosition() + step->GetPostStepPoint()->GetPosition()) / 2;
-        CumulativeMeanMomentum += (step->GetPreStepPoint()->GetMomentum() + step->GetPostStepPoint()->GetMomentum()) / 2;
-	CumulativeEnergyDeposit += step->GetTotalEnergyDeposit();
-	CumulativePathLength += step->GetStepLength();
-	CumulativeMeanTime += step->GetTrack()->GetGlobalTime();
+	++state.CumulativeNumSteps;    
+        state.CumulativeMeanPosition += (step->GetPreStepPoint()->GetPosition() + step->GetPostStepPoint()->GetPosition()) / 2;
+        state.CumulativeMeanMomentum += (step->GetPreStepPoint()->GetMomentum() + step->GetPostStepPoint()->GetMomentum()) / 2;
+	state.CumulativeEnergyDeposit += step->GetTotalEnergyDeposit();
+	state.CumulativePathLength += step->GetStepLength();
+	state.CumulativeMeanTime += step->GetTrack()->GetGlobalTime();
       }
       
     };
@@ -415,16 +621,30 @@ namespace dd4hep {
     /// Initialization overload for specialization
     template <> void Geant4SensitiveAction<TPCSDData>::initialize() {
       eventAction().callAtEnd(&m_userData,&TPCSDData::endEvent);
+      runAction().callAtBegin(&m_userData,&TPCSDData::beginRun);
+      runAction().callAtEnd(&m_userData,&TPCSDData::endRun);
 
       declareProperty("TPCLowPtCut",              m_userData.Control.TPCLowPtCut ); 
       declareProperty("TPCLowPtStepLimit",        m_userData.Control.TPCLowPtStepLimit );
       declareProperty("TPCLowPtMaxHitSeparation", m_userData.Control.TPCLowPtMaxHitSeparation );
+      declareProperty("TPCSpacePointSeparation",  m_userData.Control.TPCSpacePointSeparation );
+      declareProperty("TPCProfile",               m_userData.Control.TPCProfile );
 
       m_userData.fThresholdEnergyDeposit = m_sensitive.energyCutoff();
       m_userData.sensitive = this;
 
       IDDescriptor dsc = m_sensitive.idSpec() ;
       m_userData.layerField = dsc.field( "layer" ) ;
+      m_userData.cellIDFromVolume = !m_segmentation.isValid() ;
+
+      // the pad rows of a FixedPadSizeTPCData start at rMinReadout and have the same height
+      const rec::FixedPadSizeTPCData* tpcData = m_detector.extension<rec::FixedPadSizeTPCData>( false ) ;
+      if( tpcData ) {
+	m_userData.padRowCentralRadii.clear() ;
+	for( int row=0 ; row<tpcData->maxRow ; ++row ) {
+	  m_userData.padRowCentralRadii.push_back( ( tpcData->rMinReadout + ( row + 0.5 )*tpcData->padHeight ) * CLHEP::cm / dd4hep::cm ) ;
+	}
+      }
 
     }
 